@@ -0,0 +1,62 @@
+#pragma once
+
+//
+// Registry encoding of an action slot, 0x00MMRRKK:
+//   MM - BTN_ACTION_MODE
+//   RR - HID report ID (REPORTID_CAPKEY_*)
+//   KK - Key bits within that report, in BTN_REPORT order
+//
+#define BTN_ACTION_VALUE(Mode, ReportId, Keys) \
+    (((ULONG)(Mode) << 16) | ((ULONG)(ReportId) << 8) | (ULONG)(Keys))
+
+#define BTN_ACTION_VALUE_MODE(Value)        ((UCHAR)((Value) >> 16))
+#define BTN_ACTION_VALUE_REPORT_ID(Value)   ((UCHAR)((Value) >> 8))
+#define BTN_ACTION_VALUE_KEYS(Value)        ((UCHAR)(Value))
+
+//
+// Upper bound of a chord's tolerance, in milliseconds. Presses held back for
+// a chord are delayed by up to this much.
+//
+#define BTN_CHORD_MAX_TOLERANCE_MS          200
+
+//
+// Registry encoding of a chord, 0x00TTSSMM:
+//   TT - Tolerance in milliseconds, up to BTN_CHORD_MAX_TOLERANCE_MS
+//   SS - BTN_ACTION_SLOT fired by the chord
+//   MM - BUTTON_BIT of every key of the chord, at least two
+//
+#define BTN_CHORD_VALUE(Mask, Slot, ToleranceMs) \
+    (((ULONG)(ToleranceMs) << 16) | ((ULONG)(Slot) << 8) | (ULONG)(Mask))
+
+#define BTN_CHORD_VALUE_TOLERANCE_MS(Value) ((UCHAR)((Value) >> 16))
+#define BTN_CHORD_VALUE_SLOT(Value)         ((UCHAR)((Value) >> 8))
+#define BTN_CHORD_VALUE_MASK(Value)         ((UCHAR)(Value))
+
+//
+// Valid key bits of each input report
+//
+#define BTN_KEYBOARD_KEYS_MASK              0x3F
+#define BTN_CONSUMER_KEYS_MASK              0x03
+#define BTN_CONTROL_KEYS_MASK               0x07
+
+NTSTATUS
+BtnLoadActionMap(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
+
+VOID
+BtnBuildTransitionTable(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
+
+FORCEINLINE
+const BTN_TRANSITION*
+BtnLookupTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE Button,
+    IN ULONG StateMask
+    )
+{
+    return &DeviceContext->Transitions[
+        BTN_TRANSITION_INDEX(DeviceContext->IgnoreButtonPresses, StateMask, Button)];
+}
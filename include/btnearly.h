@@ -0,0 +1,78 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Edges that arrive before the device is ready to report them.
+// tools/d0-race-sim races presses against the D0 entry sequence of the
+// driver to check that none are lost or reported twice.
+//
+// The debounced edges of every line wait in a small ring, oldest first,
+// until reporting is enabled; they are then fed through the normal
+// evaluation in order. The ring is bounded: once full, every new edge
+// pushes out the oldest. Edges older than the maximum age when the ring is
+// drained are dropped, a press that long ago is no longer what the user is
+// doing.
+//
+
+#pragma once
+
+#define BTN_EARLY_EDGES                 16
+#define BTN_EARLY_MAX_AGE_MS            1000
+
+typedef struct _BTN_EARLY_EDGE
+{
+    unsigned long long Time;
+    unsigned char Button;
+    unsigned char Pressed;
+} BTN_EARLY_EDGE;
+
+typedef struct _BTN_EARLY_RING
+{
+    unsigned long Head;
+    unsigned long Count;
+    BTN_EARLY_EDGE Edges[BTN_EARLY_EDGES];
+} BTN_EARLY_RING;
+
+//
+// Appends an edge. Returns 1 and the edge pushed out if the ring was full.
+//
+static __inline int BtnEarlyPush(
+    BTN_EARLY_RING* Ring,
+    const BTN_EARLY_EDGE* Edge,
+    BTN_EARLY_EDGE* Dropped)
+{
+    int full = Ring->Count == BTN_EARLY_EDGES;
+
+    if (full)
+    {
+        *Dropped = Ring->Edges[Ring->Head];
+        Ring->Head = (Ring->Head + 1) % BTN_EARLY_EDGES;
+        Ring->Count--;
+    }
+
+    Ring->Edges[(Ring->Head + Ring->Count) % BTN_EARLY_EDGES] = *Edge;
+    Ring->Count++;
+
+    return full;
+}
+
+//
+// Takes the oldest edge. Returns 0 once the ring is empty, 1 for an edge to
+// evaluate and -1 for one older than MaxAge at Now, to be dropped.
+//
+static __inline int BtnEarlyPop(
+    BTN_EARLY_RING* Ring,
+    unsigned long long Now,
+    unsigned long long MaxAge,
+    BTN_EARLY_EDGE* Edge)
+{
+    if (Ring->Count == 0)
+    {
+        return 0;
+    }
+
+    *Edge = Ring->Edges[Ring->Head];
+    Ring->Head = (Ring->Head + 1) % BTN_EARLY_EDGES;
+    Ring->Count--;
+
+    return Now > Edge->Time && Now - Edge->Time > MaxAge ? -1 : 1;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Binary trace events. Shared between the driver, which only uses the IDs,
+// and tools/btntrace, which formats records offline. Every format takes
+// exactly two unsigned 32-bit arguments, Arg1 then Arg2. IDs are positional:
+// append new events at the end and never reorder.
+//
+// This header must stay free of kernel headers.
+//
+
+#pragma once
+
+#define BTN_EVENT_LIST(EVENT) \
+    EVENT(Interrupt,            "button %u: interrupt, %u edges pending") \
+    EVENT(WorkItem,             "button %u: work item, %u drains requested") \
+    EVENT(EdgesDrained,         "button %u: %u edges drained") \
+    EVENT(EdgeBeforeReady,      "button %u: edge consumed during initialization, %u so far") /* retired */ \
+    EVENT(EdgeNotProcessed,     "button %u: edge dropped, interrupts not processed yet") /* retired */ \
+    EVENT(ButtonState,          "button %u: state mask 0x%02x") \
+    EVENT(ReportCompleted,      "report %u keys 0x%02x: read completed") \
+    EVENT(ReportParked,         "report %u keys 0x%02x: no read pending, parked") \
+    EVENT(ReportDropped,        "report %u keys 0x%02x: no read pending and ring full, dropped") \
+    EVENT(ReadFailed,           "read completion failed, status 0x%08x, buffer %u bytes") \
+    EVENT(EdgesFiltered,        "button %u: %u bouncing edges filtered") \
+    EVENT(EdgeSettled,          "button %u: settled, pressed %u") \
+    EVENT(DebounceTuned,        "button %u: debounce window now %u us") \
+    EVENT(Hold,                 "button %u: held, hold action fired") \
+    EVENT(Repeat,               "button %u: autorepeat, next in %u ms") \
+    EVENT(Gesture,              "button %u: %u taps recognized") \
+    EVENT(GestureReplayed,      "button %u: no gesture, %u held back edges replayed") \
+    EVENT(ChordFired,           "button %u: chord 0x%02x fired") \
+    EVENT(ChordReplayed,        "button %u: no chord, %u held back presses replayed") \
+    EVENT(Storm,                "button %u: interrupt budget exceeded") \
+    EVENT(StormMasked,          "button %u: masked for %u ms") \
+    EVENT(StormUnmasked,        "button %u: unmasked, state resynchronized") \
+    EVENT(Stuck,                "button %u: held for %u s, quarantined") \
+    EVENT(StuckCleared,         "button %u: released, quarantine lifted") \
+    EVENT(LevelRead,            "button %u: level read, pressed %u") \
+    EVENT(LevelReadFailed,      "level read of lines 0x%02x failed, status 0x%08x") \
+    EVENT(EdgeLost,             "button %u: edges disagree with level, pressed %u") \
+    EVENT(EdgeHeldUntilReady,   "button %u: edge held until ready, pressed %u") \
+    EVENT(EarlyEdgeDropped,     "button %u: edge held before ready dropped, %u ms old") \
+    EVENT(Lifecycle,            "lifecycle state %u entered from state %u") \
+    EVENT(LifecycleUnexpected,  "lifecycle state %u entered from unexpected state %u") \
+    EVENT(Wake,                 "button %u: idle request completed")
@@ -0,0 +1,131 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Multi-tap recognizer. Shared between the driver and tools/gesture-sim,
+// which benchmarks the delay it adds to single presses.
+//
+// A button with a double or triple tap action holds its edges back while a
+// tap pattern is in progress. Every press extends the pattern by the tap
+// window; the pattern completes early once it reaches the highest tap
+// count with an action, and otherwise ends when the window runs out, firing
+// the action for the taps counted or replaying the held back edges if that
+// count has none. A single press is therefore never delayed by more than
+// one window.
+//
+// This header must stay free of kernel headers.
+//
+
+#pragma once
+
+#define BTN_GESTURE_MAX_TAPS            3
+
+typedef struct _BTN_TAP_STATE
+{
+    unsigned long long Deadline;    // End of the pattern in progress, 0 if none
+    unsigned char TapMask;          // Bit n set if n taps have an action, n >= 2
+    unsigned char Taps;             // Presses in the pattern so far
+    unsigned char Active;           // Taps of a gesture whose last press is held, 0 if none
+} BTN_TAP_STATE;
+
+typedef enum _BTN_TAP_RESULT
+{
+    BtnTapPass = 0,     // Not part of a pattern, report the edge as usual
+    BtnTapDefer,        // Held back until the pattern ends
+    BtnTapFire,         // Pattern complete, report the gesture for Taps taps
+    BtnTapRelease,      // Last press of a fired gesture released
+    BtnTapReplay,       // Pattern ended without a gesture, report the held back edges
+} BTN_TAP_RESULT;
+
+static __inline unsigned long BtnTapMaxTaps(const BTN_TAP_STATE* State)
+{
+    unsigned long maxTaps = 1;
+
+    for (unsigned long taps = 2; taps <= BTN_GESTURE_MAX_TAPS; taps++)
+    {
+        if (State->TapMask & (1ul << taps))
+        {
+            maxTaps = taps;
+        }
+    }
+
+    return maxTaps;
+}
+
+//
+// Feeds one debounced edge. A pattern whose deadline is at or before Now
+// must have been ended with BtnTapOnDeadline first.
+//
+static __inline BTN_TAP_RESULT BtnTapOnEdge(
+    BTN_TAP_STATE* State,
+    int Pressed,
+    unsigned long long Now,
+    unsigned long long Window,
+    unsigned long* Taps)
+{
+    *Taps = State->Taps;
+
+    if (State->Active)
+    {
+        if (Pressed)
+        {
+            return BtnTapPass;
+        }
+
+        *Taps = State->Active;
+        State->Active = 0;
+        return BtnTapRelease;
+    }
+
+    if (State->TapMask == 0)
+    {
+        return BtnTapPass;
+    }
+
+    if (!Pressed)
+    {
+        // A release only belongs to a pattern its press started
+        return State->Taps != 0 ? BtnTapDefer : BtnTapPass;
+    }
+
+    *Taps = ++State->Taps;
+
+    if (State->Taps >= BtnTapMaxTaps(State))
+    {
+        State->Active = State->Taps;
+        State->Taps = 0;
+        State->Deadline = 0;
+        return BtnTapFire;
+    }
+
+    State->Deadline = Now + Window;
+    return BtnTapDefer;
+}
+
+//
+// Ends the pattern in progress once its deadline has passed. Pressed is
+// the button's current state; a gesture that fires while it is held stays
+// active until the release.
+//
+static __inline BTN_TAP_RESULT BtnTapOnDeadline(
+    BTN_TAP_STATE* State,
+    int Pressed,
+    unsigned long* Taps)
+{
+    *Taps = State->Taps;
+
+    State->Taps = 0;
+    State->Deadline = 0;
+
+    if (*Taps == 0)
+    {
+        return BtnTapPass;
+    }
+
+    if (State->TapMask & (1ul << *Taps))
+    {
+        State->Active = Pressed ? (unsigned char)*Taps : 0;
+        return BtnTapFire;
+    }
+
+    return BtnTapReplay;
+}
@@ -0,0 +1,170 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Bit-sliced rule matching. Shared between the driver and tools/rules-bench.
+//
+// A rule fires when its trigger input changes, every input in its required
+// mask is set and no input in its forbidden mask is. Rules are stored
+// transposed: for every input, one bit per rule telling whether the rule
+// requires, forbids or is triggered by it. Matching ANDs one word of 64
+// rules per input, so its cost depends on the number of inputs and words,
+// never on the number of rules. The lowest numbered matching rule wins.
+//
+// BTN_RULE_WORDS sets the capacity, 64 rules per word. The word loops are
+// plain C so that host builds can vectorize them; the driver keeps them
+// scalar and uses a single word.
+//
+// This header must stay free of kernel headers.
+//
+
+#pragma once
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifndef BTN_RULE_WORDS
+#define BTN_RULE_WORDS                  1
+#endif
+
+#define BTN_RULE_MAX_INPUTS             8
+#define BTN_MAX_RULES                   (64 * BTN_RULE_WORDS)
+
+typedef struct _BTN_RULE_SET
+{
+    unsigned long Inputs;
+    unsigned long long Defined[BTN_RULE_WORDS];
+    unsigned long long RequiredBy[BTN_RULE_MAX_INPUTS][BTN_RULE_WORDS];
+    unsigned long long ForbiddenBy[BTN_RULE_MAX_INPUTS][BTN_RULE_WORDS];
+    unsigned long long TriggeredBy[BTN_RULE_MAX_INPUTS][BTN_RULE_WORDS];
+} BTN_RULE_SET;
+
+typedef struct _BTN_RULE_MATCH
+{
+    long Complete;      // Rule completed by the inputs and trigger, -1 if none
+    long Partial;       // Rule that more inputs could still complete, -1 if none
+} BTN_RULE_MATCH;
+
+static __inline long BtnRuleFirst(const unsigned long long* Rules)
+{
+    for (unsigned long word = 0; word < BTN_RULE_WORDS; word++)
+    {
+        if (Rules[word] != 0)
+        {
+#ifdef _MSC_VER
+            unsigned long bit;
+
+            _BitScanForward64(&bit, Rules[word]);
+            return (long)(word * 64 + bit);
+#else
+            return (long)(word * 64 + __builtin_ctzll(Rules[word]));
+#endif
+        }
+    }
+
+    return -1;
+}
+
+static __inline void BtnRuleSetInit(BTN_RULE_SET* Set, unsigned long Inputs)
+{
+    unsigned char* bytes = (unsigned char*)Set;
+
+    for (unsigned long i = 0; i < sizeof(BTN_RULE_SET); i++)
+    {
+        bytes[i] = 0;
+    }
+
+    Set->Inputs = Inputs < BTN_RULE_MAX_INPUTS ? Inputs : BTN_RULE_MAX_INPUTS;
+}
+
+//
+// Rule numbers are priorities, lower numbers win
+//
+static __inline int BtnRuleSetAdd(
+    BTN_RULE_SET* Set,
+    unsigned long Rule,
+    unsigned long Required,
+    unsigned long Forbidden,
+    unsigned long Trigger)
+{
+    unsigned long word = Rule / 64;
+    unsigned long long bit = 1ull << (Rule % 64);
+
+    if (Rule >= BTN_MAX_RULES)
+    {
+        return 0;
+    }
+
+    Set->Defined[word] |= bit;
+
+    for (unsigned long input = 0; input < Set->Inputs; input++)
+    {
+        if (Required & (1ul << input))
+        {
+            Set->RequiredBy[input][word] |= bit;
+        }
+
+        if (Forbidden & (1ul << input))
+        {
+            Set->ForbiddenBy[input][word] |= bit;
+        }
+
+        if (Trigger & (1ul << input))
+        {
+            Set->TriggeredBy[input][word] |= bit;
+        }
+    }
+
+    return 1;
+}
+
+//
+// Matches every rule against the inputs set after Trigger changed. Partial
+// rules are those not forbidding any input that is set and still requiring
+// one that is not.
+//
+static __inline BTN_RULE_MATCH BtnRuleMatch(
+    const BTN_RULE_SET* Set,
+    unsigned long Inputs,
+    unsigned long Trigger)
+{
+    unsigned long long complete[BTN_RULE_WORDS];
+    unsigned long long partial[BTN_RULE_WORDS];
+    unsigned long long missing[BTN_RULE_WORDS];
+    BTN_RULE_MATCH match;
+
+    for (unsigned long word = 0; word < BTN_RULE_WORDS; word++)
+    {
+        complete[word] = Trigger < Set->Inputs ? Set->TriggeredBy[Trigger][word] : 0;
+        partial[word] = Set->Defined[word];
+        missing[word] = 0;
+    }
+
+    //
+    // Branch-free, input states are as good as random to a predictor
+    //
+    for (unsigned long input = 0; input < Set->Inputs; input++)
+    {
+        unsigned long long isSet = 0ull - ((Inputs >> input) & 1);
+
+        for (unsigned long word = 0; word < BTN_RULE_WORDS; word++)
+        {
+            unsigned long long forbidden = Set->ForbiddenBy[input][word] & isSet;
+            unsigned long long unmet = Set->RequiredBy[input][word] & ~isSet;
+
+            complete[word] &= ~(forbidden | unmet);
+            partial[word] &= ~forbidden;
+            missing[word] |= unmet;
+        }
+    }
+
+    for (unsigned long word = 0; word < BTN_RULE_WORDS; word++)
+    {
+        partial[word] &= missing[word];
+    }
+
+    match.Complete = BtnRuleFirst(complete);
+    match.Partial = BtnRuleFirst(partial);
+
+    return match;
+}
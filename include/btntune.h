@@ -0,0 +1,91 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Debounce window tuning. Shared between the driver and the host simulator
+// in tools/debounce-sim, so this header must stay free of kernel headers.
+//
+// Input is a histogram of edge-to-edge intervals in log2 buckets of
+// microseconds, the layout used by the latency report: bucket 0 holds
+// intervals under 1us, bucket n those in [2^(n-1), 2^n) us, the last
+// bucket everything longer.
+//
+
+#pragma once
+
+#define BTN_TUNE_BUCKETS                20
+#define BTN_TUNE_MIN_SAMPLES            64      // Bounce intervals needed before tuning
+#define BTN_TUNE_COVERAGE_PERMILLE      995     // Share of bounce intervals the window must cover
+#define BTN_TUNE_PERIOD                 32      // Edges between two tuning passes
+#define BTN_TUNE_AGE_SAMPLES            4096    // Histogram is halved past this many samples
+
+static __inline
+unsigned long
+BtnTuneWindowUs(
+    const unsigned long* Buckets,
+    unsigned long MinimumUs,
+    unsigned long MaximumUs
+    )
+/*++
+
+Routine Description:
+
+    Picks the smallest window that still covers BTN_TUNE_COVERAGE_PERMILLE
+    of the observed bounce. Intervals in buckets reaching MaximumUs or
+    beyond are taken as separate presses, not bounce. The window is the
+    upper edge of the covering bucket, which leaves up to 2x headroom.
+
+Arguments:
+
+    Buckets - Interval histogram, BTN_TUNE_BUCKETS entries
+    MinimumUs - Lower bound of the window
+    MaximumUs - Upper bound of the window
+
+Return Value:
+
+    The window in microseconds, or 0 if there is not enough data yet
+
+--*/
+{
+    unsigned long long total = 0;
+    unsigned long long covered = 0;
+    unsigned long limit = 0;
+    unsigned long window = MaximumUs;
+
+    //
+    // Bucket n ends at 2^n us, only buckets ending at or below MaximumUs
+    // hold bounce
+    //
+    while (limit < BTN_TUNE_BUCKETS - 1 && (1ULL << limit) <= MaximumUs)
+    {
+        total += Buckets[limit];
+        limit++;
+    }
+
+    if (total < BTN_TUNE_MIN_SAMPLES)
+    {
+        return 0;
+    }
+
+    for (unsigned long bucket = 0; bucket < limit; bucket++)
+    {
+        covered += Buckets[bucket];
+
+        if (covered * 1000 >= total * BTN_TUNE_COVERAGE_PERMILLE)
+        {
+            window = 1UL << bucket;
+            break;
+        }
+    }
+
+    if (window < MinimumUs)
+    {
+        window = MinimumUs;
+    }
+
+    if (window > MaximumUs)
+    {
+        window = MaximumUs;
+    }
+
+    return window;
+}
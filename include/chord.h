@@ -0,0 +1,22 @@
+#pragma once
+
+const BTN_TRANSITION*
+BtnChordOnTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN const BTN_TRANSITION* Transition,
+    IN ULONGLONG EdgeTime
+    );
+
+VOID
+BtnChordExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    );
+
+VOID
+BtnChordReset(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
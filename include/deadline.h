@@ -0,0 +1,30 @@
+#pragma once
+
+//
+// How late the shared deadline timer may fire, so that the system can
+// coalesce its expiration with other timers
+//
+#define BTN_DEADLINE_TOLERABLE_DELAY_MS     4
+
+VOID
+BtnSetDeadline(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BTN_DEADLINE_KIND Kind,
+    IN ULONGLONG Deadline
+    );
+
+VOID
+BtnClearDeadline(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BTN_DEADLINE_KIND Kind
+    );
+
+VOID
+BtnServiceDeadlines(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Now
+    );
+
+EVT_WDF_TIMER OnDeadlineTimer;
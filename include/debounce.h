@@ -0,0 +1,42 @@
+#pragma once
+
+//
+// Bounds of the registry configurable debounce window, in milliseconds
+//
+#define BTN_DEBOUNCE_MAX_MS                 100
+#define BTN_DEBOUNCE_DEFAULT_MINIMUM_MS     2
+
+NTSTATUS
+BtnLoadDebounceConfig(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
+
+VOID
+BtnDebounceEdges(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG Edges,
+    IN ULONGLONG FirstEdgeTime,
+    IN ULONGLONG LastEdgeTime
+    );
+
+VOID
+BtnDebounceLevel(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BOOLEAN Pressed
+    );
+
+VOID
+BtnDebounceResync(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BOOLEAN Pressed,
+    IN ULONGLONG Now
+    );
+
+VOID
+BtnDebounceSettle(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType
+    );
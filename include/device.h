@@ -7,8 +7,46 @@ EVT_WDF_DEVICE_D0_EXIT OnD0Exit;
 
 EVT_WDF_INTERRUPT_ISR OnInterruptIsr;
 
+EVT_WDF_INTERRUPT_WORKITEM OnInterruptWorkItem;
+
 EVT_WDF_DEVICE_PREPARE_HARDWARE OnPrepareHardware;
 
 EVT_WDF_DEVICE_RELEASE_HARDWARE OnReleaseHardware;
 
-EVT_WDF_DEVICE_D0_ENTRY_POST_INTERRUPTS_ENABLED OnD0EntryPostInterruptsEnabled;
\ No newline at end of file
+EVT_WDF_DEVICE_D0_ENTRY_POST_INTERRUPTS_ENABLED OnD0EntryPostInterruptsEnabled;
+
+VOID
+SendReport(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BTN_REPORT Report,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
+    );
+
+VOID
+BtnDeliverTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN const BTN_TRANSITION* Transition,
+    IN ULONGLONG EdgeTime
+    );
+
+VOID
+HandleButtonPress(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
+    );
+
+VOID
+BtnDrainPendingEdges(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
+
+VOID
+BtnCompleteReadRequest(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN WDFREQUEST Request,
+    IN const BTN_PENDING_REPORT* PendingReport
+    );
@@ -0,0 +1,46 @@
+#pragma once
+
+FORCEINLINE
+VOID
+BtnTraceEvent(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BTN_EVENT_ID EventId,
+    IN ULONG Arg1,
+    IN ULONG Arg2
+    )
+/*++
+
+Routine Description:
+
+    Appends one record to the device's binary trace ring. Safe at any IRQL
+    and from concurrent writers; the oldest record is overwritten once the
+    ring is full.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    EventId - Event from btnevents.h
+    Arg1 - First format argument
+    Arg2 - Second format argument
+
+Return Value:
+
+    None
+
+--*/
+{
+    LONG sequence = InterlockedIncrement(&DeviceContext->TraceSequence);
+    PBTN_TRACE_RECORD record = &DeviceContext->TraceRecords[sequence & (BTN_TRACE_RING_SIZE - 1)];
+
+    //
+    // Readers drop records whose sequence is 0 or does not match the slot
+    //
+    WriteNoFence(&record->Sequence, 0);
+
+    record->EventId = (USHORT)EventId;
+    record->Timestamp = BtnQueryInterruptTime();
+    record->Arg1 = Arg1;
+    record->Arg2 = Arg2;
+
+    WriteRelease(&record->Sequence, sequence);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+//
+// Bounds of the registry configurable tap window, in milliseconds. The
+// window must end before a held button can autorepeat or fire its hold
+// action, so that a replayed single press always comes first.
+//
+#define BTN_GESTURE_DEFAULT_WINDOW_MS       250
+#define BTN_GESTURE_MAX_WINDOW_MS           400
+
+NTSTATUS
+BtnLoadGestureConfig(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
+
+BOOLEAN
+BtnGestureOnTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN const BTN_TRANSITION* Transition,
+    IN ULONGLONG EdgeTime
+    );
+
+VOID
+BtnGestureExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    );
+
+VOID
+BtnGestureReset(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Now
+    );
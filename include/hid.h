@@ -117,4 +117,46 @@ BtnReadReport(
                 REPORT_COUNT, 0x01,                                         \
                 REPORT_SIZE, 0x05,                                          \
                 INPUT, 0x03,                            /*(Cnst,Var,Abs)*/  \
+            END_COLLECTION,                                                 \
+                                                                            \
+            USAGE_PAGE_1, 0x00, 0xFF,                   /*Vendor Defined*/  \
+            USAGE, 0x01,                                                    \
+            BEGIN_COLLECTION, 0x01,                     /*Application*/     \
+                REPORT_ID, REPORTID_LATENCY,                                \
+                USAGE, 0x02,                            /* Latency */       \
+                LOGICAL_MINIMUM, 0x00,                                      \
+                LOGICAL_MAXIMUM_2, 0xFF, 0x00,                              \
+                REPORT_SIZE, 0x08,                                          \
+                REPORT_COUNT_2,                                             \
+                    (UCHAR)(BTN_LATENCY_REPORT_PAYLOAD & 0xFF),             \
+                    (UCHAR)(BTN_LATENCY_REPORT_PAYLOAD >> 8),               \
+                FEATURE, 0x02,                          /* Data,Var,Abs */  \
+                                                                            \
+                REPORT_ID, REPORTID_COUNTERS,                               \
+                USAGE, 0x03,                            /* Counters */      \
+                REPORT_COUNT_2,                                             \
+                    (UCHAR)(BTN_COUNTERS_REPORT_PAYLOAD & 0xFF),            \
+                    (UCHAR)(BTN_COUNTERS_REPORT_PAYLOAD >> 8),              \
+                FEATURE, 0x02,                          /* Data,Var,Abs */  \
+                                                                            \
+                REPORT_ID, REPORTID_TRACE,                                  \
+                USAGE, 0x04,                            /* Trace */         \
+                REPORT_COUNT_2,                                             \
+                    (UCHAR)(BTN_TRACE_REPORT_PAYLOAD & 0xFF),               \
+                    (UCHAR)(BTN_TRACE_REPORT_PAYLOAD >> 8),                 \
+                FEATURE, 0x02,                          /* Data,Var,Abs */  \
+                                                                            \
+                REPORT_ID, REPORTID_DEBOUNCE,                               \
+                USAGE, 0x05,                            /* Debounce */      \
+                REPORT_COUNT_2,                                             \
+                    (UCHAR)(BTN_DEBOUNCE_REPORT_PAYLOAD & 0xFF),            \
+                    (UCHAR)(BTN_DEBOUNCE_REPORT_PAYLOAD >> 8),              \
+                FEATURE, 0x02,                          /* Data,Var,Abs */  \
+                                                                            \
+                REPORT_ID, REPORTID_DIAGNOSTICS,                            \
+                USAGE, 0x06,                            /* Diagnostics */   \
+                REPORT_COUNT_2,                                             \
+                    (UCHAR)(BTN_DIAGNOSTICS_REPORT_PAYLOAD & 0xFF),         \
+                    (UCHAR)(BTN_DIAGNOSTICS_REPORT_PAYLOAD >> 8),           \
+                FEATURE, 0x02,                          /* Data,Var,Abs */  \
             END_COLLECTION
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+//
+// Hold and autorepeat timing. Autorepeat starts after BTN_REPEAT_DELAY_MS
+// and speeds up by a quarter on every repeat down to the minimum interval.
+//
+#define BTN_HOLD_DELAY_MS                   800
+#define BTN_REPEAT_DELAY_MS                 500
+#define BTN_REPEAT_INTERVAL_MS              200
+#define BTN_REPEAT_MIN_INTERVAL_MS          50
+
+//
+// Lines that autorepeat while held, if their action is held for as long
+// as the button is
+//
+#define BTN_REPEAT_BUTTONS                  (BUTTON_BIT(VolumeUp) | BUTTON_BIT(VolumeDown))
+
+VOID
+BtnHoldOnTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN const BTN_TRANSITION* Transition
+    );
+
+VOID
+BtnHoldExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    );
+
+VOID
+BtnRepeatExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    );
@@ -15,6 +15,11 @@ typedef struct _IDLE_WORKITEM_CONTEXT
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(IDLE_WORKITEM_CONTEXT, GetWorkItemContext)
 
+NTSTATUS
+BtnCreateIdleWorkItem(
+    IN PDEVICE_EXTENSION FxDeviceContext
+    );
+
 NTSTATUS
 BtnProcessIdleRequest(
     IN WDFDEVICE Device,
@@ -22,9 +27,15 @@ BtnProcessIdleRequest(
     OUT BOOLEAN *Pending
     );
 
-VOID
+BOOLEAN
 BtnCompleteIdleIrp(
     IN PDEVICE_EXTENSION FxDeviceContext
     );
 
+VOID
+BtnWakeFromIdle(
+    IN PDEVICE_EXTENSION FxDeviceContext,
+    IN BUTTON_TYPE ButtonType
+    );
+
 EVT_WDF_WORKITEM BtnIdleIrpWorkitem;
\ No newline at end of file
@@ -9,6 +9,10 @@
 #define RESHUB_USE_HELPER_ROUTINES
 #include <reshub.h>
 #include "trace.h"
+#include "btnevents.h"
+#include "btngesture.h"
+#include "btnrules.h"
+#include "btnearly.h"
 
 //
 // HID descriptor & reporting
@@ -17,6 +21,11 @@
 #define REPORTID_CAPKEY_KEYBOARD        4
 #define REPORTID_CAPKEY_CONSUMER        5
 #define REPORTID_CAPKEY_CONTROL         6
+#define REPORTID_LATENCY                7
+#define REPORTID_COUNTERS               8
+#define REPORTID_TRACE                  9
+#define REPORTID_DEBOUNCE               10
+#define REPORTID_DIAGNOSTICS            11
 
 typedef enum _BUTTON_STATE
 {
@@ -31,9 +40,33 @@ typedef enum _BUTTON_TYPE
     VolumeDown,
     CameraFocus,
     Camera,
-    Slider
+    Slider,
+    ButtonCount
 } BUTTON_TYPE;
 
+#define BUTTON_BIT(Button)              (1UL << (Button))
+#define BUTTON_MASK_ALL                 (BUTTON_BIT(ButtonCount) - 1)
+#define BUTTON_PRESSED(Mask, Button)    (((Mask) & BUTTON_BIT(Button)) ? ButtonStatePressed : ButtonStateUnpressed)
+#define BUTTONS_HELD(Mask, Buttons)     (((Mask) & (Buttons)) == (Buttons))
+
+//
+// Lines that count towards the number of keys held down. The slider is a
+// switch and may legitimately stay on while keys are used.
+//
+#define BUTTON_MASK_KEYS                (BUTTON_MASK_ALL & ~BUTTON_BIT(Slider))
+
+//
+// Per-button descriptor, indexed by BUTTON_TYPE. A line is only wired up
+// when the device exposes at least MinimumInterrupts interrupt resources.
+//
+typedef struct _BUTTON_DESCRIPTOR
+{
+    PCSTR Name;
+    ULONG MinimumInterrupts;
+} BUTTON_DESCRIPTOR, *PBUTTON_DESCRIPTOR;
+
+extern const BUTTON_DESCRIPTOR gButtonDescriptors[ButtonCount];
+
 typedef struct _BTN_REPORT {
     UCHAR       ReportID;
     union
@@ -65,10 +98,422 @@ typedef struct _BTN_REPORT {
     } KeysData;
 } BTN_REPORT, * PBTN_REPORT;
 
+//
+// Button actions. Every button and chord owns a slot holding the report it
+// asserts and when; slots can be remapped per SKU from the device's hardware
+// registry key, see BtnLoadActionMap.
+//
+typedef enum _BTN_ACTION_MODE
+{
+    ActionModeNone = 0,         // Nothing is reported
+    ActionModeFollow,           // Keys are held for as long as the button is
+    ActionModeTapOnPress,       // Keys are pressed and released on button down
+    ActionModeTapOnRelease,     // Keys are pressed and released on button up
+    ActionModeTapOnChange,      // Keys are pressed and released on either edge
+    ActionModeCount
+} BTN_ACTION_MODE;
+
+typedef enum _BTN_ACTION_SLOT
+{
+    //
+    // Slots 0 to ButtonCount - 1 belong to the button of the same BUTTON_TYPE
+    //
+    ActionChordPowerVolumeUp = ButtonCount,
+    ActionChordPowerVolumeDown,
+
+    //
+    // Fired once a button has been held for BTN_HOLD_DELAY_MS, in BUTTON_TYPE
+    // order, see BTN_HOLD_SLOT
+    //
+    ActionHoldPower,
+    ActionHoldVolumeUp,
+    ActionHoldVolumeDown,
+    ActionHoldCameraFocus,
+    ActionHoldCamera,
+    ActionHoldSlider,
+
+    //
+    // Fired by the multi-tap recognizer, in BUTTON_TYPE order for every tap
+    // count from 2 to BTN_GESTURE_MAX_TAPS, see BTN_TAP_SLOT
+    //
+    ActionDoubleTapPower,
+    ActionDoubleTapVolumeUp,
+    ActionDoubleTapVolumeDown,
+    ActionDoubleTapCameraFocus,
+    ActionDoubleTapCamera,
+    ActionDoubleTapSlider,
+    ActionTripleTapPower,
+    ActionTripleTapVolumeUp,
+    ActionTripleTapVolumeDown,
+    ActionTripleTapCameraFocus,
+    ActionTripleTapCamera,
+    ActionTripleTapSlider,
+    ActionSlotCount
+} BTN_ACTION_SLOT;
+
+#define BTN_HOLD_SLOT(Button)           ((BTN_ACTION_SLOT)(ActionHoldPower + (Button)))
+#define BTN_TAP_SLOT(Button, Taps)      ((BTN_ACTION_SLOT)(ActionDoubleTapPower + ((Taps) - 2) * ButtonCount + (Button)))
+
+C_ASSERT(BTN_TAP_SLOT(Slider, BTN_GESTURE_MAX_TAPS) == ActionSlotCount - 1);
+
+typedef struct _BTN_ACTION
+{
+    UCHAR Mode;
+    BTN_REPORT Report;
+} BTN_ACTION, *PBTN_ACTION;
+
+//
+// Outcome of one edge, precomputed by BtnBuildTransitionTable for every
+// (IgnoreButtonPresses, button mask after the edge, triggering button).
+// The edge direction is the triggering button's bit in the mask.
+//
+#define BTN_TRANSITION_MAX_REPORTS      2
+
+typedef struct _BTN_TRANSITION
+{
+    UCHAR ReportCount;
+    BOOLEAN IgnoreButtonPresses;
+    BOOLEAN PressIgnored;
+    BTN_REPORT Reports[BTN_TRANSITION_MAX_REPORTS];
+} BTN_TRANSITION, *PBTN_TRANSITION;
+
+#define BTN_TRANSITION_INDEX(Ignore, Mask, Button) \
+    (((((ULONG)!!(Ignore) << ButtonCount) | ((Mask) & BUTTON_MASK_ALL)) * ButtonCount) + (Button))
+
+#define BTN_TRANSITION_COUNT            (2 * BUTTON_BIT(ButtonCount) * ButtonCount)
+
+//
+// Slots of the deadline wheel, every line has one of each. A deadline is an
+// interrupt time, 0 when the slot is idle.
+//
+typedef enum _BTN_DEADLINE_KIND
+{
+    DeadlineSettle = 0,         // Debounced line has been quiet for its window
+    DeadlineHold,               // Button held long enough for its hold action
+    DeadlineRepeat,             // Next autorepeat of a held button
+    DeadlineGesture,            // Tap pattern in progress has run out of time
+    DeadlineChord,              // Chord tolerance of held back presses has run out
+    DeadlineStorm,              // Line masked by storm protection may be unmasked
+    DeadlineStuck,              // Key held for the whole stuck timeout
+    DeadlineKindCount
+} BTN_DEADLINE_KIND;
+
+//
+// Latency accounting. Every edge is timestamped at ISR entry and at each
+// stage boundary, durations land in log2 buckets of microseconds: bucket 0
+// holds durations under 1us, bucket n those in [2^(n-1), 2^n) us, the last
+// bucket everything longer.
+//
+typedef enum _BTN_LATENCY_STAGE
+{
+    LatencyStageDispatch = 0,   // ISR entry to work item
+    LatencyStageEvaluate,       // Work item to reports produced
+    LatencyStageDeliver,        // Report produced to HID read completed
+    LatencyStageTotal,          // ISR entry to HID read completed
+    LatencyStageCount
+} BTN_LATENCY_STAGE;
+
+#define BTN_LATENCY_BUCKETS             20
+
+//
+// Device lifecycle, see lifecycle.h. Phases are timed across D0 entries
+// in the same log2 buckets as the latency stages.
+//
+typedef enum _BTN_LIFECYCLE_STATE
+{
+    LifecycleReleased = 0,      // No hardware, before OnPrepareHardware or after OnReleaseHardware
+    LifecyclePrepared,          // Resources found, never powered up
+    LifecyclePoweringUp,        // OnD0Entry run, interrupts not enabled yet
+    LifecycleReady,             // Interrupts enabled, edges are reported
+    LifecyclePoweredDown,       // OnD0Exit run
+    LifecycleStateCount
+} BTN_LIFECYCLE_STATE;
+
+typedef enum _BTN_LIFECYCLE_PHASE
+{
+    LifecyclePhasePowerUp = 0,  // OnD0Entry to interrupts enabled
+    LifecyclePhaseResync,       // Interrupts enabled to early edges replayed and levels reconciled
+    LifecyclePhaseFirstReport,  // OnD0Entry to the first report produced after it
+    LifecyclePhaseWakeToD0,     // Idle request completed by a button edge to OnD0Entry, if the device had left D0
+    LifecyclePhaseWakeReport,   // Idle request completed by a button edge to the first report after it
+    LifecyclePhaseCount
+} BTN_LIFECYCLE_PHASE;
+
+#include <pshpack1.h>
+typedef struct _BTN_LATENCY_FEATURE_REPORT
+{
+    UCHAR ReportID;
+    ULONG Buckets[ButtonCount][LatencyStageCount][BTN_LATENCY_BUCKETS];
+} BTN_LATENCY_FEATURE_REPORT, *PBTN_LATENCY_FEATURE_REPORT;
+#include <poppack.h>
+
+#define BTN_LATENCY_REPORT_PAYLOAD      (sizeof(BTN_LATENCY_FEATURE_REPORT) - sizeof(UCHAR))
+
+//
+// Operational counters, kept per button and cheap enough to stay on in
+// production. A SET of the counters feature report resets them.
+//
+typedef enum _BTN_COUNTER
+{
+    CounterInterrupts = 0,      // ISR invocations
+    CounterEdgesCoalesced,      // Edges folded into an already queued work item
+    CounterReportsEmitted,      // Reports produced by the button's edges
+    CounterReportsDropped,      // Reports lost to a full ring or a failed read
+    CounterPressesIgnored,      // Presses swallowed by IgnoreButtonPresses, or held back before ready and dropped
+    CounterWorkItems,           // Interrupt work items run
+    CounterEdgesFiltered,       // Edges absorbed by debouncing
+    CounterTransitions,         // Debounced state changes, one per physical press or release
+    CounterStorms,              // Times the line was masked for exceeding its interrupt budget
+    CounterEdgesThrottled,      // Interrupts over budget, dropped before the line was masked
+    CounterStuck,               // Times the line was quarantined as stuck
+    CounterWakes,               // Times the line's edge completed the parked idle request
+    CounterCount
+} BTN_COUNTER;
+
+#include <pshpack1.h>
+typedef struct _BTN_COUNTERS_FEATURE_REPORT
+{
+    UCHAR ReportID;
+    ULONG Counters[ButtonCount][CounterCount];
+} BTN_COUNTERS_FEATURE_REPORT, *PBTN_COUNTERS_FEATURE_REPORT;
+#include <poppack.h>
+
+#define BTN_COUNTERS_REPORT_PAYLOAD     (sizeof(BTN_COUNTERS_FEATURE_REPORT) - sizeof(UCHAR))
+
+//
+// Binary trace ring. Records are written lock-free by BtnTraceEvent and
+// formatted offline by tools/btntrace, see btnevents.h for the event list.
+// Sequence is 0 while a record is being written.
+//
+#define BTN_EVENT_ID_ENTRY(Name, Format) BtnEvent##Name,
+
+typedef enum _BTN_EVENT_ID
+{
+    BTN_EVENT_LIST(BTN_EVENT_ID_ENTRY)
+    BtnEventCount
+} BTN_EVENT_ID;
+
+#undef BTN_EVENT_ID_ENTRY
+
+#define BTN_TRACE_RING_SIZE             128
+
+typedef struct _BTN_TRACE_RECORD
+{
+    volatile LONG Sequence;
+    USHORT EventId;
+    USHORT Reserved;
+    ULONGLONG Timestamp;
+    ULONG Arg1;
+    ULONG Arg2;
+} BTN_TRACE_RECORD, *PBTN_TRACE_RECORD;
+
+C_ASSERT(sizeof(BTN_TRACE_RECORD) == 24);
+
+#include <pshpack1.h>
+typedef struct _BTN_TRACE_FEATURE_REPORT
+{
+    UCHAR ReportID;
+    ULONG Sequence;
+    BTN_TRACE_RECORD Records[BTN_TRACE_RING_SIZE];
+} BTN_TRACE_FEATURE_REPORT, *PBTN_TRACE_FEATURE_REPORT;
+#include <poppack.h>
+
+#define BTN_TRACE_REPORT_PAYLOAD        (sizeof(BTN_TRACE_FEATURE_REPORT) - sizeof(UCHAR))
+
+//
+// Debounce tuning state of every line: the window in use, its bounds and
+// the edge-to-edge interval histogram it was learned from
+//
+#include <pshpack1.h>
+typedef struct _BTN_DEBOUNCE_LINE_REPORT
+{
+    ULONG WindowUs;
+    ULONG MinimumUs;
+    ULONG MaximumUs;
+    ULONG Intervals[BTN_LATENCY_BUCKETS];
+} BTN_DEBOUNCE_LINE_REPORT, *PBTN_DEBOUNCE_LINE_REPORT;
+
+typedef struct _BTN_DEBOUNCE_FEATURE_REPORT
+{
+    UCHAR ReportID;
+    BTN_DEBOUNCE_LINE_REPORT Lines[ButtonCount];
+} BTN_DEBOUNCE_FEATURE_REPORT, *PBTN_DEBOUNCE_FEATURE_REPORT;
+#include <poppack.h>
+
+#define BTN_DEBOUNCE_REPORT_PAYLOAD     (sizeof(BTN_DEBOUNCE_FEATURE_REPORT) - sizeof(UCHAR))
+
+//
+// Health of every line, and of the device. HeldMs is how long the line has
+// been reported pressed, 0 while it is released. BTN_LINE_WOKE_DEVICE marks
+// the line whose edge last brought the stack out of idle. Lifecycle is the
+// current BTN_LIFECYCLE_STATE.
+//
+#define BTN_LINE_WIRED                  0x01
+#define BTN_LINE_PRESSED                0x02
+#define BTN_LINE_STUCK                  0x04
+#define BTN_LINE_STORM_MASKED           0x08
+#define BTN_LINE_WOKE_DEVICE            0x10
+
+#include <pshpack1.h>
+typedef struct _BTN_DIAGNOSTICS_LINE_REPORT
+{
+    ULONG Flags;
+    ULONG HeldMs;
+} BTN_DIAGNOSTICS_LINE_REPORT, *PBTN_DIAGNOSTICS_LINE_REPORT;
+
+typedef struct _BTN_DIAGNOSTICS_FEATURE_REPORT
+{
+    UCHAR ReportID;
+    BTN_DIAGNOSTICS_LINE_REPORT Lines[ButtonCount];
+    ULONG Lifecycle;
+    ULONG LifecycleBuckets[LifecyclePhaseCount][BTN_LATENCY_BUCKETS];
+} BTN_DIAGNOSTICS_FEATURE_REPORT, *PBTN_DIAGNOSTICS_FEATURE_REPORT;
+#include <poppack.h>
+
+#define BTN_DIAGNOSTICS_REPORT_PAYLOAD  (sizeof(BTN_DIAGNOSTICS_FEATURE_REPORT) - sizeof(UCHAR))
+
+#define BTN_MS_TO_INTERRUPT_TIME(Ms)        ((ULONGLONG)(Ms) * 10000)
+
+FORCEINLINE
+ULONGLONG
+BtnQueryInterruptTime(
+    VOID
+    )
+{
+    ULONGLONG qpcTimeStamp;
+
+    return KeQueryInterruptTimePrecise(&qpcTimeStamp);
+}
+
+FORCEINLINE
+ULONG
+BtnDurationBucket(
+    IN ULONGLONG Duration
+    )
+{
+    ULONG bucket = 0;
+    ULONGLONG microseconds = Duration / 10;
+
+    //
+    // Log2 microsecond buckets as described for BTN_LATENCY_STAGE
+    //
+    if (microseconds != 0)
+    {
+        BitScanReverse64(&bucket, microseconds);
+        bucket = min(bucket + 1, BTN_LATENCY_BUCKETS - 1);
+    }
+
+    return bucket;
+}
+
+//
+// A report on its way to HIDCLASS, with the timestamps of the edge that
+// produced it. EdgeTime is 0 for reports not caused by an edge.
+//
+typedef struct _BTN_PENDING_REPORT
+{
+    BTN_REPORT Report;
+    BUTTON_TYPE Button;
+    ULONGLONG EdgeTime;
+    ULONGLONG EvaluatedTime;
+} BTN_PENDING_REPORT, *PBTN_PENDING_REPORT;
+
+//
+// An evaluated edge held back by the multi-tap recognizer. A triple tap
+// completes on its third press, so a pattern holds at most five edges.
+//
+#define BTN_GESTURE_RING_SIZE           8
+
+typedef struct _BTN_DEFERRED_TRANSITION
+{
+    const BTN_TRANSITION* Transition;
+    ULONGLONG EdgeTime;
+    BUTTON_TYPE Button;
+    ULONG StateMask;
+} BTN_DEFERRED_TRANSITION, *PBTN_DEFERRED_TRANSITION;
+
+//
+// Chords are compiled by BtnBuildTransitionTable into a bit-sliced rule set
+// over the keys, see btnrules.h. Rule n is chord n.
+//
+#define BTN_MAX_CHORDS                  8
+
+C_ASSERT(BTN_MAX_CHORDS <= BTN_MAX_RULES);
+C_ASSERT(ButtonCount <= BTN_RULE_MAX_INPUTS);
+
 //
 // Device context
 //
 
+#define BTN_REPORT_RING_SIZE            32
+
+typedef struct _BUTTON_LINE
+{
+    WDFINTERRUPT Interrupt;
+
+    //
+    // Edge accounting. OnInterruptIsr bumps the counter and sets the line's
+    // bit in PendingMask, BtnDrainPendingEdges consumes both so that an edge
+    // arriving while a work item is already queued is never lost.
+    // PendingSince is the interrupt time of the oldest edge not yet drained,
+    // LatestEdgeTime that of the newest.
+    //
+    volatile LONG PendingEdges;
+    volatile LONGLONG PendingSince;
+    volatile LONGLONG LatestEdgeTime;
+
+    //
+    // Storm protection. The token bucket is owned by the line's ISR, the
+    // masking state by the drain.
+    //
+    ULONG StormTokens;
+    ULONGLONG StormRefillTime;
+    BOOLEAN StormMasked;
+    ULONGLONG StormBackoff;
+    ULONGLONG StormUnmaskedTime;
+
+    //
+    // Stuck detection, owned by the drain. A stuck line has had its release
+    // reported while it is still pressed, its edges are ignored until the
+    // line is released. Stuck is also read by OnInterruptIsr and only
+    // written with interlocked operations.
+    //
+    ULONGLONG PressedSince;
+    volatile LONG Stuck;
+
+    //
+    // Debounce state, owned by the drain. RawPressed follows every edge,
+    // LogicalPressed is what has been reported; the line is settling while
+    // they differ and is quiet again from QuietUntil on. DebounceWindow is
+    // tuned within its bounds from IntervalBuckets, which OnInterruptIsr
+    // fills with the time between consecutive edges.
+    //
+    ULONGLONG DebounceWindow;
+    ULONGLONG DebounceMinimum;
+    ULONGLONG DebounceMaximum;
+    volatile LONG IntervalBuckets[BTN_LATENCY_BUCKETS];
+    ULONG EdgesSinceTuning;
+    ULONGLONG QuietUntil;
+    ULONGLONG LastEdgeTime;
+    BOOLEAN RawPressed;
+    BOOLEAN LogicalPressed;
+
+    //
+    // Hold and autorepeat state, owned by the drain. Once HoldFired is set
+    // the release reports come from the hold action instead of the button's.
+    //
+    BOOLEAN HoldFired;
+    ULONGLONG RepeatInterval;
+
+    //
+    // Multi-tap recognizer state, owned by the drain. Edges of a pattern in
+    // progress wait in Deferred until it fires a gesture or is replayed.
+    //
+    BTN_TAP_STATE Tap;
+    ULONG DeferredCount;
+    BTN_DEFERRED_TRANSITION Deferred[BTN_GESTURE_RING_SIZE];
+} BUTTON_LINE, *PBUTTON_LINE;
+
 typedef struct _DEVICE_EXTENSION
 {
     //
@@ -81,37 +526,150 @@ typedef struct _DEVICE_EXTENSION
     //
     // Interrupt servicing
     //
-    WDFINTERRUPT InterruptPower;
-    WDFINTERRUPT InterruptVolumeUp;
-    WDFINTERRUPT InterruptVolumeDown;
-    WDFINTERRUPT InterruptCameraFocus;
-    WDFINTERRUPT InterruptCamera;
-    WDFINTERRUPT InterruptSlider;
-    BOOLEAN ServiceInterruptsAfterD0Entry;
-    BOOLEAN ProcessInterrupts;
-    
+    BUTTON_LINE Lines[ButtonCount];
+    volatile LONG PendingMask;
+    volatile LONG DrainRequests;
+    volatile LONG StormMask;
+    volatile LONG ResyncRequested;
+
+    //
+    // GPIO IO connection covering the pins of every line in LevelLines, bit
+    // n of a read is line n. All reads reuse LevelRequest and LevelMemory,
+    // which describes LevelPins; only the drain owner reads. ActiveHighMask
+    // has a bit set for every line that reads 1 when pressed.
+    //
+    LARGE_INTEGER LevelConnectionId;
+    WDFIOTARGET LevelTarget;
+    WDFREQUEST LevelRequest;
+    WDFMEMORY LevelMemory;
+    ULONG LevelPins;
+    ULONG LevelLines;
+    ULONG ActiveHighMask;
+
+    //
+    // Deadline wheel and the shared passive timer bringing the drain back
+    // for its earliest slot. Owned by the drain, except that the timer
+    // callback clears DeadlineArmed once the timer has fired.
+    //
+    WDFTIMER DeadlineTimer;
+    ULONGLONG Deadlines[ButtonCount][DeadlineKindCount];
+    ULONGLONG Deadline;
+    volatile LONG DeadlineArmed;
+
+    //
+    // Lifecycle holds a BTN_LIFECYCLE_STATE. Only BtnLifecycleEnter, called
+    // from the serialized PnP and power callbacks, changes it; everything
+    // else reads it with BtnLifecycleState. LifecycleTimes is when every
+    // state was last entered. AwaitingFirstReport is set on every D0 entry
+    // and cleared by the first report that follows.
+    //
+    volatile LONG Lifecycle;
+    ULONGLONG LifecycleTimes[LifecycleStateCount];
+    volatile LONG LifecycleBuckets[LifecyclePhaseCount][BTN_LATENCY_BUCKETS];
+    volatile LONG AwaitingFirstReport;
+
+    //
+    // Edges held back until the device is ready, owned by the drain
+    //
+    BTN_EARLY_RING EarlyEdges;
+
+    //
+    // Reports produced while HIDCLASS has no read pending, drained by
+    // BtnReadReport. The ring and PingPongQueue are only touched under
+    // ReportLock.
+    //
+    WDFSPINLOCK ReportLock;
+    BTN_PENDING_REPORT PendingReports[BTN_REPORT_RING_SIZE];
+    ULONG PendingReportHead;
+    ULONG PendingReportCount;
+
+    //
+    // Per-stage latency histograms and operational counters, updated with
+    // interlocked increments only
+    //
+    volatile LONG LatencyBuckets[ButtonCount][LatencyStageCount][BTN_LATENCY_BUCKETS];
+    volatile LONG Counters[ButtonCount][CounterCount];
+
+    //
+    // Binary trace ring, slot (TraceSequence & (BTN_TRACE_RING_SIZE - 1))
+    // holds the latest event
+    //
+    volatile LONG TraceSequence;
+    BTN_TRACE_RECORD TraceRecords[BTN_TRACE_RING_SIZE];
+
     // 
-    // Power related
+    // Power related. IdleWorkItem is created once and carries every idle
+    // notification to IdleQueue, IdleInFlight is set while it does and
+    // IdleParked once it is there, until a button edge or D0 entry
+    // completes it. WakeMask has the bit of the line whose edge last
+    // completed it, WakeTime is the interrupt time it was completed at
+    // until the first report after it.
     //
     WDFQUEUE IdleQueue;
+    WDFWORKITEM IdleWorkItem;
+    volatile LONG IdleInFlight;
+    volatile LONG IdleParked;
+    volatile LONG WakeMask;
+    volatile LONGLONG WakeTime;
 
     //
-    // Button states
+    // Button states, one BUTTON_BIT per line. Only ever updated with
+    // compare-exchange, evaluation works on the returned snapshot.
     //
-    BUTTON_STATE StatePower;
-    BUTTON_STATE StateVolumeUp;
-    BUTTON_STATE StateVolumeDown;
-    BUTTON_STATE StateCameraFocus;
-    BUTTON_STATE StateCamera;
-    BUTTON_STATE StateSlider;
-
+    DECLSPEC_CACHEALIGN volatile LONG ButtonMask;
     BOOLEAN IgnoreButtonPresses;
-    DWORD InitializationOk;
+
+    //
+    // Button actions
+    //
+    BTN_ACTION Actions[ActionSlotCount];
+    BTN_TRANSITION Transitions[BTN_TRANSITION_COUNT];
+    BTN_TRANSITION HoldPress[ButtonCount];
+    BTN_TRANSITION HoldRelease[ButtonCount];
+    BTN_TRANSITION GesturePress[ButtonCount][BTN_GESTURE_MAX_TAPS - 1];
+    BTN_TRANSITION GestureRelease[ButtonCount][BTN_GESTURE_MAX_TAPS - 1];
+    ULONGLONG MultiTapWindow;
+    ULONGLONG StuckTimeout;
+
+    //
+    // Chords. ChordHeld holds back key presses that may still become part
+    // of a chord until ChordDeadline; ActiveChord is 1 + the index of the
+    // chord whose keys are down, 0 if none. Owned by the drain.
+    // ChordCount chords are loaded by BtnLoadActionMap, ChordToleranceMs
+    // overrides every chord's tolerance, MAXULONG if unset.
+    //
+    ULONG ChordToleranceMs;
+    ULONG ChordCount;
+    BTN_ACTION_SLOT ChordSlots[BTN_MAX_CHORDS];
+    ULONG ChordMasks[BTN_MAX_CHORDS];
+    ULONG ChordTolerancesMs[BTN_MAX_CHORDS];
+    BTN_RULE_SET ChordRules;
+    BTN_TRANSITION ChordPress[BTN_MAX_CHORDS];
+    BTN_TRANSITION ChordRelease[BTN_MAX_CHORDS];
+    ULONG ActiveChord;
+    ULONG ChordHeldMask;
+    ULONG ChordHeldCount;
+    ULONGLONG ChordDeadline;
+    BTN_DEFERRED_TRANSITION ChordHeld[ButtonCount];
 
 } DEVICE_EXTENSION, *PDEVICE_EXTENSION;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(DEVICE_EXTENSION, GetDeviceContext)
 
+#define BtnCountEvent(DeviceContext, Button, Counter) \
+    InterlockedIncrement(&(DeviceContext)->Counters[(Button)][(Counter)])
+
+//
+// Interrupt context
+//
+
+typedef struct _INTERRUPT_CONTEXT
+{
+    BUTTON_TYPE Button;
+} INTERRUPT_CONTEXT, *PINTERRUPT_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(INTERRUPT_CONTEXT, GetInterruptContext)
+
 //
 // Memory tags
 //
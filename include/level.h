@@ -0,0 +1,30 @@
+#pragma once
+
+NTSTATUS
+BtnOpenLevelTarget(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
+
+VOID
+BtnCloseLevelTarget(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
+
+NTSTATUS
+BtnReadLevels(
+    IN PDEVICE_EXTENSION DeviceContext,
+    OUT PULONG PressedMask
+    );
+
+NTSTATUS
+BtnReadLineLevel(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    OUT PBOOLEAN Pressed
+    );
+
+VOID
+BtnResyncLines(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Now
+    );
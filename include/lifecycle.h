@@ -0,0 +1,37 @@
+#pragma once
+
+//
+// Device lifecycle. The PnP and power callbacks move the device through
+//
+//   Released -> Prepared -> PoweringUp -> Ready -> PoweredDown -> PoweringUp ...
+//
+// and back to Released from Prepared or PoweredDown. Edges are only
+// reported while the device is Ready, every other state holds them back.
+//
+
+VOID
+BtnLifecycleEnter(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BTN_LIFECYCLE_STATE State
+    );
+
+VOID
+BtnLifecycleRecordPhase(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BTN_LIFECYCLE_PHASE Phase,
+    IN ULONGLONG StartTime,
+    IN ULONGLONG EndTime
+    );
+
+FORCEINLINE
+BTN_LIFECYCLE_STATE
+BtnLifecycleState(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+{
+    //
+    // Pairs with the exchange in BtnLifecycleEnter, whatever the callback
+    // set up before entering the state is visible once it is seen
+    //
+    return (BTN_LIFECYCLE_STATE)ReadAcquire(&DeviceContext->Lifecycle);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+//
+// Interrupt budget of every line, a token bucket refilled at
+// BTN_STORM_RATE edges per second holding up to BTN_STORM_BURST. A bouncing
+// switch pressed as fast as a thumb can manages about a fifth of that.
+//
+#define BTN_STORM_RATE                      250
+#define BTN_STORM_BURST                     500
+
+//
+// A line over budget is masked for a backoff that doubles with every
+// storm, and starts over once the line has behaved for
+// BTN_STORM_BACKOFF_RESET_MS after being unmasked
+//
+#define BTN_STORM_MIN_BACKOFF_MS            1000
+#define BTN_STORM_MAX_BACKOFF_MS            32000
+#define BTN_STORM_BACKOFF_RESET_MS          60000
+
+BOOLEAN
+BtnStormAdmit(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
+    );
+
+VOID
+BtnStormMaskLines(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Now
+    );
+
+VOID
+BtnStormExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    );
+
+VOID
+BtnStormReset(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
@@ -0,0 +1,42 @@
+#pragma once
+
+//
+// A line reported pressed for longer than the registry configurable stuck
+// timeout is taken to be damaged, in seconds. The slider is a switch and
+// is never considered stuck.
+//
+#define BTN_STUCK_DEFAULT_TIMEOUT_S         120
+#define BTN_STUCK_MAX_TIMEOUT_S             3600
+#define BTN_STUCK_BUTTONS                   BUTTON_MASK_KEYS
+
+//
+// A stuck line whose level can be read has its interrupt disabled, the
+// level is polled for the release at this interval instead
+//
+#define BTN_STUCK_POLL_MS                   100
+
+NTSTATUS
+BtnLoadStuckConfig(
+    IN PDEVICE_EXTENSION DeviceContext
+    );
+
+BOOLEAN
+BtnStuckOnTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
+    );
+
+VOID
+BtnStuckMask(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    );
+
+VOID
+BtnStuckExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    );
@@ -1,22 +1,90 @@
+#pragma once
+
 #include <wdm.h>
 
-#define Trace(Level, Flags, Msg, ...) \
-			DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "ST: " Msg "\n", __VA_ARGS__);
-
-#define TRACE_FLAG_INIT        1  
-#define TRACE_FLAG_REGISTRY    2  
-#define TRACE_FLAG_HID         3  
-#define TRACE_FLAG_PNP         4  
-#define TRACE_FLAG_POWER       5  
-#define TRACE_FLAG_SPB         6  
-#define TRACE_FLAG_CONFIG      7  
-#define TRACE_FLAG_REPORTING   8  
-#define TRACE_FLAG_INTERRUPT   9  
-#define TRACE_FLAG_SAMPLES     10  
-#define TRACE_FLAG_OTHER       11  
-#define TRACE_FLAG_IDLE		   12
-
-#define TRACE_LEVEL_ERROR       1
-#define TRACE_LEVEL_VERBOSE     2
+#define TRACE_LEVEL_NONE        0
+#define TRACE_LEVEL_CRITICAL    1
+#define TRACE_LEVEL_ERROR       2
+#define TRACE_LEVEL_WARNING     3
 #define TRACE_LEVEL_INFORMATION 4
-#define TRACE_LEVEL_WARNING     3
\ No newline at end of file
+#define TRACE_LEVEL_VERBOSE     5
+
+#define TRACE_FLAG_INIT         0x00000001
+#define TRACE_FLAG_REGISTRY     0x00000002
+#define TRACE_FLAG_HID          0x00000004
+#define TRACE_FLAG_PNP          0x00000008
+#define TRACE_FLAG_POWER        0x00000010
+#define TRACE_FLAG_SPB          0x00000020
+#define TRACE_FLAG_CONFIG       0x00000040
+#define TRACE_FLAG_REPORTING    0x00000080
+#define TRACE_FLAG_INTERRUPT    0x00000100
+#define TRACE_FLAG_SAMPLES      0x00000200
+#define TRACE_FLAG_OTHER        0x00000400
+#define TRACE_FLAG_IDLE         0x00000800
+#define TRACE_FLAG_ALL          0x00000FFF
+
+//
+// Flags used at call sites
+//
+#define TRACE_INIT              TRACE_FLAG_INIT
+#define TRACE_HID               TRACE_FLAG_HID
+#define TRACE_IDLE              TRACE_FLAG_IDLE
+#define TRACE_DRIVER            TRACE_FLAG_OTHER
+
+//
+// Calls above TRACE_COMPILE_LEVEL are constant-false and are dropped with
+// their format strings by the optimizer. Release builds keep warnings and
+// errors only unless the build overrides it.
+//
+#ifndef TRACE_COMPILE_LEVEL
+#if DBG
+#define TRACE_COMPILE_LEVEL     TRACE_LEVEL_VERBOSE
+#else
+#define TRACE_COMPILE_LEVEL     TRACE_LEVEL_WARNING
+#endif
+#endif
+
+//
+// Runtime filter, read from the driver's Parameters key (TraceLevel,
+// TraceFlags) by TraceInitialize
+//
+extern ULONG gTraceLevel;
+extern ULONG gTraceFlags;
+
+//
+// Every call site may print TRACE_RATE_LIMIT_BURST messages per
+// TRACE_RATE_LIMIT_WINDOW, the rest are counted and reported with the next
+// message that gets through.
+//
+#define TRACE_RATE_LIMIT_BURST  10
+#define TRACE_RATE_LIMIT_WINDOW (1000 * 10000)  // 1s in 100ns units
+
+typedef struct _TRACE_CALLSITE
+{
+    volatile LONGLONG WindowStart;
+    volatile LONG Count;
+    volatile LONG Suppressed;
+} TRACE_CALLSITE, *PTRACE_CALLSITE;
+
+VOID
+TraceInitialize(
+    IN WDFDRIVER Driver
+    );
+
+BOOLEAN
+TraceRateLimit(
+    IN PTRACE_CALLSITE Callsite
+    );
+
+#define Trace(Level, Flags, Msg, ...) \
+    do \
+    { \
+        static TRACE_CALLSITE _traceCallsite; \
+        if ((Level) <= TRACE_COMPILE_LEVEL && \
+            (Level) <= gTraceLevel && \
+            ((Flags) & gTraceFlags) != 0 && \
+            TraceRateLimit(&_traceCallsite)) \
+        { \
+            DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: %s: " Msg "\n", __FUNCTION__, ##__VA_ARGS__); \
+        } \
+    } while (0)
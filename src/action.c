@@ -0,0 +1,629 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <action.h>
+#include <trace.h>
+
+#ifdef ALLOC_PRAGMA
+  #pragma alloc_text(PAGE, BtnLoadActionMap)
+  #pragma alloc_text(PAGE, BtnBuildTransitionTable)
+#endif
+
+//
+// Registry value name and default mapping of every action slot
+//
+static const PCWSTR gActionValueNames[ActionSlotCount] =
+{
+    L"PowerAction",
+    L"VolumeUpAction",
+    L"VolumeDownAction",
+    L"CameraFocusAction",
+    L"CameraAction",
+    L"SliderAction",
+    L"PowerVolumeUpAction",
+    L"PowerVolumeDownAction",
+    L"PowerHoldAction",
+    L"VolumeUpHoldAction",
+    L"VolumeDownHoldAction",
+    L"CameraFocusHoldAction",
+    L"CameraHoldAction",
+    L"SliderHoldAction",
+    L"PowerDoubleTapAction",
+    L"VolumeUpDoubleTapAction",
+    L"VolumeDownDoubleTapAction",
+    L"CameraFocusDoubleTapAction",
+    L"CameraDoubleTapAction",
+    L"SliderDoubleTapAction",
+    L"PowerTripleTapAction",
+    L"VolumeUpTripleTapAction",
+    L"VolumeDownTripleTapAction",
+    L"CameraFocusTripleTapAction",
+    L"CameraTripleTapAction",
+    L"SliderTripleTapAction",
+};
+
+static const ULONG gDefaultActions[ActionSlotCount] =
+{
+    // Power: SystemPowerDown once released
+    BTN_ACTION_VALUE(ActionModeTapOnRelease, REPORTID_CAPKEY_CONTROL, 0x01),
+    // VolumeUp / VolumeDown
+    BTN_ACTION_VALUE(ActionModeFollow, REPORTID_CAPKEY_CONSUMER, 0x01),
+    BTN_ACTION_VALUE(ActionModeFollow, REPORTID_CAPKEY_CONSUMER, 0x02),
+    // CameraFocus / Camera: LeftWin, placeholder until boards provide a mapping
+    BTN_ACTION_VALUE(ActionModeFollow, REPORTID_CAPKEY_KEYBOARD, 0x20),
+    BTN_ACTION_VALUE(ActionModeFollow, REPORTID_CAPKEY_KEYBOARD, 0x20),
+    // Slider: WIN + F14 on every change
+    BTN_ACTION_VALUE(ActionModeTapOnChange, REPORTID_CAPKEY_KEYBOARD, 0x22),
+    // Power + VolumeUp: WIN + F15
+    BTN_ACTION_VALUE(ActionModeTapOnPress, REPORTID_CAPKEY_KEYBOARD, 0x24),
+    // Power + VolumeDown: CTRL + ALT + DEL
+    BTN_ACTION_VALUE(ActionModeTapOnPress, REPORTID_CAPKEY_KEYBOARD, 0x19),
+    // Hold actions are opt-in per SKU
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    // Multi-tap actions delay single presses, opt-in per SKU as well. So is
+    // the camera action on a power double tap, see BtnLoadActionMap.
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+    BTN_ACTION_VALUE(ActionModeNone, 0, 0),
+};
+
+//
+// Chords of any number of keys. A chord fires when the last of its keys goes
+// down, in any order, with no other key held, after which further presses
+// are ignored until every key is released. Presses of keys that could still
+// complete a chord are held back for up to ToleranceMs, so keys pressed
+// together report nothing of their own. See BtnChordOnTransition.
+//
+// gChords are the built-in chords, replaced by the chords of the device's
+// hardware registry key as soon as any of gChordValueNames is set.
+//
+typedef struct _BTN_CHORD
+{
+    ULONG Mask;
+    BTN_ACTION_SLOT Slot;
+    ULONG ToleranceMs;
+} BTN_CHORD;
+
+static const BTN_CHORD gChords[] =
+{
+    { BUTTON_BIT(Power) | BUTTON_BIT(VolumeUp),   ActionChordPowerVolumeUp,   80 },
+    { BUTTON_BIT(Power) | BUTTON_BIT(VolumeDown), ActionChordPowerVolumeDown, 80 },
+};
+
+C_ASSERT(RTL_NUMBER_OF(gChords) <= BTN_MAX_CHORDS);
+
+static const PCWSTR gChordValueNames[BTN_MAX_CHORDS] =
+{
+    L"Chord0",
+    L"Chord1",
+    L"Chord2",
+    L"Chord3",
+    L"Chord4",
+    L"Chord5",
+    L"Chord6",
+    L"Chord7",
+};
+
+static
+BOOLEAN
+BtnDecodeAction(
+    IN ULONG Value,
+    OUT PBTN_ACTION Action
+    )
+/*++
+
+Routine Description:
+
+    Validates a registry encoded action and unpacks it.
+
+Arguments:
+
+    Value - Encoded action, see BTN_ACTION_VALUE
+    Action - Receives the decoded action
+
+Return Value:
+
+    TRUE if Value describes a valid action
+
+--*/
+{
+    UCHAR mode = BTN_ACTION_VALUE_MODE(Value);
+    UCHAR reportId = BTN_ACTION_VALUE_REPORT_ID(Value);
+    UCHAR keys = BTN_ACTION_VALUE_KEYS(Value);
+    UCHAR validKeys;
+
+    if ((Value >> 24) != 0 || mode >= ActionModeCount)
+    {
+        return FALSE;
+    }
+
+    if (mode == ActionModeNone)
+    {
+        RtlZeroMemory(Action, sizeof(BTN_ACTION));
+        return TRUE;
+    }
+
+    switch (reportId)
+    {
+    case REPORTID_CAPKEY_KEYBOARD:
+        validKeys = BTN_KEYBOARD_KEYS_MASK;
+        break;
+    case REPORTID_CAPKEY_CONSUMER:
+        validKeys = BTN_CONSUMER_KEYS_MASK;
+        break;
+    case REPORTID_CAPKEY_CONTROL:
+        validKeys = BTN_CONTROL_KEYS_MASK;
+        break;
+    default:
+        return FALSE;
+    }
+
+    if (keys == 0 || (keys & ~validKeys) != 0)
+    {
+        return FALSE;
+    }
+
+    Action->Mode = mode;
+    Action->Report.ReportID = reportId;
+    Action->Report.KeysData.Raw = keys;
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+BtnDecodeChord(
+    IN ULONG Value,
+    OUT BTN_CHORD* Chord
+    )
+/*++
+
+Routine Description:
+
+    Validates a registry encoded chord and unpacks it.
+
+Arguments:
+
+    Value - Encoded chord, see BTN_CHORD_VALUE
+    Chord - Receives the decoded chord
+
+Return Value:
+
+    TRUE if Value describes a valid chord
+
+--*/
+{
+    ULONG mask = BTN_CHORD_VALUE_MASK(Value);
+    ULONG slot = BTN_CHORD_VALUE_SLOT(Value);
+    ULONG toleranceMs = BTN_CHORD_VALUE_TOLERANCE_MS(Value);
+
+    if ((Value >> 24) != 0 ||
+        (mask & ~BUTTON_MASK_KEYS) != 0 ||
+        (mask & (mask - 1)) == 0 ||
+        slot >= ActionSlotCount ||
+        toleranceMs > BTN_CHORD_MAX_TOLERANCE_MS)
+    {
+        return FALSE;
+    }
+
+    Chord->Mask = mask;
+    Chord->Slot = (BTN_ACTION_SLOT)slot;
+    Chord->ToleranceMs = toleranceMs;
+
+    return TRUE;
+}
+
+NTSTATUS
+BtnLoadActionMap(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    Fills DeviceContext->Actions from the device's hardware registry key,
+    falling back to the built-in mapping for every slot that is absent or
+    invalid. On devices without a camera button, a SKU that sets
+    PowerDoubleTapCamera has a power double tap it does not map fire the
+    camera action instead; it is off by default, since any double tap
+    action holds every power press back for the tap window.
+
+    The chords are read from Chord0 to Chord7 the same way; once any of
+    them is set they replace the built-in chords, 0 defining no chord.
+    ChordToleranceMs, up to BTN_CHORD_MAX_TOLERANCE_MS, overrides the
+    tolerance of every chord. Only called from
+    OnPrepareHardware after the lines have been probed, the interrupt path
+    never touches the registry.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+    WDFKEY key = NULL;
+    UNICODE_STRING valueName;
+    ULONG value;
+    BOOLEAN powerDoubleTapMapped = FALSE;
+    BOOLEAN powerDoubleTapCamera = FALSE;
+    BOOLEAN chordsMapped = FALSE;
+    BTN_CHORD chord;
+    DECLARE_CONST_UNICODE_STRING(toleranceValueName, L"ChordToleranceMs");
+    DECLARE_CONST_UNICODE_STRING(cameraValueName, L"PowerDoubleTapCamera");
+
+    PAGED_CODE();
+
+    DeviceContext->ChordToleranceMs = MAXULONG;
+    DeviceContext->ChordCount = RTL_NUMBER_OF(gChords);
+
+    for (ULONG index = 0; index < RTL_NUMBER_OF(gChords); index++)
+    {
+        DeviceContext->ChordMasks[index] = gChords[index].Mask;
+        DeviceContext->ChordSlots[index] = gChords[index].Slot;
+        DeviceContext->ChordTolerancesMs[index] = gChords[index].ToleranceMs;
+    }
+
+    for (ULONG slot = 0; slot < ActionSlotCount; slot++)
+    {
+        BOOLEAN valid = BtnDecodeAction(gDefaultActions[slot], &DeviceContext->Actions[slot]);
+
+        NT_ASSERT(valid);
+        UNREFERENCED_PARAMETER(valid);
+    }
+
+    status = WdfDeviceOpenRegistryKey(
+        DeviceContext->FxDevice,
+        PLUGPLAY_REGISTRY_DEVICE,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &key);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_INIT,
+            "Error opening device registry key, using default key mapping - 0x%08X",
+            status);
+
+        goto exit;
+    }
+
+    for (ULONG slot = 0; slot < ActionSlotCount; slot++)
+    {
+        RtlInitUnicodeString(&valueName, gActionValueNames[slot]);
+
+        status = WdfRegistryQueryULong(key, &valueName, &value);
+        if (!NT_SUCCESS(status))
+        {
+            continue;
+        }
+
+        if (!BtnDecodeAction(value, &DeviceContext->Actions[slot]))
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INIT,
+                "Ignoring invalid mapping %ws=0x%08X",
+                gActionValueNames[slot],
+                value);
+
+            BtnDecodeAction(gDefaultActions[slot], &DeviceContext->Actions[slot]);
+            continue;
+        }
+
+        if (slot == BTN_TAP_SLOT(Power, 2))
+        {
+            powerDoubleTapMapped = TRUE;
+        }
+    }
+
+    for (ULONG index = 0; index < BTN_MAX_CHORDS; index++)
+    {
+        RtlInitUnicodeString(&valueName, gChordValueNames[index]);
+
+        status = WdfRegistryQueryULong(key, &valueName, &value);
+        if (!NT_SUCCESS(status))
+        {
+            continue;
+        }
+
+        if (!chordsMapped)
+        {
+            chordsMapped = TRUE;
+            DeviceContext->ChordCount = 0;
+        }
+
+        if (value == 0)
+        {
+            continue;
+        }
+
+        if (!BtnDecodeChord(value, &chord))
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INIT,
+                "Ignoring invalid chord %ws=0x%08X",
+                gChordValueNames[index],
+                value);
+
+            continue;
+        }
+
+        DeviceContext->ChordMasks[DeviceContext->ChordCount] = chord.Mask;
+        DeviceContext->ChordSlots[DeviceContext->ChordCount] = chord.Slot;
+        DeviceContext->ChordTolerancesMs[DeviceContext->ChordCount] = chord.ToleranceMs;
+        DeviceContext->ChordCount++;
+    }
+
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &toleranceValueName, &value)))
+    {
+        if (value <= BTN_CHORD_MAX_TOLERANCE_MS)
+        {
+            DeviceContext->ChordToleranceMs = value;
+        }
+        else
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INIT,
+                "Ignoring invalid chord tolerance ChordToleranceMs=%lu",
+                value);
+        }
+    }
+
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &cameraValueName, &value)))
+    {
+        powerDoubleTapCamera = value != 0;
+    }
+
+    WdfRegistryClose(key);
+
+exit:
+
+    if (powerDoubleTapCamera && DeviceContext->Lines[Camera].Interrupt == NULL && !powerDoubleTapMapped)
+    {
+        DeviceContext->Actions[BTN_TAP_SLOT(Power, 2)] = DeviceContext->Actions[Camera];
+
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_INIT,
+            "No camera button, power double tap fires the camera action");
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+BtnAddReport(
+    IN OUT PBTN_TRANSITION Transition,
+    IN BTN_REPORT Report
+    )
+{
+    NT_ASSERT(Transition->ReportCount < BTN_TRANSITION_MAX_REPORTS);
+
+    Transition->Reports[Transition->ReportCount++] = Report;
+}
+
+static
+VOID
+BtnApplyAction(
+    IN const BTN_ACTION* Action,
+    IN BOOLEAN Pressed,
+    IN OUT PBTN_TRANSITION Transition
+    )
+{
+    BTN_REPORT released = { 0 };
+
+    released.ReportID = Action->Report.ReportID;
+
+    switch (Action->Mode)
+    {
+    case ActionModeFollow:
+        BtnAddReport(Transition, Pressed ? Action->Report : released);
+        break;
+
+    case ActionModeTapOnPress:
+    case ActionModeTapOnRelease:
+    case ActionModeTapOnChange:
+        if ((Action->Mode == ActionModeTapOnPress && !Pressed) ||
+            (Action->Mode == ActionModeTapOnRelease && Pressed))
+        {
+            break;
+        }
+
+        // Unpress the keys immediately
+        BtnAddReport(Transition, Action->Report);
+        BtnAddReport(Transition, released);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static
+VOID
+BtnEvaluateTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN BOOLEAN IgnoreButtonPresses,
+    OUT PBTN_TRANSITION Transition
+    )
+/*++
+
+Routine Description:
+
+    Computes the reports and the next IgnoreButtonPresses value for one
+    edge of a single key, chords are handled by BtnChordOnTransition. Only
+    used to fill the transition table, never on the interrupt path.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context holding the action map
+    ButtonType - Line that changed state
+    StateMask - Button mask after the edge
+    IgnoreButtonPresses - Value of the flag before the edge
+    Transition - Receives the outcome
+
+Return Value:
+
+    None
+
+--*/
+{
+    ULONG RelevantButtonActiveCount = RtlNumberOfSetBitsUlongPtr(StateMask & BUTTON_MASK_KEYS);
+
+    RtlZeroMemory(Transition, sizeof(BTN_TRANSITION));
+    Transition->IgnoreButtonPresses = IgnoreButtonPresses;
+
+    //
+    // Only one key should be active at a time outside of chords
+    // The only exception is the slider where we can expect it to be enabled with other keys
+    //
+    if (RelevantButtonActiveCount <= 1)
+    {
+        if (!IgnoreButtonPresses || !(BUTTON_BIT(ButtonType) & BUTTON_MASK_KEYS))
+        {
+            BtnApplyAction(
+                &DeviceContext->Actions[ButtonType],
+                BUTTON_PRESSED(StateMask, ButtonType),
+                Transition);
+        }
+        else if (BUTTON_PRESSED(StateMask, ButtonType))
+        {
+            Transition->PressIgnored = TRUE;
+        }
+    }
+
+    if (RelevantButtonActiveCount == 0)
+    {
+        Transition->IgnoreButtonPresses = FALSE;
+    }
+}
+
+VOID
+BtnBuildTransitionTable(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    Compiles the action map and the button combination rules into
+    DeviceContext->Transitions so that evaluating an edge is a single
+    table load, the hold and multi-tap actions into HoldPress,
+    HoldRelease, GesturePress and GestureRelease, and the chord list into
+    the bit-sliced ChordRules, so that matching a key event against every
+    chord costs the same however many chords there are.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+
+Return Value:
+
+    None
+
+--*/
+{
+    PAGED_CODE();
+
+    for (ULONG ignore = 0; ignore < 2; ignore++)
+    {
+        for (ULONG mask = 0; mask <= BUTTON_MASK_ALL; mask++)
+        {
+            for (ULONG button = 0; button < ButtonCount; button++)
+            {
+                BtnEvaluateTransition(
+                    DeviceContext,
+                    (BUTTON_TYPE)button,
+                    mask,
+                    (BOOLEAN)ignore,
+                    &DeviceContext->Transitions[BTN_TRANSITION_INDEX(ignore, mask, button)]);
+            }
+        }
+    }
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        const BTN_ACTION* action = &DeviceContext->Actions[BTN_HOLD_SLOT(button)];
+
+        RtlZeroMemory(&DeviceContext->HoldPress[button], sizeof(BTN_TRANSITION));
+        RtlZeroMemory(&DeviceContext->HoldRelease[button], sizeof(BTN_TRANSITION));
+
+        BtnApplyAction(action, TRUE, &DeviceContext->HoldPress[button]);
+        BtnApplyAction(action, FALSE, &DeviceContext->HoldRelease[button]);
+
+        for (ULONG taps = 2; taps <= BTN_GESTURE_MAX_TAPS; taps++)
+        {
+            PBTN_TRANSITION press = &DeviceContext->GesturePress[button][taps - 2];
+            PBTN_TRANSITION release = &DeviceContext->GestureRelease[button][taps - 2];
+
+            action = &DeviceContext->Actions[BTN_TAP_SLOT(button, taps)];
+
+            RtlZeroMemory(press, sizeof(BTN_TRANSITION));
+            RtlZeroMemory(release, sizeof(BTN_TRANSITION));
+
+            BtnApplyAction(action, TRUE, press);
+            BtnApplyAction(action, FALSE, release);
+        }
+    }
+
+    BtnRuleSetInit(&DeviceContext->ChordRules, ButtonCount);
+
+    for (ULONG chord = 0; chord < DeviceContext->ChordCount; chord++)
+    {
+        const BTN_ACTION* action = &DeviceContext->Actions[DeviceContext->ChordSlots[chord]];
+        ULONG mask = DeviceContext->ChordMasks[chord];
+
+        NT_ASSERT((mask & ~BUTTON_MASK_KEYS) == 0);
+
+        if (DeviceContext->ChordToleranceMs != MAXULONG)
+        {
+            DeviceContext->ChordTolerancesMs[chord] = DeviceContext->ChordToleranceMs;
+        }
+
+        RtlZeroMemory(&DeviceContext->ChordPress[chord], sizeof(BTN_TRANSITION));
+        RtlZeroMemory(&DeviceContext->ChordRelease[chord], sizeof(BTN_TRANSITION));
+
+        BtnApplyAction(action, TRUE, &DeviceContext->ChordPress[chord]);
+        BtnApplyAction(action, FALSE, &DeviceContext->ChordRelease[chord]);
+
+        DeviceContext->ChordPress[chord].IgnoreButtonPresses = TRUE;
+        DeviceContext->ChordRelease[chord].IgnoreButtonPresses = TRUE;
+
+        if (action->Mode == ActionModeNone)
+        {
+            continue;
+        }
+
+        //
+        // Any of the chord's keys completes it, no other key may be held
+        //
+        BtnRuleSetAdd(&DeviceContext->ChordRules, chord, mask, BUTTON_MASK_KEYS & ~mask, mask);
+    }
+}
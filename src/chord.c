@@ -0,0 +1,266 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <device.h>
+#include <deadline.h>
+#include <chord.h>
+#include <eventlog.h>
+#include <trace.h>
+
+static
+VOID
+BtnChordReplay(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    Delivers the presses held back for a chord that did not come together,
+    in the order and with the timestamps they arrived with.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+
+Return Value:
+
+    None
+
+--*/
+{
+    BTN_DEFERRED_TRANSITION held[ButtonCount];
+    ULONG heldCount = DeviceContext->ChordHeldCount;
+
+    if (heldCount == 0)
+    {
+        return;
+    }
+
+    BtnClearDeadline(DeviceContext, DeviceContext->ChordHeld[0].Button, DeadlineChord);
+
+    //
+    // Delivering may hold back presses again, start from an empty list
+    //
+    RtlCopyMemory(held, DeviceContext->ChordHeld, heldCount * sizeof(BTN_DEFERRED_TRANSITION));
+
+    DeviceContext->ChordHeldCount = 0;
+    DeviceContext->ChordHeldMask = 0;
+
+    BtnTraceEvent(DeviceContext, BtnEventChordReplayed, held[0].Button, heldCount);
+
+    for (ULONG i = 0; i < heldCount; i++)
+    {
+        BtnDeliverTransition(
+            DeviceContext,
+            held[i].Button,
+            held[i].StateMask,
+            held[i].Transition,
+            held[i].EdgeTime);
+    }
+}
+
+static
+const BTN_TRANSITION*
+BtnChordFire(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN ULONG Chord,
+    IN ULONGLONG EdgeTime
+    )
+{
+    ULONG reported = DeviceContext->ChordMasks[Chord] & StateMask & ~DeviceContext->ChordHeldMask & ~BUTTON_BIT(ButtonType);
+
+    //
+    // Presses held back are swallowed by the chord, keys that were reported
+    // before it came together are let go
+    //
+    if (DeviceContext->ChordHeldCount != 0)
+    {
+        BtnClearDeadline(DeviceContext, DeviceContext->ChordHeld[0].Button, DeadlineChord);
+
+        DeviceContext->ChordHeldCount = 0;
+        DeviceContext->ChordHeldMask = 0;
+    }
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        const BTN_ACTION* action = &DeviceContext->Actions[button];
+        BTN_REPORT released = { 0 };
+
+        if ((reported & BUTTON_BIT(button)) == 0 || action->Mode != ActionModeFollow)
+        {
+            continue;
+        }
+
+        released.ReportID = action->Report.ReportID;
+
+        SendReport(DeviceContext, released, (BUTTON_TYPE)button, EdgeTime);
+    }
+
+    DeviceContext->ActiveChord = Chord + 1;
+
+    BtnTraceEvent(DeviceContext, BtnEventChordFired, ButtonType, DeviceContext->ChordMasks[Chord]);
+
+    return &DeviceContext->ChordPress[Chord];
+}
+
+const BTN_TRANSITION*
+BtnChordOnTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN const BTN_TRANSITION* Transition,
+    IN ULONGLONG EdgeTime
+    )
+/*++
+
+Routine Description:
+
+    Matches one evaluated edge against the chord rules compiled by
+    BtnBuildTransitionTable, all of them at once: a press completing a
+    chord fires it, a press that may still become part of a larger chord
+    is held back for that chord's tolerance, anything else flushes the
+    presses held back so far.
+
+    Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line that changed state
+    StateMask - Button mask after the edge
+    Transition - Outcome of the edge for the key on its own
+    EdgeTime - Interrupt time of the edge
+
+Return Value:
+
+    Transition to deliver for the edge, NULL if it was held back
+
+--*/
+{
+    BOOLEAN pressed = BUTTON_PRESSED(StateMask, ButtonType) ? TRUE : FALSE;
+    BTN_RULE_MATCH match;
+    ULONG toleranceMs;
+    ULONG chord;
+
+    if ((BUTTON_BIT(ButtonType) & BUTTON_MASK_KEYS) == 0)
+    {
+        return Transition;
+    }
+
+    match = BtnRuleMatch(&DeviceContext->ChordRules, StateMask & BUTTON_MASK_KEYS, ButtonType);
+    toleranceMs = match.Partial >= 0 ? DeviceContext->ChordTolerancesMs[match.Partial] : 0;
+
+    //
+    // A tolerance that ran out before this edge is flushed first, its
+    // deadline may just not have been serviced yet
+    //
+    if (DeviceContext->ChordHeldCount != 0 && EdgeTime >= DeviceContext->ChordDeadline)
+    {
+        BtnChordReplay(DeviceContext);
+    }
+
+    if (pressed && match.Complete >= 0)
+    {
+        return BtnChordFire(DeviceContext, ButtonType, StateMask, (ULONG)match.Complete, EdgeTime);
+    }
+
+    if (!pressed &&
+        DeviceContext->ActiveChord != 0 &&
+        (DeviceContext->ChordMasks[DeviceContext->ActiveChord - 1] & BUTTON_BIT(ButtonType)) != 0)
+    {
+        chord = DeviceContext->ActiveChord - 1;
+        DeviceContext->ActiveChord = 0;
+
+        return &DeviceContext->ChordRelease[chord];
+    }
+
+    if (pressed && toleranceMs != 0 && !DeviceContext->IgnoreButtonPresses)
+    {
+        //
+        // Presses that report nothing have nothing to hold back
+        //
+        if (Transition->ReportCount == 0)
+        {
+            return Transition;
+        }
+
+        if (DeviceContext->ChordHeldCount == 0)
+        {
+            DeviceContext->ChordDeadline = EdgeTime + BTN_MS_TO_INTERRUPT_TIME(toleranceMs);
+
+            BtnSetDeadline(DeviceContext, ButtonType, DeadlineChord, DeviceContext->ChordDeadline);
+        }
+
+        NT_ASSERT(DeviceContext->ChordHeldCount < ButtonCount);
+
+        DeviceContext->ChordHeld[DeviceContext->ChordHeldCount].Transition = Transition;
+        DeviceContext->ChordHeld[DeviceContext->ChordHeldCount].EdgeTime = EdgeTime;
+        DeviceContext->ChordHeld[DeviceContext->ChordHeldCount].Button = ButtonType;
+        DeviceContext->ChordHeld[DeviceContext->ChordHeldCount].StateMask = StateMask;
+        DeviceContext->ChordHeldCount++;
+        DeviceContext->ChordHeldMask |= BUTTON_BIT(ButtonType);
+
+        return NULL;
+    }
+
+    //
+    // No chord can complete from here, or a key held back went up
+    //
+    if (pressed || (DeviceContext->ChordHeldMask & BUTTON_BIT(ButtonType)) != 0)
+    {
+        BtnChordReplay(DeviceContext);
+    }
+
+    return Transition;
+}
+
+VOID
+BtnChordExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Chord deadline of the deadline wheel, the presses held back did not
+    come together into a chord in time.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line of the first press held back
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    UNREFERENCED_PARAMETER(ButtonType);
+    UNREFERENCED_PARAMETER(Now);
+
+    BtnChordReplay(DeviceContext);
+}
+
+VOID
+BtnChordReset(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+{
+    //
+    // Presses held back go out on their own, the chord can no longer
+    // come together
+    //
+    BtnChordReplay(DeviceContext);
+
+    DeviceContext->ActiveChord = 0;
+    DeviceContext->ChordHeldCount = 0;
+    DeviceContext->ChordHeldMask = 0;
+}
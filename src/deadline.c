@@ -0,0 +1,230 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <device.h>
+#include <deadline.h>
+#include <debounce.h>
+#include <gesture.h>
+#include <chord.h>
+#include <storm.h>
+#include <stuck.h>
+#include <hold.h>
+#include <trace.h>
+
+static
+VOID
+BtnArmDeadlineTimer(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Deadline,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Makes sure the shared deadline timer fires no later than Deadline. The
+    timer is only restarted when it is idle or due after Deadline, so a
+    burst of deadlines arms it at most once.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    Deadline - Interrupt time by which the drain must run again
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    if (ReadNoFence(&DeviceContext->DeadlineArmed) && DeviceContext->Deadline <= Deadline)
+    {
+        return;
+    }
+
+    WriteNoFence(&DeviceContext->DeadlineArmed, TRUE);
+    DeviceContext->Deadline = Deadline;
+
+    //
+    // Negative due times are relative, in 100ns units like the interrupt time
+    //
+    WdfTimerStart(
+        DeviceContext->DeadlineTimer,
+        -(LONGLONG)(Deadline > Now ? Deadline - Now : 1));
+}
+
+VOID
+BtnSetDeadline(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BTN_DEADLINE_KIND Kind,
+    IN ULONGLONG Deadline
+    )
+/*++
+
+Routine Description:
+
+    Schedules one slot of the deadline wheel, replacing the deadline it held.
+    Only called by the drain owner, the wheel needs no locking.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line the deadline belongs to
+    Kind - What BtnServiceDeadlines does when it expires
+    Deadline - Interrupt time of expiry
+
+Return Value:
+
+    None
+
+--*/
+{
+    DeviceContext->Deadlines[ButtonType][Kind] = Deadline;
+
+    BtnArmDeadlineTimer(DeviceContext, Deadline, BtnQueryInterruptTime());
+}
+
+VOID
+BtnClearDeadline(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BTN_DEADLINE_KIND Kind
+    )
+{
+    //
+    // The timer is left running, an expiry with nothing due is harmless
+    //
+    DeviceContext->Deadlines[ButtonType][Kind] = 0;
+}
+
+VOID
+BtnServiceDeadlines(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Runs every expired slot of the deadline wheel and re-arms the shared
+    timer for the earliest slot still pending. Handlers may schedule new
+    deadlines. Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    ULONGLONG nextDeadline = MAXULONGLONG;
+
+    if (ReadNoFence(&DeviceContext->DeadlineArmed) && Now >= DeviceContext->Deadline)
+    {
+        WriteNoFence(&DeviceContext->DeadlineArmed, FALSE);
+    }
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        for (ULONG kind = 0; kind < DeadlineKindCount; kind++)
+        {
+            ULONGLONG deadline = DeviceContext->Deadlines[button][kind];
+
+            if (deadline == 0 || deadline > Now)
+            {
+                continue;
+            }
+
+            DeviceContext->Deadlines[button][kind] = 0;
+
+            switch (kind)
+            {
+            case DeadlineSettle:
+                BtnDebounceSettle(DeviceContext, (BUTTON_TYPE)button);
+                break;
+
+            case DeadlineHold:
+                BtnHoldExpired(DeviceContext, (BUTTON_TYPE)button, Now);
+                break;
+
+            case DeadlineRepeat:
+                BtnRepeatExpired(DeviceContext, (BUTTON_TYPE)button, Now);
+                break;
+
+            case DeadlineGesture:
+                BtnGestureExpired(DeviceContext, (BUTTON_TYPE)button, Now);
+                break;
+
+            case DeadlineChord:
+                BtnChordExpired(DeviceContext, (BUTTON_TYPE)button, Now);
+                break;
+
+            case DeadlineStorm:
+                BtnStormExpired(DeviceContext, (BUTTON_TYPE)button, Now);
+                break;
+
+            case DeadlineStuck:
+                BtnStuckExpired(DeviceContext, (BUTTON_TYPE)button, Now);
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        for (ULONG kind = 0; kind < DeadlineKindCount; kind++)
+        {
+            if (DeviceContext->Deadlines[button][kind] != 0)
+            {
+                nextDeadline = min(nextDeadline, DeviceContext->Deadlines[button][kind]);
+            }
+        }
+    }
+
+    if (nextDeadline != MAXULONGLONG)
+    {
+        BtnArmDeadlineTimer(DeviceContext, nextDeadline, Now);
+    }
+}
+
+VOID
+OnDeadlineTimer(
+    IN WDFTIMER Timer
+    )
+/*++
+
+Routine Description:
+
+    Passive level callback of the shared deadline timer. All deadline work
+    happens in the drain, the timer only makes sure one runs. The timer is
+    no longer pending once it has fired, whether or not the deadline has
+    passed by the drain's clock, so the drain must be free to start it
+    again. An expiry a little ahead of the deadline would otherwise leave
+    the slot waiting on a timer that never comes.
+
+Arguments:
+
+    Timer - Handle to the framework timer object
+
+Return Value:
+
+    None
+
+--*/
+{
+    PDEVICE_EXTENSION devContext = GetDeviceContext(WdfTimerGetParentObject(Timer));
+
+    WriteNoFence(&devContext->DeadlineArmed, FALSE);
+
+    BtnDrainPendingEdges(devContext);
+}
@@ -0,0 +1,495 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <device.h>
+#include <debounce.h>
+#include <deadline.h>
+#include <stuck.h>
+#include <btntune.h>
+#include <eventlog.h>
+#include <trace.h>
+
+#ifdef ALLOC_PRAGMA
+  #pragma alloc_text(PAGE, BtnLoadDebounceConfig)
+#endif
+
+//
+// Registry value name and default stable-state window of every line
+//
+static const PCWSTR gDebounceValueNames[ButtonCount] =
+{
+    L"PowerDebounceMs",
+    L"VolumeUpDebounceMs",
+    L"VolumeDownDebounceMs",
+    L"CameraFocusDebounceMs",
+    L"CameraDebounceMs",
+    L"SliderDebounceMs",
+};
+
+static const ULONG gDefaultDebounceMs[ButtonCount] =
+{
+    10,     // Power
+    10,     // VolumeUp
+    10,     // VolumeDown
+    10,     // CameraFocus
+    10,     // Camera
+    20,     // Slider, a sliding contact bounces for longer
+};
+
+#define BTN_US_TO_INTERRUPT_TIME(Us)        ((ULONGLONG)(Us) * 10)
+#define BTN_INTERRUPT_TIME_TO_US(Time)      ((ULONG)((Time) / 10))
+
+C_ASSERT(BTN_TUNE_BUCKETS == BTN_LATENCY_BUCKETS);
+
+NTSTATUS
+BtnLoadDebounceConfig(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    Sets every line's debounce bounds from the device's hardware registry
+    key. <Name>DebounceMs is the upper bound, and the window the line starts
+    with before it has learned its bounce; DebounceMinimumMs is the lower
+    bound shared by all lines. Values that are absent or above
+    BTN_DEBOUNCE_MAX_MS keep the built-in ones, 0 disables debouncing for
+    the line.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+    WDFKEY key = NULL;
+    UNICODE_STRING valueName;
+    ULONG value;
+    ULONG minimumMs = BTN_DEBOUNCE_DEFAULT_MINIMUM_MS;
+    DECLARE_CONST_UNICODE_STRING(minimumValueName, L"DebounceMinimumMs");
+
+    PAGED_CODE();
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        PBUTTON_LINE line = &DeviceContext->Lines[button];
+
+        line->DebounceMaximum = BTN_MS_TO_INTERRUPT_TIME(gDefaultDebounceMs[button]);
+        line->QuietUntil = 0;
+        line->EdgesSinceTuning = 0;
+        line->RawPressed = FALSE;
+        line->LogicalPressed = FALSE;
+    }
+
+    status = WdfDeviceOpenRegistryKey(
+        DeviceContext->FxDevice,
+        PLUGPLAY_REGISTRY_DEVICE,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &key);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_INIT,
+            "Error opening device registry key, using default debounce windows - 0x%08X",
+            status);
+
+        goto exit;
+    }
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        RtlInitUnicodeString(&valueName, gDebounceValueNames[button]);
+
+        status = WdfRegistryQueryULong(key, &valueName, &value);
+        if (!NT_SUCCESS(status))
+        {
+            continue;
+        }
+
+        if (value > BTN_DEBOUNCE_MAX_MS)
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INIT,
+                "Ignoring invalid debounce window %ws=%lu",
+                gDebounceValueNames[button],
+                value);
+
+            continue;
+        }
+
+        DeviceContext->Lines[button].DebounceMaximum = BTN_MS_TO_INTERRUPT_TIME(value);
+    }
+
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &minimumValueName, &value)))
+    {
+        if (value <= BTN_DEBOUNCE_MAX_MS)
+        {
+            minimumMs = value;
+        }
+        else
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INIT,
+                "Ignoring invalid debounce window DebounceMinimumMs=%lu",
+                value);
+        }
+    }
+
+    WdfRegistryClose(key);
+
+exit:
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        PBUTTON_LINE line = &DeviceContext->Lines[button];
+
+        line->DebounceMinimum = min(BTN_MS_TO_INTERRUPT_TIME(minimumMs), line->DebounceMaximum);
+        line->DebounceWindow = line->DebounceMaximum;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+BtnTuneDebounceWindow(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType
+    )
+/*++
+
+Routine Description:
+
+    Moves the line's window to the smallest value that still filters the
+    bounce observed so far, see BtnTuneWindowUs. The histogram is aged so
+    that the window follows a switch as it wears.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line to tune
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    unsigned long intervals[BTN_TUNE_BUCKETS];
+    ULONG samples = 0;
+    ULONG windowUs;
+
+    line->EdgesSinceTuning = 0;
+
+    if (line->DebounceMinimum == line->DebounceMaximum)
+    {
+        return;
+    }
+
+    for (ULONG bucket = 0; bucket < BTN_TUNE_BUCKETS; bucket++)
+    {
+        intervals[bucket] = (ULONG)ReadNoFence(&line->IntervalBuckets[bucket]);
+        samples += intervals[bucket];
+    }
+
+    windowUs = BtnTuneWindowUs(
+        intervals,
+        BTN_INTERRUPT_TIME_TO_US(line->DebounceMinimum),
+        BTN_INTERRUPT_TIME_TO_US(line->DebounceMaximum));
+
+    if (windowUs != 0 && BTN_US_TO_INTERRUPT_TIME(windowUs) != line->DebounceWindow)
+    {
+        line->DebounceWindow = BTN_US_TO_INTERRUPT_TIME(windowUs);
+
+        BtnTraceEvent(DeviceContext, BtnEventDebounceTuned, ButtonType, windowUs);
+    }
+
+    //
+    // Halve the histogram once it is large enough, edges counted by the ISR
+    // meanwhile are kept since only the halved amount is taken off
+    //
+    if (samples > BTN_TUNE_AGE_SAMPLES)
+    {
+        for (ULONG bucket = 0; bucket < BTN_TUNE_BUCKETS; bucket++)
+        {
+            InterlockedAdd(&line->IntervalBuckets[bucket], -(LONG)(intervals[bucket] / 2));
+        }
+    }
+}
+
+static
+VOID
+BtnAcceptTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
+    )
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+
+    line->LogicalPressed = !line->LogicalPressed;
+
+    BtnCountEvent(DeviceContext, ButtonType, CounterTransitions);
+
+    if (!BtnStuckOnTransition(DeviceContext, ButtonType, EdgeTime))
+    {
+        return;
+    }
+
+    HandleButtonPress(DeviceContext, ButtonType, EdgeTime);
+}
+
+VOID
+BtnDebounceEdges(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG Edges,
+    IN ULONGLONG FirstEdgeTime,
+    IN ULONGLONG LastEdgeTime
+    )
+/*++
+
+Routine Description:
+
+    Folds a batch of edges drained for one line into its debounced state.
+    The first edge after a quiet period is accepted immediately; edges
+    within DebounceWindow of the previous one only flip the raw parity and
+    extend the window. If the raw state disagrees with the reported state
+    once the line has been quiet for a full window, the settle deadline
+    reports the difference.
+
+    Only called by the drain owner, the line state needs no locking.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line the edges belong to
+    Edges - Number of edges in the batch
+    FirstEdgeTime - Interrupt time of the first edge of the batch
+    LastEdgeTime - Interrupt time of the last edge of the batch
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    ULONG filtered = Edges;
+
+    //
+    // A pending settle that expired before this batch goes first, so the
+    // reported sequence keeps the order the contacts moved in
+    //
+    if (line->RawPressed != line->LogicalPressed && FirstEdgeTime >= line->QuietUntil)
+    {
+        BtnAcceptTransition(DeviceContext, ButtonType, line->LastEdgeTime);
+    }
+
+    line->RawPressed ^= (Edges & 1);
+
+    if (FirstEdgeTime >= line->QuietUntil)
+    {
+        BtnAcceptTransition(DeviceContext, ButtonType, FirstEdgeTime);
+        filtered--;
+    }
+
+    line->LastEdgeTime = LastEdgeTime;
+    line->QuietUntil = max(LastEdgeTime, FirstEdgeTime) + line->DebounceWindow;
+
+    if (filtered != 0)
+    {
+        InterlockedAdd(&DeviceContext->Counters[ButtonType][CounterEdgesFiltered], (LONG)filtered);
+        BtnTraceEvent(DeviceContext, BtnEventEdgesFiltered, ButtonType, filtered);
+    }
+
+    if (line->RawPressed != line->LogicalPressed)
+    {
+        BtnSetDeadline(DeviceContext, ButtonType, DeadlineSettle, line->QuietUntil);
+    }
+    else
+    {
+        BtnClearDeadline(DeviceContext, ButtonType, DeadlineSettle);
+    }
+
+    line->EdgesSinceTuning += Edges;
+
+    if (line->EdgesSinceTuning >= BTN_TUNE_PERIOD)
+    {
+        BtnTuneDebounceWindow(DeviceContext, ButtonType);
+    }
+}
+
+VOID
+BtnDebounceLevel(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BOOLEAN Pressed
+    )
+/*++
+
+Routine Description:
+
+    Corrects the raw state of a line to a level read after its edges were
+    debounced, once no further edge is pending for it. The edge that was
+    lost is not made up: the level only replaces the raw parity, and the
+    settle deadline reports the difference once the line has been quiet
+    for its window, as it would for any bounce train.
+
+    Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line whose level was read
+    Pressed - Level of the line
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+
+    if (line->RawPressed == Pressed)
+    {
+        return;
+    }
+
+    BtnTraceEvent(DeviceContext, BtnEventEdgeLost, ButtonType, Pressed);
+
+    line->RawPressed = Pressed;
+
+    if (line->RawPressed != line->LogicalPressed)
+    {
+        BtnSetDeadline(DeviceContext, ButtonType, DeadlineSettle, line->QuietUntil);
+    }
+    else
+    {
+        BtnClearDeadline(DeviceContext, ButtonType, DeadlineSettle);
+    }
+}
+
+VOID
+BtnDebounceResync(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BOOLEAN Pressed,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Forces the line's debounced state to a level known by other means,
+    after edges have been lost. Only a difference between the level and
+    the state last reported in ButtonMask is reported, right away, so
+    that a line that went through edges nobody saw and came back reports
+    nothing. A stuck line reports nothing either, its release went out
+    when it was quarantined.
+
+    Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line to resynchronize
+    Pressed - Level of the line
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    BOOLEAN changed = line->LogicalPressed != Pressed;
+
+    BtnClearDeadline(DeviceContext, ButtonType, DeadlineSettle);
+
+    line->RawPressed = Pressed;
+    line->LogicalPressed = Pressed;
+    line->LastEdgeTime = Now;
+    line->QuietUntil = Now;
+
+    //
+    // A press the line is still in restarts the stuck timeout, whose
+    // deadline may have been dropped while the device was off
+    //
+    if ((changed || (Pressed && !line->Stuck)) &&
+        !BtnStuckOnTransition(DeviceContext, ButtonType, Now))
+    {
+        return;
+    }
+
+    //
+    // Still pressed, the line stays quarantined. Its interrupt was enabled
+    // to read the level, by the framework at D0 entry or to poll it.
+    //
+    if (line->Stuck)
+    {
+        BtnStuckMask(DeviceContext, ButtonType, Now);
+        return;
+    }
+
+    if ((BOOLEAN)BUTTON_PRESSED(ReadNoFence(&DeviceContext->ButtonMask), ButtonType) == Pressed)
+    {
+        return;
+    }
+
+    BtnCountEvent(DeviceContext, ButtonType, CounterTransitions);
+    BtnTraceEvent(DeviceContext, BtnEventEdgeSettled, ButtonType, Pressed);
+
+    HandleButtonPress(DeviceContext, ButtonType, Now);
+}
+
+VOID
+BtnDebounceSettle(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType
+    )
+/*++
+
+Routine Description:
+
+    Settle deadline of the deadline wheel. Reports the final state of a
+    line whose bounce train ended with the raw state differing from the
+    reported one, now that the line has been quiet for its window.
+
+    Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line that has gone quiet
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+
+    if (line->RawPressed == line->LogicalPressed)
+    {
+        return;
+    }
+
+    BtnTraceEvent(DeviceContext, BtnEventEdgeSettled, ButtonType, line->RawPressed);
+    BtnAcceptTransition(DeviceContext, ButtonType, line->LastEdgeTime);
+}
@@ -5,44 +5,71 @@
 #include <device.h>
 #include <spb.h>
 #include <idle.h>
+#include <action.h>
+#include <debounce.h>
+#include <deadline.h>
+#include <hold.h>
+#include <gesture.h>
+#include <chord.h>
+#include <storm.h>
+#include <stuck.h>
+#include <level.h>
+#include <lifecycle.h>
+#include <eventlog.h>
 #include <trace.h>
 
 #ifdef ALLOC_PRAGMA
   #pragma alloc_text(PAGE, OnD0Exit)
 #endif
 
-VOID SendReport(
+//
+// Button lines in the order their interrupt resources are listed in ACPI
+//
+const BUTTON_DESCRIPTOR gButtonDescriptors[ButtonCount] =
+{
+    { "Power",       3 },
+    { "VolumeUp",    3 },
+    { "VolumeDown",  3 },
+    { "CameraFocus", 5 },
+    { "Camera",      5 },
+    { "Slider",      6 },
+};
+
+VOID BtnRecordLatency(
     IN PDEVICE_EXTENSION deviceContext,
-    IN BTN_REPORT hidReportFromDriver
+    IN BUTTON_TYPE ButtonType,
+    IN BTN_LATENCY_STAGE Stage,
+    IN ULONGLONG StartTime,
+    IN ULONGLONG EndTime
 )
 {
-    NTSTATUS status;
-    WDFREQUEST request = NULL;
-    PBTN_REPORT hidReportRequestBuffer = { 0 };
-    size_t hidReportRequestBufferLength;
-
-    status = WdfIoQueueRetrieveNextRequest(
-        deviceContext->PingPongQueue,
-        &request);
-
-    if (!NT_SUCCESS(status))
+    if (StartTime == 0 || EndTime < StartTime)
     {
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL,
-            "No request pending from HIDClass, ignoring report - STATUS:%X",
-            status);
+        return;
     }
 
+    InterlockedIncrement(&deviceContext->LatencyBuckets[ButtonType][Stage][BtnDurationBucket(EndTime - StartTime)]);
+}
+
+VOID BtnCompleteReadRequest(
+    IN PDEVICE_EXTENSION deviceContext,
+    IN WDFREQUEST request,
+    IN const BTN_PENDING_REPORT* pendingReport
+)
+{
+    NTSTATUS status;
+    PBTN_REPORT hidReportRequestBuffer = NULL;
+    size_t hidReportRequestBufferLength;
+
     status = WdfRequestRetrieveOutputBuffer(
         request,
         sizeof(BTN_REPORT),
-        &hidReportRequestBuffer,
+        (PVOID*)&hidReportRequestBuffer,
         &hidReportRequestBufferLength);
 
     if (!NT_SUCCESS(status))
     {
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL,
-            "Error retrieving HID read request output buffer - STATUS:%X",
-            status);
+        BtnTraceEvent(deviceContext, BtnEventReadFailed, (ULONG)status, 0);
     }
     else
     {
@@ -53,15 +80,13 @@ VOID SendReport(
         {
             status = STATUS_BUFFER_TOO_SMALL;
 
-            DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "Error HID read request buffer is too small (%d bytes) - STATUS:%X\n",
-                hidReportRequestBufferLength,
-                status);
+            BtnTraceEvent(deviceContext, BtnEventReadFailed, (ULONG)status, (ULONG)hidReportRequestBufferLength);
         }
         else
         {
             RtlCopyMemory(
                 hidReportRequestBuffer,
-                &hidReportFromDriver,
+                &pendingReport->Report,
                 sizeof(BTN_REPORT));
 
             WdfRequestSetInformation(request, sizeof(BTN_REPORT));
@@ -69,307 +94,460 @@ VOID SendReport(
     }
 
     WdfRequestComplete(request, status);
+
+    if (!NT_SUCCESS(status))
+    {
+        BtnCountEvent(deviceContext, pendingReport->Button, CounterReportsDropped);
+    }
+    else
+    {
+        BtnTraceEvent(
+            deviceContext,
+            BtnEventReportCompleted,
+            pendingReport->Report.ReportID,
+            pendingReport->Report.KeysData.Raw);
+
+        ULONGLONG completedTime = BtnQueryInterruptTime();
+
+        BtnRecordLatency(deviceContext, pendingReport->Button, LatencyStageDeliver, pendingReport->EvaluatedTime, completedTime);
+        BtnRecordLatency(deviceContext, pendingReport->Button, LatencyStageTotal, pendingReport->EdgeTime, completedTime);
+    }
 }
 
-VOID EvaluateButtonAction(
+VOID SendReport(
     IN PDEVICE_EXTENSION deviceContext,
-    IN BUTTON_TYPE ButtonType
+    IN BTN_REPORT hidReportFromDriver,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
 )
 {
-    BTN_REPORT hidReportFromDriver = { 0 };
+    NTSTATUS status;
+    WDFREQUEST request = NULL;
+    BOOLEAN overflow = FALSE;
+    BTN_PENDING_REPORT pendingReport;
 
-    int RelevantButtonActiveCount = (int)deviceContext->StateCamera + (int)deviceContext->StateCameraFocus +
-                                    (int)deviceContext->StatePower +
-                                    (int)deviceContext->StateVolumeUp + (int)deviceContext->StateVolumeDown;
+    pendingReport.Report = hidReportFromDriver;
+    pendingReport.Button = ButtonType;
+    pendingReport.EdgeTime = EdgeTime;
+    pendingReport.EvaluatedTime = BtnQueryInterruptTime();
 
-    if (RelevantButtonActiveCount <= 2)
+    if (ReadNoFence(&deviceContext->AwaitingFirstReport) &&
+        InterlockedExchange(&deviceContext->AwaitingFirstReport, FALSE))
     {
-        // Trigger on Volume Up being high
-        if (deviceContext->StatePower && deviceContext->StateVolumeUp && ButtonType == VolumeUp)
-        {
-            // Power + Volume Up (High)
-            // WIN + F15
+        BtnLifecycleRecordPhase(
+            deviceContext,
+            LifecyclePhaseFirstReport,
+            deviceContext->LifecycleTimes[LifecyclePoweringUp],
+            pendingReport.EvaluatedTime);
+    }
 
-            hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-            hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStatePressed;
-            hidReportFromDriver.KeysData.Keyboard.F15 = ButtonStatePressed;
-            SendReport(deviceContext, hidReportFromDriver);
+    if (ReadNoFence64(&deviceContext->WakeTime) != 0)
+    {
+        BtnLifecycleRecordPhase(
+            deviceContext,
+            LifecyclePhaseWakeReport,
+            (ULONGLONG)InterlockedExchange64(&deviceContext->WakeTime, 0),
+            pendingReport.EvaluatedTime);
+    }
 
-            // Unpress the keys immediately
-            hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-            hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStateUnpressed;
-            hidReportFromDriver.KeysData.Keyboard.F15 = ButtonStateUnpressed;
-            SendReport(deviceContext, hidReportFromDriver);
+    BtnCountEvent(deviceContext, ButtonType, CounterReportsEmitted);
 
-            deviceContext->IgnoreButtonPresses = TRUE;
-        }
-        // Trigger on Volume Down being high
-        else if (deviceContext->StatePower && deviceContext->StateVolumeDown && ButtonType == VolumeDown)
+    //
+    // ReportLock keeps this and BtnReadReport from both deciding the other
+    // side is empty, a report is either handed to a pending read or parked
+    // in the ring for the next one.
+    //
+    WdfSpinLockAcquire(deviceContext->ReportLock);
+
+    status = WdfIoQueueRetrieveNextRequest(
+        deviceContext->PingPongQueue,
+        &request);
+
+    if (!NT_SUCCESS(status))
+    {
+        request = NULL;
+
+        if (deviceContext->PendingReportCount < BTN_REPORT_RING_SIZE)
         {
-            // Power + Volume Down (High)
-            // CTRL + ALT + DEL
-
-            hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-            hidReportFromDriver.KeysData.Keyboard.LeftCtrl = ButtonStatePressed;
-            hidReportFromDriver.KeysData.Keyboard.LeftAlt = ButtonStatePressed;
-            hidReportFromDriver.KeysData.Keyboard.Del = ButtonStatePressed;
-            SendReport(deviceContext, hidReportFromDriver);
-
-            // Unpress the keys immediately
-            hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-            hidReportFromDriver.KeysData.Keyboard.LeftCtrl = ButtonStateUnpressed;
-            hidReportFromDriver.KeysData.Keyboard.LeftAlt = ButtonStateUnpressed;
-            hidReportFromDriver.KeysData.Keyboard.Del = ButtonStateUnpressed;
-            SendReport(deviceContext, hidReportFromDriver);
-
-            deviceContext->IgnoreButtonPresses = TRUE;
+            deviceContext->PendingReports[
+                (deviceContext->PendingReportHead + deviceContext->PendingReportCount) & (BTN_REPORT_RING_SIZE - 1)] =
+                pendingReport;
+            deviceContext->PendingReportCount++;
         }
-        //
-        // Only one key should be active at a time after checking the above combinations
-        // The only exception is the slider where we can expect it to be enabled with other keys
-        //
-        else if (RelevantButtonActiveCount <= 1)
+        else
         {
-            // Trigger on power being low
-            if (ButtonType == Power && !deviceContext->StatePower && !deviceContext->IgnoreButtonPresses)
-            {
-                // Power
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_CONTROL;
-                hidReportFromDriver.KeysData.Control.SystemPowerDown = ButtonStatePressed;
-                SendReport(deviceContext, hidReportFromDriver);
-
-                // Unpress the key immediately
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_CONTROL;
-                hidReportFromDriver.KeysData.Control.SystemPowerDown = ButtonStateUnpressed;
-                SendReport(deviceContext, hidReportFromDriver);
-            }
+            overflow = TRUE;
+        }
+    }
 
-            if (ButtonType == VolumeUp && !deviceContext->IgnoreButtonPresses)
-            {
-                // Volume Up
+    WdfSpinLockRelease(deviceContext->ReportLock);
 
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_CONSUMER;
-                hidReportFromDriver.KeysData.Consumer.VolumeUp = deviceContext->StateVolumeUp;
-                SendReport(deviceContext, hidReportFromDriver);
-            }
+    if (request != NULL)
+    {
+        BtnCompleteReadRequest(deviceContext, request, &pendingReport);
+    }
+    else if (overflow)
+    {
+        BtnCountEvent(deviceContext, ButtonType, CounterReportsDropped);
+        BtnTraceEvent(deviceContext, BtnEventReportDropped, hidReportFromDriver.ReportID, hidReportFromDriver.KeysData.Raw);
+    }
+    else
+    {
+        BtnTraceEvent(deviceContext, BtnEventReportParked, hidReportFromDriver.ReportID, hidReportFromDriver.KeysData.Raw);
+    }
+}
 
-            if (ButtonType == VolumeDown && !deviceContext->IgnoreButtonPresses)
-            {
-                // Volume Down
+ULONG BtnToggleButtonState(
+    IN PDEVICE_EXTENSION deviceContext,
+    IN BUTTON_TYPE ButtonType
+)
+/*++
 
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_CONSUMER;
-                hidReportFromDriver.KeysData.Consumer.VolumeDown = deviceContext->StateVolumeDown;
-                SendReport(deviceContext, hidReportFromDriver);
-            }
+  Routine Description:
 
-            if (ButtonType == CameraFocus && !deviceContext->IgnoreButtonPresses)
-            {
-                // Camera Focus
-                // Placeholder
+    Atomically flips the line's bit in ButtonMask.
 
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-                hidReportFromDriver.KeysData.Keyboard.LeftWin = deviceContext->StateCameraFocus;
-                SendReport(deviceContext, hidReportFromDriver);
-            }
+  Arguments:
 
-            if (ButtonType == Camera && !deviceContext->IgnoreButtonPresses)
-            {
-                // Camera
-                // Placeholder
+    deviceContext - Pointer to the device context
+    ButtonType - Line whose state changed
 
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-                hidReportFromDriver.KeysData.Keyboard.LeftWin = deviceContext->StateCamera;
-                SendReport(deviceContext, hidReportFromDriver);
-            }
+  Return Value:
 
-            if (deviceContext->StateSlider && ButtonType == Slider)
-            {
-                // Slider on
-                // WIN + F14
-
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-                hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStatePressed;
-                hidReportFromDriver.KeysData.Keyboard.F14 = ButtonStatePressed;
-                SendReport(deviceContext, hidReportFromDriver);
-
-                // Unpress the keys immediately
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-                hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStateUnpressed;
-                hidReportFromDriver.KeysData.Keyboard.F14 = ButtonStateUnpressed;
-                SendReport(deviceContext, hidReportFromDriver);
-            }
-            else if (!deviceContext->StateSlider && ButtonType == Slider)
-            {
-                // Slider off
-                // WIN + F14
-
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-                hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStatePressed;
-                hidReportFromDriver.KeysData.Keyboard.F14 = ButtonStatePressed;
-                SendReport(deviceContext, hidReportFromDriver);
-
-                // Unpress the keys immediately
-                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
-                hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStateUnpressed;
-                hidReportFromDriver.KeysData.Keyboard.F14 = ButtonStateUnpressed;
-                SendReport(deviceContext, hidReportFromDriver);
-            }
-        }
-    }
+    The button mask as of this update
 
-    if (RelevantButtonActiveCount == 0)
+--*/
+{
+    LONG oldMask;
+    LONG newMask;
+
+    do
     {
-        deviceContext->IgnoreButtonPresses = FALSE;
-    }
+        oldMask = ReadNoFence(&deviceContext->ButtonMask);
+        newMask = oldMask ^ (LONG)BUTTON_BIT(ButtonType);
+    } while (InterlockedCompareExchange(&deviceContext->ButtonMask, newMask, oldMask) != oldMask);
+
+    return (ULONG)newMask;
 }
 
-VOID HandleButtonPress(
+VOID BtnDeliverTransition(
     IN PDEVICE_EXTENSION deviceContext,
-    IN BUTTON_TYPE ButtonType)
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN const BTN_TRANSITION* transition,
+    IN ULONGLONG EdgeTime
+)
+/*++
+
+  Routine Description:
+
+    Reports the outcome of an edge, unless the multi-tap recognizer takes
+    it, and updates the state that depends on it. Called for every edge
+    that has passed the chord automaton, and for presses it held back once
+    they are released.
+
+  Arguments:
+
+    deviceContext - Pointer to the device context
+    ButtonType - Line that changed state
+    StateMask - Button mask after the edge
+    transition - Outcome of the edge
+    EdgeTime - Interrupt time of the edge
+
+  Return Value:
+
+    None
+
+--*/
 {
-    if (!deviceContext->ProcessInterrupts)
+    if (!BtnGestureOnTransition(deviceContext, ButtonType, StateMask, transition, EdgeTime))
     {
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Cancelling interrupt processing because we are not done initializing yet.\n");
-        return;
+        for (UCHAR i = 0; i < transition->ReportCount; i++)
+        {
+            SendReport(deviceContext, transition->Reports[i], ButtonType, EdgeTime);
+        }
     }
 
-    switch (ButtonType)
-    {
-    case VolumeUp:
-    {
-        deviceContext->StateVolumeUp = !deviceContext->StateVolumeUp;
-        break;
-    }
-    case VolumeDown:
+    if (transition->PressIgnored)
     {
-        deviceContext->StateVolumeDown = !deviceContext->StateVolumeDown;
-        break;
+        BtnCountEvent(deviceContext, ButtonType, CounterPressesIgnored);
     }
-    case Power:
-    {
-        deviceContext->StatePower = !deviceContext->StatePower;
-        break;
-    }
-    case Camera:
-    {
-        deviceContext->StateCamera = !deviceContext->StateCamera;
-        break;
-    }
-    case CameraFocus:
+
+    deviceContext->IgnoreButtonPresses = transition->IgnoreButtonPresses;
+
+    BtnHoldOnTransition(deviceContext, ButtonType, StateMask, transition);
+}
+
+VOID EvaluateButtonAction(
+    IN PDEVICE_EXTENSION deviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN ULONGLONG EdgeTime
+)
+{
+    //
+    // StateMask is the snapshot returned by the update that triggered this
+    // evaluation, concurrent updates never show up half-way through it.
+    // The combination rules are precompiled by BtnBuildTransitionTable.
+    //
+    const BTN_TRANSITION* transition = BtnLookupTransition(deviceContext, ButtonType, StateMask);
+
+    //
+    // Once a hold has fired, the release belongs to the hold action
+    //
+    if (!BUTTON_PRESSED(StateMask, ButtonType) && deviceContext->Lines[ButtonType].HoldFired)
     {
-        deviceContext->StateCameraFocus = !deviceContext->StateCameraFocus;
-        break;
+        transition = &deviceContext->HoldRelease[ButtonType];
     }
-    case Slider:
+
+    transition = BtnChordOnTransition(deviceContext, ButtonType, StateMask, transition, EdgeTime);
+    if (transition == NULL)
     {
-        deviceContext->StateSlider = !deviceContext->StateSlider;
-        break;
-    }
+        return;
     }
 
-    EvaluateButtonAction(deviceContext, ButtonType);
+    BtnDeliverTransition(deviceContext, ButtonType, StateMask, transition, EdgeTime);
 }
 
-void InterruptPowerWorkItem(
-    WDFINTERRUPT Interrupt,
-    WDFOBJECT AssociatedObject
-)
+VOID HandleButtonPress(
+    IN PDEVICE_EXTENSION deviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime)
 {
-    UNREFERENCED_PARAMETER(Interrupt);
+    ULONG stateMask;
+    BTN_EARLY_EDGE edge;
+    BTN_EARLY_EDGE dropped;
 
-    PDEVICE_EXTENSION devCtx = GetDeviceContext(AssociatedObject);
+    //
+    // Until the device is ready, edges wait in EarlyEdges for
+    // BtnReplayEarlyEdges. Later edges queue up behind them as long as any
+    // are left, so that the order is kept.
+    //
+    if (BtnLifecycleState(deviceContext) != LifecycleReady || deviceContext->EarlyEdges.Count != 0)
+    {
+        edge.Time = EdgeTime;
+        edge.Button = (UCHAR)ButtonType;
+        edge.Pressed = deviceContext->Lines[ButtonType].LogicalPressed;
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Got an interrupt from Power!\n");
+        BtnTraceEvent(deviceContext, BtnEventEdgeHeldUntilReady, ButtonType, edge.Pressed);
 
-    if (devCtx->InitializationOk == 2)
-        HandleButtonPress(devCtx, Power);
-    else
-        devCtx->InitializationOk++;
-}
+        if (BtnEarlyPush(&deviceContext->EarlyEdges, &edge, &dropped))
+        {
+            BtnCountEvent(deviceContext, dropped.Button, CounterPressesIgnored);
+            BtnTraceEvent(deviceContext, BtnEventEarlyEdgeDropped, dropped.Button, (ULONG)((EdgeTime - dropped.Time) / 10000));
+        }
 
-void InterruptVolumeUpWorkItem(
-    WDFINTERRUPT Interrupt,
-    WDFOBJECT AssociatedObject
-)
-{
-    UNREFERENCED_PARAMETER(Interrupt);
+        return;
+    }
 
-    PDEVICE_EXTENSION devCtx = GetDeviceContext(AssociatedObject);
+    stateMask = BtnToggleButtonState(deviceContext, ButtonType);
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Got an interrupt from VolumeUp!\n");
+    BtnTraceEvent(deviceContext, BtnEventButtonState, ButtonType, stateMask);
 
-    if (devCtx->InitializationOk >= 2)
-        HandleButtonPress(devCtx, VolumeUp);
-    else
-        devCtx->InitializationOk++;
+    EvaluateButtonAction(deviceContext, ButtonType, stateMask, EdgeTime);
 }
 
-void InterruptVolumeDownWorkItem(
-    WDFINTERRUPT Interrupt,
-    WDFOBJECT AssociatedObject
+static
+VOID BtnReplayEarlyEdges(
+    IN PDEVICE_EXTENSION deviceContext,
+    IN ULONGLONG Now
 )
-{
-    UNREFERENCED_PARAMETER(Interrupt);
+/*++
 
-    PDEVICE_EXTENSION devCtx = GetDeviceContext(AssociatedObject);
+  Routine Description:
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Got an interrupt from VolumeDown!\n");
+    Evaluates the edges HandleButtonPress held back before the device was
+    ready, oldest first. Edges older than BTN_EARLY_MAX_AGE_MS are dropped,
+    as are those that would not change the reported state. Must run before
+    the line levels are reconciled, which fixes whatever a dropped edge
+    left behind.
 
-    if (devCtx->InitializationOk >= 2)
-        HandleButtonPress(devCtx, VolumeDown);
-    else
-        devCtx->InitializationOk++;
-}
+  Arguments:
 
-void InterruptCameraFocusWorkItem(
-    WDFINTERRUPT Interrupt,
-    WDFOBJECT AssociatedObject
-)
+    deviceContext - Pointer to the device context
+    Now - Current interrupt time
+
+  Return Value:
+
+    None
+
+--*/
 {
-    UNREFERENCED_PARAMETER(Interrupt);
+    BTN_EARLY_EDGE edge;
+    BTN_EARLY_RING ring = deviceContext->EarlyEdges;
+    int result;
 
-    PDEVICE_EXTENSION devCtx = GetDeviceContext(AssociatedObject);
+    //
+    // Work on a copy, HandleButtonPress would queue the edges right back
+    //
+    deviceContext->EarlyEdges.Count = 0;
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Got an interrupt from CameraFocus!\n");
+    while ((result = BtnEarlyPop(&ring, Now, BTN_MS_TO_INTERRUPT_TIME(BTN_EARLY_MAX_AGE_MS), &edge)) != 0)
+    {
+        if (result < 0)
+        {
+            BtnCountEvent(deviceContext, edge.Button, CounterPressesIgnored);
+            BtnTraceEvent(deviceContext, BtnEventEarlyEdgeDropped, edge.Button, (ULONG)((Now - edge.Time) / 10000));
+            continue;
+        }
 
-    if (devCtx->InitializationOk >= 2)
-        HandleButtonPress(devCtx, CameraFocus);
-    else
-        devCtx->InitializationOk++;
+        //
+        // Early edges are debounced and alternate, one that matches the
+        // reported state follows an edge lost in D3 or pushed out of the
+        // ring. Report the missing one first so the press is not lost too.
+        //
+        if ((BOOLEAN)BUTTON_PRESSED(ReadNoFence(&deviceContext->ButtonMask), edge.Button) == edge.Pressed)
+        {
+            BtnTraceEvent(deviceContext, BtnEventEdgeLost, edge.Button, edge.Pressed);
+            HandleButtonPress(deviceContext, (BUTTON_TYPE)edge.Button, edge.Time);
+        }
+
+        HandleButtonPress(deviceContext, (BUTTON_TYPE)edge.Button, edge.Time);
+    }
 }
 
-void InterruptCameraWorkItem(
-    WDFINTERRUPT Interrupt,
-    WDFOBJECT AssociatedObject
+VOID BtnDrainPendingEdges(
+    IN PDEVICE_EXTENSION deviceContext
 )
+/*++
+
+  Routine Description:
+
+    Processes every edge OnInterruptIsr has accounted for since the last
+    drain. Work items for different lines may run concurrently, so only the
+    first caller drains; later callers bump DrainRequests and return, and
+    the owner keeps looping until no further request came in meanwhile.
+
+  Arguments:
+
+    deviceContext - Pointer to the device context
+
+  Return Value:
+
+    None
+
+--*/
 {
-    UNREFERENCED_PARAMETER(Interrupt);
+    LONG pendingMask;
+    LONG drainMask;
+    LONG edges[ButtonCount];
+    ULONG button;
+    ULONGLONG edgeTime[ButtonCount];
+    ULONGLONG latestEdgeTime[ButtonCount];
+    ULONGLONG pickupTime;
+    ULONG pressedMask = 0;
+    BOOLEAN levelsRead;
+
+    if (InterlockedIncrement(&deviceContext->DrainRequests) != 1)
+    {
+        return;
+    }
 
-    PDEVICE_EXTENSION devCtx = GetDeviceContext(AssociatedObject);
+    do
+    {
+        pickupTime = BtnQueryInterruptTime();
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Got an interrupt from Camera!\n");
+        BtnStormMaskLines(deviceContext, pickupTime);
 
-    if (devCtx->InitializationOk >= 2)
-        HandleButtonPress(devCtx, Camera);
-    else
-        devCtx->InitializationOk++;
+        if (InterlockedExchange(&deviceContext->ResyncRequested, FALSE))
+        {
+            BtnReplayEarlyEdges(deviceContext, pickupTime);
+            BtnResyncLines(deviceContext, pickupTime);
+
+            BtnLifecycleRecordPhase(
+                deviceContext,
+                LifecyclePhaseResync,
+                deviceContext->LifecycleTimes[LifecycleReady],
+                BtnQueryInterruptTime());
+        }
+
+        pendingMask = InterlockedExchange(&deviceContext->PendingMask, 0);
+        drainMask = pendingMask;
+
+        //
+        // Take every line's edges before reading the levels, so that the
+        // levels are at least as recent as the edges
+        //
+        while (pendingMask != 0)
+        {
+            BitScanForward(&button, (ULONG)pendingMask);
+            pendingMask &= pendingMask - 1;
+
+            edges[button] = InterlockedExchange(&deviceContext->Lines[button].PendingEdges, 0);
+            edgeTime[button] = ReadNoFence64(&deviceContext->Lines[button].PendingSince);
+            latestEdgeTime[button] = ReadNoFence64(&deviceContext->Lines[button].LatestEdgeTime);
+        }
+
+        //
+        // Edges are only a hint that a line changed, its level has the final
+        // say. One read covers every line however many changed.
+        //
+        levelsRead = drainMask != 0 && NT_SUCCESS(BtnReadLevels(deviceContext, &pressedMask));
+
+        while (drainMask != 0)
+        {
+            BitScanForward(&button, (ULONG)drainMask);
+            drainMask &= drainMask - 1;
+
+            BtnRecordLatency(deviceContext, (BUTTON_TYPE)button, LatencyStageDispatch, edgeTime[button], pickupTime);
+            BtnTraceEvent(deviceContext, BtnEventEdgesDrained, button, (ULONG)edges[button]);
+
+            if (edges[button] > 0)
+            {
+                BtnDebounceEdges(deviceContext, (BUTTON_TYPE)button, (ULONG)edges[button], edgeTime[button], latestEdgeTime[button]);
+            }
+
+            //
+            // The level may disagree with the edges because one was lost
+            // between the ISR and here, or because one arrived between
+            // taking the edges and reading the levels. Only in the first
+            // case is no edge pending now; in the second the next drain,
+            // already requested by the ISR, compares again.
+            //
+            if (edges[button] > 0 && levelsRead && (deviceContext->LevelLines & BUTTON_BIT(button)) &&
+                ReadNoFence(&deviceContext->Lines[button].PendingEdges) == 0)
+            {
+                BtnDebounceLevel(deviceContext, (BUTTON_TYPE)button, BUTTON_PRESSED(pressedMask, button) == ButtonStatePressed);
+            }
+
+            BtnRecordLatency(deviceContext, (BUTTON_TYPE)button, LatencyStageEvaluate, pickupTime, BtnQueryInterruptTime());
+        }
+
+        BtnServiceDeadlines(deviceContext, BtnQueryInterruptTime());
+    } while (InterlockedDecrement(&deviceContext->DrainRequests) != 0);
 }
 
-void InterruptSliderWorkItem(
-    WDFINTERRUPT Interrupt,
-    WDFOBJECT AssociatedObject
-)
-{
-    UNREFERENCED_PARAMETER(Interrupt);
+VOID
+OnInterruptWorkItem(
+    IN WDFINTERRUPT Interrupt,
+    IN WDFOBJECT AssociatedObject
+    )
+/*++
 
+  Routine Description:
+
+    Passive-level work item shared by every button line. The line is
+    identified through the interrupt context, the edges themselves are
+    picked up from the pending counters by BtnDrainPendingEdges.
+
+  Arguments:
+
+    Interrupt - a handle to a framework interrupt object
+    AssociatedObject - the framework device object
+
+  Return Value:
+
+    None
+
+--*/
+{
     PDEVICE_EXTENSION devCtx = GetDeviceContext(AssociatedObject);
+    BUTTON_TYPE button = GetInterruptContext(Interrupt)->Button;
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Got an interrupt from Slider!\n");
+    BtnCountEvent(devCtx, button, CounterWorkItems);
+    BtnTraceEvent(devCtx, BtnEventWorkItem, button, (ULONG)ReadNoFence(&devCtx->DrainRequests));
 
-    if (devCtx->InitializationOk >= 2)
-        HandleButtonPress(devCtx, Slider);
-    else
-        devCtx->InitializationOk++;
+    BtnDrainPendingEdges(devCtx);
 }
 
 BOOLEAN
@@ -382,8 +560,10 @@ OnInterruptIsr(
   Routine Description:
 
     This routine responds to interrupts generated by the
-    controller. If one is recognized, it queues a DPC for 
-    processing. 
+    controller. Every edge is accounted for in the line's pending
+    counter before the work item is queued, so edges that arrive
+    while the work item is already queued are coalesced rather than
+    dropped.
 
     This is a PASSIVE_LEVEL ISR. ACPI should specify
     level-triggered interrupts when using Synaptics 3202.
@@ -400,13 +580,79 @@ OnInterruptIsr(
 
 --*/
 {
+    PDEVICE_EXTENSION devCtx;
+    BUTTON_TYPE button;
+    ULONGLONG edgeTime;
+    ULONGLONG previousEdgeTime;
+    LONG pendingEdges;
+
     UNREFERENCED_PARAMETER(MessageID);
 
-    //DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: EvtInterruptIsr Entry\n");
+    edgeTime = BtnQueryInterruptTime();
+
+    devCtx = GetDeviceContext(WdfInterruptGetDevice(Interrupt));
+    button = GetInterruptContext(Interrupt)->Button;
+
+    BtnCountEvent(devCtx, button, CounterInterrupts);
+
+    //
+    // A line over its budget is only counted until the drain masks it, the
+    // first interrupt over budget brings the drain in
+    //
+    if (!BtnStormAdmit(devCtx, button, edgeTime))
+    {
+        BtnCountEvent(devCtx, button, CounterEdgesThrottled);
+
+        if ((InterlockedOr(&devCtx->StormMask, 1L << button) & (1L << button)) == 0)
+        {
+            BtnTraceEvent(devCtx, BtnEventStorm, button, 0);
+            WdfInterruptQueueWorkItemForIsr(Interrupt);
+        }
+
+        return TRUE;
+    }
+
+    //
+    // The counter must be bumped before the mask bit is published, so a
+    // drain that observes the bit always observes the edge too.
+    //
+    pendingEdges = InterlockedIncrement(&devCtx->Lines[button].PendingEdges);
+    if (pendingEdges == 1)
+    {
+        WriteNoFence64(&devCtx->Lines[button].PendingSince, (LONGLONG)edgeTime);
+    }
+
+    //
+    // Edges of one line are serialized by its passive interrupt lock, so
+    // the previous edge time can be read and replaced without a race
+    //
+    previousEdgeTime = (ULONGLONG)ReadNoFence64(&devCtx->Lines[button].LatestEdgeTime);
+    WriteNoFence64(&devCtx->Lines[button].LatestEdgeTime, (LONGLONG)edgeTime);
+
+    if (previousEdgeTime != 0 && edgeTime > previousEdgeTime)
+    {
+        InterlockedIncrement(&devCtx->Lines[button].IntervalBuckets[BtnDurationBucket(edgeTime - previousEdgeTime)]);
+    }
 
-    WdfInterruptQueueWorkItemForIsr(Interrupt);
+    InterlockedOr(&devCtx->PendingMask, 1L << button);
 
-    //DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: EvtInterruptIsr Exit\n");
+    BtnTraceEvent(devCtx, BtnEventInterrupt, button, (ULONG)pendingEdges);
+
+    //
+    // With HIDCLASS's idle request parked, the edge brings the stack back
+    // out of idle. The interrupt is passive, the request can be completed
+    // from here. A stuck line's edges are ignored, they do not count as
+    // the buttons being in use.
+    //
+    if (ReadNoFence(&devCtx->IdleParked) && !ReadNoFence(&devCtx->Lines[button].Stuck))
+    {
+        BtnWakeFromIdle(devCtx, button);
+    }
+
+    if (!WdfInterruptQueueWorkItemForIsr(Interrupt))
+    {
+        BtnCountEvent(devCtx, button, CounterEdgesCoalesced);
+    }
 
     return TRUE;
 }
@@ -423,36 +669,23 @@ LumiaButtonsGPIOProbeResources(
 
     NTSTATUS status = STATUS_SUCCESS;
 
-    WDF_INTERRUPT_CONFIG interruptConfigPower;
-    WDF_INTERRUPT_CONFIG interruptConfigVolumeUp;
-    WDF_INTERRUPT_CONFIG interruptConfigVolumeDown;
-    WDF_INTERRUPT_CONFIG interruptConfigCameraFocus;
-    WDF_INTERRUPT_CONFIG interruptConfigCamera;
-    WDF_INTERRUPT_CONFIG interruptConfigSlider;
+    WDF_INTERRUPT_CONFIG interruptConfig;
+    WDF_OBJECT_ATTRIBUTES interruptAttributes;
 
     PCM_PARTIAL_RESOURCE_DESCRIPTOR descriptor = NULL;
 
-    DeviceContext->StatePower = ButtonStateUnpressed;
-    DeviceContext->StateVolumeUp = ButtonStateUnpressed;
-    DeviceContext->StateVolumeDown = ButtonStateUnpressed;
-    DeviceContext->StateCameraFocus = ButtonStateUnpressed;
-    DeviceContext->StateCamera = ButtonStateUnpressed;
-    DeviceContext->StateSlider = ButtonStateUnpressed;
+    InterlockedExchange(&DeviceContext->ButtonMask, 0);
 
-    DeviceContext->ProcessInterrupts = FALSE;
+    DeviceContext->LevelConnectionId.QuadPart = 0;
+    DeviceContext->LevelLines = 0;
 
     ULONG interruptFound = 0;
-
-    ULONG InterruptPower = 0;
-    ULONG InterruptVolumeUp = 0;
-    ULONG InterruptVolumeDown = 0;
-    ULONG InterruptCameraFocus = 0;
-    ULONG InterruptCamera = 0;
-    ULONG InterruptSlider = 0;
+    ULONG interruptIndex[ButtonCount] = { 0 };
+    ULONG connectionFound = 0;
 
     ULONG resourceCount;
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: LumiaButtonsGPIOProbeResources Entry\n");
+    Trace(TRACE_LEVEL_VERBOSE, TRACE_INIT, "Entry");
 
     resourceCount = WdfCmResourceListGetCount(ResourcesTranslated);
 
@@ -465,187 +698,99 @@ LumiaButtonsGPIOProbeResources(
         case CmResourceTypeInterrupt:
             // We've found an interrupt resource.
 
-            switch (interruptFound)
+            if (interruptFound < ButtonCount)
             {
-            case 0:
-                InterruptPower = i;
-                break;
-            case 1:
-                InterruptVolumeUp = i;
-                break;
-            case 2:
-                InterruptVolumeDown = i;
-                break;
-            case 3:
-                InterruptCameraFocus = i;
-                break;
-            case 4:
-                InterruptCamera = i;
-                break;
-            case 5:
-                InterruptSlider = i;
-                break;
-            default:
-                break;
+                interruptIndex[interruptFound] = i;
             }
 
-            DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Found Interrupt resource id=%lu index=%lu\n", interruptFound, i);
+            Trace(TRACE_LEVEL_INFORMATION, TRACE_INIT, "Found Interrupt resource id=%lu index=%lu", interruptFound, i);
 
             interruptFound++;
             break;
 
+        case CmResourceTypeConnection:
+            //
+            // The first GPIO IO connection lists the pins of the lines in
+            // the same order as the interrupts, so that a single read
+            // returns every level
+            //
+            if (descriptor->u.Connection.Class != CM_RESOURCE_CONNECTION_CLASS_GPIO ||
+                descriptor->u.Connection.Type != CM_RESOURCE_CONNECTION_TYPE_GPIO_IO)
+            {
+                break;
+            }
+
+            if (connectionFound == 0)
+            {
+                DeviceContext->LevelConnectionId.LowPart = descriptor->u.Connection.IdLowPart;
+                DeviceContext->LevelConnectionId.HighPart = descriptor->u.Connection.IdHighPart;
+            }
+
+            Trace(TRACE_LEVEL_INFORMATION, TRACE_INIT, "Found GPIO IO resource id=%lu index=%lu", connectionFound, i);
+
+            connectionFound++;
+            break;
+
         default:
             // We don't care about other descriptors.
             break;
         }
     }
 
-    if (interruptFound < 3)
+    //
+    // Power, VolumeUp and VolumeDown are mandatory
+    //
+    if (interruptFound < gButtonDescriptors[Power].MinimumInterrupts)
     {
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Not all resources were found, Interrupts = %d\n", interruptFound);
+        Trace(TRACE_LEVEL_ERROR, TRACE_INIT, "Not all resources were found, Interrupts = %lu", interruptFound);
         status = STATUS_INSUFFICIENT_RESOURCES;
         goto Exit;
     }
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Beginning to create interrupts\n");
-
-    WDF_INTERRUPT_CONFIG_INIT(&interruptConfigPower, OnInterruptIsr, NULL);
-
-    interruptConfigPower.PassiveHandling = TRUE;
-    interruptConfigPower.InterruptTranslated = WdfCmResourceListGetDescriptor(ResourcesTranslated, InterruptPower);
-    interruptConfigPower.InterruptRaw = WdfCmResourceListGetDescriptor(ResourcesRaw, InterruptPower);
-
-    interruptConfigPower.EvtInterruptWorkItem = InterruptPowerWorkItem;
-
-    status = WdfInterruptCreate(
-        DeviceContext->FxDevice,
-        &interruptConfigPower,
-        WDF_NO_OBJECT_ATTRIBUTES,
-        &DeviceContext->InterruptPower);
-    if (!NT_SUCCESS(status))
-    {
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: WdfInterruptCreate failed for Power %x\n", status);
-        goto Exit;
-    }
-
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Created Interrupt\n");
-
-    WDF_INTERRUPT_CONFIG_INIT(&interruptConfigVolumeUp, OnInterruptIsr, NULL);
+    Trace(TRACE_LEVEL_VERBOSE, TRACE_INIT, "Beginning to create interrupts");
 
-    interruptConfigVolumeUp.PassiveHandling = TRUE;
-    interruptConfigVolumeUp.InterruptTranslated = WdfCmResourceListGetDescriptor(ResourcesTranslated, InterruptVolumeUp);
-    interruptConfigVolumeUp.InterruptRaw = WdfCmResourceListGetDescriptor(ResourcesRaw, InterruptVolumeUp);
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&interruptAttributes, INTERRUPT_CONTEXT);
 
-    interruptConfigVolumeUp.EvtInterruptWorkItem = InterruptVolumeUpWorkItem;
-
-    status = WdfInterruptCreate(
-        DeviceContext->FxDevice,
-        &interruptConfigVolumeUp,
-        WDF_NO_OBJECT_ATTRIBUTES,
-        &DeviceContext->InterruptVolumeUp);
-    if (!NT_SUCCESS(status))
+    for (ULONG button = 0; button < ButtonCount; button++)
     {
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: WdfInterruptCreate failed for VolumeUp %x\n", status);
-        goto Exit;
-    }
-
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Created Interrupt\n");
-
-    WDF_INTERRUPT_CONFIG_INIT(&interruptConfigVolumeDown, OnInterruptIsr, NULL);
+        PBUTTON_LINE line = &DeviceContext->Lines[button];
 
-    interruptConfigVolumeDown.PassiveHandling = TRUE;
-    interruptConfigVolumeDown.InterruptTranslated = WdfCmResourceListGetDescriptor(ResourcesTranslated, InterruptVolumeDown);
-    interruptConfigVolumeDown.InterruptRaw = WdfCmResourceListGetDescriptor(ResourcesRaw, InterruptVolumeDown);
-
-    interruptConfigVolumeDown.EvtInterruptWorkItem = InterruptVolumeDownWorkItem;
-
-    status = WdfInterruptCreate(
-        DeviceContext->FxDevice,
-        &interruptConfigVolumeDown,
-        WDF_NO_OBJECT_ATTRIBUTES,
-        &DeviceContext->InterruptVolumeDown);
-    if (!NT_SUCCESS(status))
-    {
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: WdfInterruptCreate failed for VolumeDown %x\n", status);
-        goto Exit;
-    }
-
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Created Interrupt\n");
-
-    if (interruptFound >= 5)
-    {
-        WDF_INTERRUPT_CONFIG_INIT(&interruptConfigCameraFocus, OnInterruptIsr, NULL);
-
-        interruptConfigCameraFocus.PassiveHandling = TRUE;
-        interruptConfigCameraFocus.InterruptTranslated = WdfCmResourceListGetDescriptor(ResourcesTranslated, InterruptCameraFocus);
-        interruptConfigCameraFocus.InterruptRaw = WdfCmResourceListGetDescriptor(ResourcesRaw, InterruptCameraFocus);
-
-        interruptConfigCameraFocus.EvtInterruptWorkItem = InterruptCameraFocusWorkItem;
-
-        status = WdfInterruptCreate(
-            DeviceContext->FxDevice,
-            &interruptConfigCameraFocus,
-            WDF_NO_OBJECT_ATTRIBUTES,
-            &DeviceContext->InterruptCameraFocus);
-        if (!NT_SUCCESS(status))
+        if (interruptFound < gButtonDescriptors[button].MinimumInterrupts)
         {
-            DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: WdfInterruptCreate failed for CameraFocus %x\n", status);
-            goto Exit;
+            continue;
         }
 
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Created Interrupt\n");
-
-        WDF_INTERRUPT_CONFIG_INIT(&interruptConfigCamera, OnInterruptIsr, NULL);
+        WDF_INTERRUPT_CONFIG_INIT(&interruptConfig, OnInterruptIsr, NULL);
 
-        interruptConfigCamera.PassiveHandling = TRUE;
-        interruptConfigCamera.InterruptTranslated = WdfCmResourceListGetDescriptor(ResourcesTranslated, InterruptCamera);
-        interruptConfigCamera.InterruptRaw = WdfCmResourceListGetDescriptor(ResourcesRaw, InterruptCamera);
+        interruptConfig.PassiveHandling = TRUE;
+        interruptConfig.InterruptTranslated = WdfCmResourceListGetDescriptor(ResourcesTranslated, interruptIndex[button]);
+        interruptConfig.InterruptRaw = WdfCmResourceListGetDescriptor(ResourcesRaw, interruptIndex[button]);
 
-        interruptConfigCamera.EvtInterruptWorkItem = InterruptCameraWorkItem;
+        interruptConfig.EvtInterruptWorkItem = OnInterruptWorkItem;
 
         status = WdfInterruptCreate(
             DeviceContext->FxDevice,
-            &interruptConfigCamera,
-            WDF_NO_OBJECT_ATTRIBUTES,
-            &DeviceContext->InterruptCamera);
+            &interruptConfig,
+            &interruptAttributes,
+            &line->Interrupt);
         if (!NT_SUCCESS(status))
         {
-            DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: WdfInterruptCreate failed for Camera %x\n", status);
+            Trace(TRACE_LEVEL_ERROR, TRACE_INIT, "WdfInterruptCreate failed for %s - 0x%08X", gButtonDescriptors[button].Name, status);
             goto Exit;
         }
 
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Created Interrupt\n");
+        GetInterruptContext(line->Interrupt)->Button = (BUTTON_TYPE)button;
 
-        if (interruptFound >= 6)
+        if (connectionFound != 0)
         {
-
-            WDF_INTERRUPT_CONFIG_INIT(&interruptConfigSlider, OnInterruptIsr, NULL);
-
-            interruptConfigSlider.PassiveHandling = TRUE;
-            interruptConfigSlider.InterruptTranslated = WdfCmResourceListGetDescriptor(ResourcesTranslated, InterruptSlider);
-            interruptConfigSlider.InterruptRaw = WdfCmResourceListGetDescriptor(ResourcesRaw, InterruptSlider);
-
-            interruptConfigSlider.EvtInterruptWorkItem = InterruptSliderWorkItem;
-
-            status = WdfInterruptCreate(
-                DeviceContext->FxDevice,
-                &interruptConfigSlider,
-                WDF_NO_OBJECT_ATTRIBUTES,
-                &DeviceContext->InterruptSlider);
-            if (!NT_SUCCESS(status))
-            {
-                DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: WdfInterruptCreate failed for Slider %x\n", status);
-                goto Exit;
-            }
-
-            DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: Created Interrupt\n");
-
+            DeviceContext->LevelLines |= BUTTON_BIT(button);
         }
+
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_INIT, "Created Interrupt for %s", gButtonDescriptors[button].Name);
     }
-    
 
 Exit:
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: LumiaButtonsGPIOProbeResources Exit: %x\n", status);
+    Trace(TRACE_LEVEL_VERBOSE, TRACE_INIT, "Exit - 0x%08X", status);
 
     return status;
 }
@@ -678,18 +823,23 @@ Return Value:
     devContext = GetDeviceContext(Device);
 
     UNREFERENCED_PARAMETER(PreviousState);
-    
+
+    BtnLifecycleEnter(devContext, LifecyclePoweringUp);
+
     //
-    // N.B. This RMI chip's IRQ is level-triggered, but cannot be enabled in
-    //      ACPI until passive-level interrupt handling is added to the driver.
-    //      Service chip in case we missed an edge during D3 or boot-up.
+    // Edges missed in D3 or during the transition are reconciled from the
+    // line levels once interrupts are enabled, see
+    // OnD0EntryPostInterruptsEnabled
     //
-    devContext->ServiceInterruptsAfterD0Entry = TRUE;
 
     //
-    // Complete any pending Idle IRPs
+    // Complete any pending Idle IRPs. The stack came out of idle through
+    // something else than a button.
     //
-    BtnCompleteIdleIrp(devContext);
+    if (BtnCompleteIdleIrp(devContext))
+    {
+        InterlockedExchange(&devContext->WakeMask, 0);
+    }
 
     return status;
 }
@@ -726,6 +876,31 @@ Return Value:
     
     UNREFERENCED_PARAMETER(TargetState);    
 
+    //
+    // Edges from here until the next D0 entry has finished are held back
+    //
+    BtnLifecycleEnter(devContext, LifecyclePoweredDown);
+
+    //
+    // Pending deadlines are moot once the lines are disconnected. Presses
+    // held back for a chord or a tap pattern are reported on their own
+    // first: the levels read at the next D0 entry are compared with what
+    // ButtonMask says was reported, which includes them.
+    //
+    WdfTimerStop(devContext->DeadlineTimer, TRUE);
+    WriteNoFence(&devContext->DeadlineArmed, FALSE);
+
+    BtnChordReset(devContext);
+    BtnGestureReset(devContext, BtnQueryInterruptTime());
+    BtnStormReset(devContext);
+
+    RtlZeroMemory(devContext->Deadlines, sizeof(devContext->Deadlines));
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        devContext->Lines[button].HoldFired = FALSE;
+    }
+
     return status;
 }
     
@@ -775,17 +950,46 @@ OnPrepareHardware(
         goto exit;
     }
 
+    status = BtnLoadActionMap(devContext);
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    BtnBuildTransitionTable(devContext);
+
+    status = BtnLoadDebounceConfig(devContext);
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = BtnLoadGestureConfig(devContext);
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = BtnLoadStuckConfig(devContext);
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = BtnOpenLevelTarget(devContext);
     if (!NT_SUCCESS(status))
     {
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_INIT,
-            "Error finding CmResourceTypeConnection resource - %!STATUS!",
+            "Error finding CmResourceTypeConnection resource - 0x%08X",
             status);
 
         goto exit;
     }
 
+    BtnLifecycleEnter(devContext, LifecyclePrepared);
+
 exit:
 
     return status;
@@ -817,11 +1021,14 @@ OnReleaseHardware(
 --*/
 {
     NTSTATUS status = STATUS_SUCCESS;
-    //PDEVICE_EXTENSION devContext;
+    PDEVICE_EXTENSION devContext;
 
     UNREFERENCED_PARAMETER(FxResourcesTranslated);
-    UNREFERENCED_PARAMETER(FxDevice);
-    //devContext = GetDeviceContext(FxDevice);
+    devContext = GetDeviceContext(FxDevice);
+
+    BtnCloseLevelTarget(devContext);
+
+    BtnLifecycleEnter(devContext, LifecycleReleased);
 
     return status;
 }
@@ -834,13 +1041,21 @@ NTSTATUS OnD0EntryPostInterruptsEnabled
 {
     UNREFERENCED_PARAMETER(PreviousState);
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: OnD0EntryPostInterruptsEnabled Entry\n");
+    Trace(TRACE_LEVEL_VERBOSE, TRACE_FLAG_POWER, "Entry");
 
     PDEVICE_EXTENSION DeviceContext = GetDeviceContext(Device);
 
-    DeviceContext->ProcessInterrupts = TRUE;
+    BtnLifecycleEnter(DeviceContext, LifecycleReady);
+
+    //
+    // Interrupts are enabled, any change from here on raises an edge. Read
+    // where every line stands now and report only what differs from the
+    // state reported before the device left D0, within a single drain.
+    //
+    InterlockedExchange(&DeviceContext->ResyncRequested, TRUE);
+    BtnDrainPendingEdges(DeviceContext);
 
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "LumiaButtonsGPIO: OnD0EntryPostInterruptsEnabled Exit\n");
+    Trace(TRACE_LEVEL_VERBOSE, TRACE_FLAG_POWER, "Exit");
 
     return 0;
 }
\ No newline at end of file
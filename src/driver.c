@@ -3,6 +3,8 @@
 #include <device.h>
 #include <hid.h>
 #include <queue.h>
+#include <idle.h>
+#include <deadline.h>
 #include <trace.h>
 
 #ifdef ALLOC_PRAGMA
@@ -36,6 +38,7 @@ Return Value:
 {
     WDF_OBJECT_ATTRIBUTES attributes;
     WDF_DRIVER_CONFIG config;
+    WDFDRIVER driver;
     NTSTATUS status;
 
     //
@@ -57,7 +60,7 @@ Return Value:
         RegistryPath,
         &attributes,
         &config,
-        WDF_NO_HANDLE
+        &driver
         );
 
     if (!NT_SUCCESS(status)) 
@@ -65,7 +68,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_INIT,
-            "Error creating WDF driver object - %!STATUS!",
+            "Error creating WDF driver object - 0x%08X",
             status);
 
         //WPP_CLEANUP(DriverObject);
@@ -73,6 +76,8 @@ Return Value:
         goto exit;
     }
 
+    TraceInitialize(driver);
+
 exit:
 
     return status;
@@ -108,6 +113,7 @@ Return Value:
     WDFDEVICE fxDevice;
     WDF_PNPPOWER_EVENT_CALLBACKS pnpPowerCallbacks;
     WDF_IO_QUEUE_CONFIG queueConfig;
+    WDF_TIMER_CONFIG timerConfig;
     NTSTATUS status;
     
     UNREFERENCED_PARAMETER(Driver);
@@ -149,7 +155,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_INIT,
-            "WdfDeviceCreate failed - %!STATUS!",
+            "WdfDeviceCreate failed - 0x%08X",
             status);
 
         goto exit;
@@ -157,6 +163,50 @@ Return Value:
 
     devContext = GetDeviceContext(fxDevice);
     devContext->FxDevice = fxDevice;
+
+    //
+    // Create the lock serializing report delivery against HID read requests
+    //
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = fxDevice;
+
+    status = WdfSpinLockCreate(&attributes, &devContext->ReportLock);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error creating report lock - 0x%08X",
+            status);
+
+        goto exit;
+    }
+
+    //
+    // Create the timer servicing debounce deadlines. It runs at passive
+    // level so that its callback can drain pending edges directly.
+    //
+    WDF_TIMER_CONFIG_INIT(&timerConfig, OnDeadlineTimer);
+    timerConfig.AutomaticSerialization = FALSE;
+    timerConfig.TolerableDelay = BTN_DEADLINE_TOLERABLE_DELAY_MS;
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = fxDevice;
+    attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+    status = WdfTimerCreate(&timerConfig, &attributes, &devContext->DeadlineTimer);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error creating deadline timer - 0x%08X",
+            status);
+
+        goto exit;
+    }
   
     //
     // Create a parallel dispaBtn queue to handle requests from HID Class
@@ -180,7 +230,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_INIT,
-            "Error creating WDF default queue - %!STATUS!",
+            "Error creating WDF default queue - 0x%08X",
             status);
 
         goto exit;
@@ -206,7 +256,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_INIT,
-            "Error creating WDF read request queue - %!STATUS!",
+            "Error creating WDF read request queue - 0x%08X",
             status);
 
         goto exit;
@@ -234,12 +284,19 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_INIT,
-            "Error creating WDF idle request queue - %!STATUS!", 
+            "Error creating WDF idle request queue - 0x%08X", 
             status);
 
         goto exit;
     }
 
+    status = BtnCreateIdleWorkItem(devContext);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
 exit:
 
     return status;
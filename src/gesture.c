@@ -0,0 +1,374 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <device.h>
+#include <deadline.h>
+#include <gesture.h>
+#include <hold.h>
+#include <eventlog.h>
+#include <trace.h>
+
+#ifdef ALLOC_PRAGMA
+  #pragma alloc_text(PAGE, BtnLoadGestureConfig)
+#endif
+
+C_ASSERT(BTN_GESTURE_MAX_WINDOW_MS < BTN_REPEAT_DELAY_MS);
+C_ASSERT(BTN_GESTURE_MAX_WINDOW_MS < BTN_HOLD_DELAY_MS);
+C_ASSERT(BTN_GESTURE_RING_SIZE >= 2 * BTN_GESTURE_MAX_TAPS - 1);
+
+NTSTATUS
+BtnLoadGestureConfig(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    Enables the multi-tap recognizer on every line with a double or triple
+    tap action and reads the tap window, MultiTapWindowMs, from the device's
+    hardware registry key. Values that are absent or above
+    BTN_GESTURE_MAX_WINDOW_MS keep the default, 0 disables multi-tap
+    actions. Must run after BtnLoadActionMap.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+    WDFKEY key = NULL;
+    ULONG value;
+    ULONG windowMs = BTN_GESTURE_DEFAULT_WINDOW_MS;
+    DECLARE_CONST_UNICODE_STRING(windowValueName, L"MultiTapWindowMs");
+
+    PAGED_CODE();
+
+    status = WdfDeviceOpenRegistryKey(
+        DeviceContext->FxDevice,
+        PLUGPLAY_REGISTRY_DEVICE,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &key);
+
+    if (NT_SUCCESS(status))
+    {
+        if (NT_SUCCESS(WdfRegistryQueryULong(key, &windowValueName, &value)))
+        {
+            if (value <= BTN_GESTURE_MAX_WINDOW_MS)
+            {
+                windowMs = value;
+            }
+            else
+            {
+                Trace(
+                    TRACE_LEVEL_ERROR,
+                    TRACE_INIT,
+                    "Ignoring invalid tap window MultiTapWindowMs=%lu",
+                    value);
+            }
+        }
+
+        WdfRegistryClose(key);
+    }
+
+    DeviceContext->MultiTapWindow = BTN_MS_TO_INTERRUPT_TIME(windowMs);
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        PBUTTON_LINE line = &DeviceContext->Lines[button];
+
+        RtlZeroMemory(&line->Tap, sizeof(BTN_TAP_STATE));
+        line->DeferredCount = 0;
+
+        if (windowMs == 0)
+        {
+            continue;
+        }
+
+        for (ULONG taps = 2; taps <= BTN_GESTURE_MAX_TAPS; taps++)
+        {
+            if (DeviceContext->Actions[BTN_TAP_SLOT(button, taps)].Mode != ActionModeNone)
+            {
+                line->Tap.TapMask |= (UCHAR)(1 << taps);
+            }
+        }
+
+        if (line->Tap.TapMask != 0)
+        {
+            Trace(
+                TRACE_LEVEL_INFORMATION,
+                TRACE_INIT,
+                "%s: multi-tap actions 0x%02X, window %lu ms",
+                gButtonDescriptors[button].Name,
+                line->Tap.TapMask,
+                windowMs);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+BtnSendGesture(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN const BTN_TRANSITION* Transition,
+    IN ULONGLONG EdgeTime
+    )
+{
+    for (UCHAR i = 0; i < Transition->ReportCount; i++)
+    {
+        SendReport(DeviceContext, Transition->Reports[i], ButtonType, EdgeTime);
+    }
+}
+
+static
+VOID
+BtnGestureEnd(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN BOOLEAN Pressed,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Ends the tap pattern in progress on a line: fires the action for the
+    taps counted, or reports the held back edges as they would have been
+    reported without a recognizer, with their original timestamps.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line whose pattern ran out of time
+    Pressed - Whether the button is held at the end of the pattern
+    Now - Interrupt time the pattern ended at
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    unsigned long taps;
+
+    BtnClearDeadline(DeviceContext, ButtonType, DeadlineGesture);
+
+    switch (BtnTapOnDeadline(&line->Tap, Pressed, &taps))
+    {
+    case BtnTapFire:
+        BtnTraceEvent(DeviceContext, BtnEventGesture, ButtonType, taps);
+
+        BtnSendGesture(DeviceContext, ButtonType, &DeviceContext->GesturePress[ButtonType][taps - 2], Now);
+
+        if (!Pressed)
+        {
+            BtnSendGesture(DeviceContext, ButtonType, &DeviceContext->GestureRelease[ButtonType][taps - 2], Now);
+        }
+        break;
+
+    case BtnTapReplay:
+        BtnTraceEvent(DeviceContext, BtnEventGestureReplayed, ButtonType, line->DeferredCount);
+
+        for (ULONG i = 0; i < line->DeferredCount; i++)
+        {
+            BtnSendGesture(DeviceContext, ButtonType, line->Deferred[i].Transition, line->Deferred[i].EdgeTime);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    line->DeferredCount = 0;
+}
+
+static
+VOID
+BtnGestureCancel(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG EdgeTime
+    )
+{
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        PBUTTON_LINE line = &DeviceContext->Lines[button];
+        unsigned long taps;
+
+        if (line->Tap.Active &&
+            BtnTapOnEdge(&line->Tap, FALSE, EdgeTime, DeviceContext->MultiTapWindow, &taps) == BtnTapRelease)
+        {
+            //
+            // Let go of the gesture's keys, the button itself is still down
+            // and its release is reported as usual
+            //
+            BtnSendGesture(DeviceContext, (BUTTON_TYPE)button, &DeviceContext->GestureRelease[button][taps - 2], EdgeTime);
+        }
+
+        line->Tap.Taps = 0;
+        line->Tap.Deadline = 0;
+        line->DeferredCount = 0;
+
+        BtnClearDeadline(DeviceContext, (BUTTON_TYPE)button, DeadlineGesture);
+    }
+}
+
+BOOLEAN
+BtnGestureOnTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN const BTN_TRANSITION* Transition,
+    IN ULONGLONG EdgeTime
+    )
+/*++
+
+Routine Description:
+
+    Runs an evaluated edge through the line's multi-tap recognizer, see
+    btngesture.h. Chords take precedence: once a transition starts ignoring
+    button presses, every pattern in progress is dropped.
+
+    Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line that changed state
+    StateMask - Button mask after the edge
+    Transition - Outcome the edge was evaluated to
+    EdgeTime - Interrupt time of the edge
+
+Return Value:
+
+    TRUE if the recognizer took the edge, FALSE if the caller reports the
+    transition itself
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    BOOLEAN pressed = BUTTON_PRESSED(StateMask, ButtonType) ? TRUE : FALSE;
+    unsigned long taps;
+
+    if (DeviceContext->IgnoreButtonPresses || Transition->IgnoreButtonPresses)
+    {
+        BtnGestureCancel(DeviceContext, EdgeTime);
+        return FALSE;
+    }
+
+    //
+    // A pattern that ran out before this edge ends first, its deadline may
+    // just not have been serviced yet
+    //
+    if (line->Tap.Deadline != 0 && EdgeTime >= line->Tap.Deadline)
+    {
+        BtnGestureEnd(DeviceContext, ButtonType, !pressed, line->Tap.Deadline);
+    }
+
+    switch (BtnTapOnEdge(&line->Tap, pressed, EdgeTime, DeviceContext->MultiTapWindow, &taps))
+    {
+    case BtnTapDefer:
+        NT_ASSERT(line->DeferredCount < BTN_GESTURE_RING_SIZE);
+
+        line->Deferred[line->DeferredCount].Transition = Transition;
+        line->Deferred[line->DeferredCount].EdgeTime = EdgeTime;
+        line->Deferred[line->DeferredCount].Button = ButtonType;
+        line->Deferred[line->DeferredCount].StateMask = StateMask;
+        line->DeferredCount++;
+
+        BtnSetDeadline(DeviceContext, ButtonType, DeadlineGesture, line->Tap.Deadline);
+        return TRUE;
+
+    case BtnTapFire:
+        line->DeferredCount = 0;
+        BtnClearDeadline(DeviceContext, ButtonType, DeadlineGesture);
+
+        BtnTraceEvent(DeviceContext, BtnEventGesture, ButtonType, taps);
+
+        BtnSendGesture(DeviceContext, ButtonType, &DeviceContext->GesturePress[ButtonType][taps - 2], EdgeTime);
+        return TRUE;
+
+    case BtnTapRelease:
+        BtnSendGesture(DeviceContext, ButtonType, &DeviceContext->GestureRelease[ButtonType][taps - 2], EdgeTime);
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+VOID
+BtnGestureExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Gesture deadline of the deadline wheel, the line's tap pattern has run
+    out of time.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line whose pattern ran out of time
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    BtnGestureEnd(
+        DeviceContext,
+        ButtonType,
+        BUTTON_PRESSED(ReadNoFence(&DeviceContext->ButtonMask), ButtonType) ? TRUE : FALSE,
+        Now);
+}
+
+VOID
+BtnGestureReset(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Now
+    )
+{
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        PBUTTON_LINE line = &DeviceContext->Lines[button];
+
+        //
+        // A pattern in progress ends now, as if its window had run out
+        //
+        if (line->Tap.Deadline != 0)
+        {
+            BtnGestureExpired(DeviceContext, (BUTTON_TYPE)button, Now);
+        }
+    }
+
+    //
+    // Lets go of the keys of a gesture whose button is still held
+    //
+    BtnGestureCancel(DeviceContext, Now);
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        PBUTTON_LINE line = &DeviceContext->Lines[button];
+
+        line->Tap.Deadline = 0;
+        line->Tap.Taps = 0;
+        line->Tap.Active = 0;
+        line->DeferredCount = 0;
+    }
+}
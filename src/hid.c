@@ -2,7 +2,9 @@
 // Copyright (c) Bingxing Wang. All Rights Reserved. 
 
 #include <internal.h>
+#include <device.h>
 #include <hid.h>
+#include <lifecycle.h>
 #include <trace.h>
 
 //
@@ -32,10 +34,10 @@ const HID_DESCRIPTOR gHidDescriptor =
     HID_REVISION,                       //bcdHID
     0,                                  //bCountry - not localized
     1,                                  //bNumDescriptors
-    {                                   //DescriptorList[0]
+    {{                                  //DescriptorList[0]
         HID_REPORT_DESCRIPTOR_TYPE,     //bReportType
         sizeof(gReportDescriptor)       //wReportLength
-    }
+    }}
 };
 
 NTSTATUS
@@ -48,7 +50,8 @@ BtnReadReport(
 
 Routine Description:
 
-   Handles read requests from HIDCLASS, by forwarding the request.
+   Handles read requests from HIDCLASS, either by completing the request
+   with the oldest parked report or by forwarding it to PingPongQueue.
 
 Arguments:
 
@@ -67,19 +70,45 @@ Return Value:
 {
     PDEVICE_EXTENSION devContext;
     NTSTATUS status;
+    BTN_PENDING_REPORT report;
+    BOOLEAN reportPending = FALSE;
     
     devContext = GetDeviceContext(Device);
-    
-    status = WdfRequestForwardToIoQueue(
-            Request,
-            devContext->PingPongQueue);
+
+    //
+    // Complete the read straight away if SendReport parked a report while
+    // no read was pending, otherwise park the read for SendReport.
+    //
+    WdfSpinLockAcquire(devContext->ReportLock);
+
+    if (devContext->PendingReportCount != 0)
+    {
+        report = devContext->PendingReports[devContext->PendingReportHead];
+        devContext->PendingReportHead = (devContext->PendingReportHead + 1) & (BTN_REPORT_RING_SIZE - 1);
+        devContext->PendingReportCount--;
+        reportPending = TRUE;
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        status = WdfRequestForwardToIoQueue(
+                Request,
+                devContext->PingPongQueue);
+    }
+
+    WdfSpinLockRelease(devContext->ReportLock);
+
+    if (reportPending)
+    {
+        BtnCompleteReadRequest(devContext, Request, &report);
+    }
     
     if (!NT_SUCCESS(status))
     {
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Failed to forward HID request to I/O queue - %!STATUS!",
+            "Failed to forward HID request to I/O queue - 0x%08X",
             status);
 
         goto exit;
@@ -89,28 +118,6 @@ Return Value:
     {
         *Pending = TRUE;
     }
-
-    //
-    // Service any interrupt that may have asserted while the framework had
-    // interrupts disabled, or occurred before a read request was queued.
-    //
-    if (devContext->ServiceInterruptsAfterD0Entry == TRUE)
-    {
-		/*BTN_REPORT BTNReport;
-        BOOLEAN servicingComplete = FALSE;
-
-        while (servicingComplete == FALSE)
-        {
-            BtnServiceInterrupts(
-                devContext->TouchContext,
-                &devContext->I2CContext,
-                &BTNReport,
-                devContext->InputMode,
-                &servicingComplete);
-        }*/
-
-        devContext->ServiceInterruptsAfterD0Entry = FALSE;
-    }
     
 exit:
 
@@ -192,7 +199,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Error getting device string - %!STATUS!",
+            "Error getting device string - 0x%08X",
             status);
     }
     
@@ -244,7 +251,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Error getting HID descriptor request memory - %!STATUS!",
+            "Error getting HID descriptor request memory - 0x%08X",
             status);
         goto exit;
     }
@@ -263,7 +270,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Error copying HID descriptor to request memory - %!STATUS!",
+            "Error copying HID descriptor to request memory - 0x%08X",
             status);
         goto exit;
     }
@@ -326,7 +333,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Error getting HID report descriptor request memory - %!STATUS!",
+            "Error getting HID report descriptor request memory - 0x%08X",
             status);
         goto exit;
     }
@@ -345,7 +352,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Error copying HID report descriptor to request memory - %!STATUS!",
+            "Error copying HID report descriptor to request memory - 0x%08X",
             status);
         goto exit;
     }
@@ -395,7 +402,7 @@ Return Value:
     status = WdfRequestRetrieveOutputBuffer(
         Request,
         sizeof (HID_DEVICE_ATTRIBUTES),
-        &deviceAttributes,
+        (PVOID*)&deviceAttributes,
         NULL);
 
     if (!NT_SUCCESS(status)) 
@@ -403,7 +410,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Error retrieving device attribute output buffer - %!STATUS!",
+            "Error retrieving device attribute output buffer - 0x%08X",
             status);
         goto exit;
     }
@@ -482,12 +489,27 @@ Return Value:
 
     switch (*(PUCHAR)featurePacket->reportBuffer)
     {
+        case REPORTID_COUNTERS:
+        {
+            //
+            // Any SET of the counters report resets them, the payload is ignored
+            //
+            for (ULONG button = 0; button < ButtonCount; button++)
+            {
+                for (ULONG counter = 0; counter < CounterCount; counter++)
+                {
+                    InterlockedExchange(&devContext->Counters[button][counter], 0);
+                }
+            }
+            break;
+        }
+
         default:
         {
 			Trace(
 				TRACE_LEVEL_INFORMATION,
 				TRACE_DRIVER,
-				"%!FUNC! Unsupported type %d is requested",
+				"Unsupported type %d is requested",
 				featurePacket->reportId
 			);
 
@@ -561,12 +583,201 @@ Return Value:
 
     switch (*(PUCHAR)featurePacket->reportBuffer)
     {
+        case REPORTID_LATENCY:
+        {
+            PBTN_LATENCY_FEATURE_REPORT latencyReport;
+
+            if (featurePacket->reportBufferLen < sizeof(BTN_LATENCY_FEATURE_REPORT))
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                goto exit;
+            }
+
+            latencyReport = (PBTN_LATENCY_FEATURE_REPORT)featurePacket->reportBuffer;
+
+            //
+            // Buckets are bumped without a lock, a snapshot may be torn across
+            // buckets but each bucket is read whole
+            //
+            for (ULONG button = 0; button < ButtonCount; button++)
+            {
+                for (ULONG stage = 0; stage < LatencyStageCount; stage++)
+                {
+                    for (ULONG bucket = 0; bucket < BTN_LATENCY_BUCKETS; bucket++)
+                    {
+                        latencyReport->Buckets[button][stage][bucket] =
+                            (ULONG)ReadNoFence(&devContext->LatencyBuckets[button][stage][bucket]);
+                    }
+                }
+            }
+
+            WdfRequestSetInformation(Request, sizeof(BTN_LATENCY_FEATURE_REPORT));
+            break;
+        }
+
+        case REPORTID_COUNTERS:
+        {
+            PBTN_COUNTERS_FEATURE_REPORT countersReport;
+
+            if (featurePacket->reportBufferLen < sizeof(BTN_COUNTERS_FEATURE_REPORT))
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                goto exit;
+            }
+
+            countersReport = (PBTN_COUNTERS_FEATURE_REPORT)featurePacket->reportBuffer;
+
+            for (ULONG button = 0; button < ButtonCount; button++)
+            {
+                for (ULONG counter = 0; counter < CounterCount; counter++)
+                {
+                    countersReport->Counters[button][counter] =
+                        (ULONG)ReadNoFence(&devContext->Counters[button][counter]);
+                }
+            }
+
+            WdfRequestSetInformation(Request, sizeof(BTN_COUNTERS_FEATURE_REPORT));
+            break;
+        }
+
+        case REPORTID_TRACE:
+        {
+            PBTN_TRACE_FEATURE_REPORT traceReport;
+
+            if (featurePacket->reportBufferLen < sizeof(BTN_TRACE_FEATURE_REPORT))
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                goto exit;
+            }
+
+            traceReport = (PBTN_TRACE_FEATURE_REPORT)featurePacket->reportBuffer;
+
+            //
+            // Writers are not held off, tools/btntrace drops records torn
+            // by a concurrent BtnTraceEvent
+            //
+            traceReport->Sequence = (ULONG)ReadAcquire(&devContext->TraceSequence);
+
+            RtlCopyMemory(
+                traceReport->Records,
+                devContext->TraceRecords,
+                sizeof(traceReport->Records));
+
+            WdfRequestSetInformation(Request, sizeof(BTN_TRACE_FEATURE_REPORT));
+            break;
+        }
+
+        case REPORTID_DEBOUNCE:
+        {
+            PBTN_DEBOUNCE_FEATURE_REPORT debounceReport;
+
+            if (featurePacket->reportBufferLen < sizeof(BTN_DEBOUNCE_FEATURE_REPORT))
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                goto exit;
+            }
+
+            debounceReport = (PBTN_DEBOUNCE_FEATURE_REPORT)featurePacket->reportBuffer;
+
+            for (ULONG button = 0; button < ButtonCount; button++)
+            {
+                PBUTTON_LINE line = &devContext->Lines[button];
+                PBTN_DEBOUNCE_LINE_REPORT lineReport = &debounceReport->Lines[button];
+
+                lineReport->WindowUs = (ULONG)(line->DebounceWindow / 10);
+                lineReport->MinimumUs = (ULONG)(line->DebounceMinimum / 10);
+                lineReport->MaximumUs = (ULONG)(line->DebounceMaximum / 10);
+
+                for (ULONG bucket = 0; bucket < BTN_LATENCY_BUCKETS; bucket++)
+                {
+                    lineReport->Intervals[bucket] = (ULONG)ReadNoFence(&line->IntervalBuckets[bucket]);
+                }
+            }
+
+            WdfRequestSetInformation(Request, sizeof(BTN_DEBOUNCE_FEATURE_REPORT));
+            break;
+        }
+
+        case REPORTID_DIAGNOSTICS:
+        {
+            PBTN_DIAGNOSTICS_FEATURE_REPORT diagnosticsReport;
+            ULONG buttonMask;
+            ULONGLONG now;
+
+            if (featurePacket->reportBufferLen < sizeof(BTN_DIAGNOSTICS_FEATURE_REPORT))
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                goto exit;
+            }
+
+            diagnosticsReport = (PBTN_DIAGNOSTICS_FEATURE_REPORT)featurePacket->reportBuffer;
+            buttonMask = (ULONG)ReadNoFence(&devContext->ButtonMask);
+            now = BtnQueryInterruptTime();
+
+            //
+            // Line state belongs to the drain, this is a best effort snapshot
+            //
+            for (ULONG button = 0; button < ButtonCount; button++)
+            {
+                PBUTTON_LINE line = &devContext->Lines[button];
+                PBTN_DIAGNOSTICS_LINE_REPORT lineReport = &diagnosticsReport->Lines[button];
+                ULONGLONG pressedSince = line->PressedSince;
+
+                lineReport->Flags = 0;
+                lineReport->HeldMs = 0;
+
+                if (line->Interrupt != NULL)
+                {
+                    lineReport->Flags |= BTN_LINE_WIRED;
+                }
+
+                if (BUTTON_PRESSED(buttonMask, button))
+                {
+                    lineReport->Flags |= BTN_LINE_PRESSED;
+                }
+
+                if (ReadNoFence(&line->Stuck))
+                {
+                    lineReport->Flags |= BTN_LINE_STUCK;
+                }
+
+                if (line->StormMasked)
+                {
+                    lineReport->Flags |= BTN_LINE_STORM_MASKED;
+                }
+
+                if (ReadNoFence(&devContext->WakeMask) & BUTTON_BIT(button))
+                {
+                    lineReport->Flags |= BTN_LINE_WOKE_DEVICE;
+                }
+
+                if (pressedSince != 0 && now > pressedSince)
+                {
+                    lineReport->HeldMs = (ULONG)min((now - pressedSince) / 10000, MAXULONG);
+                }
+            }
+
+            diagnosticsReport->Lifecycle = (ULONG)BtnLifecycleState(devContext);
+
+            for (ULONG phase = 0; phase < LifecyclePhaseCount; phase++)
+            {
+                for (ULONG bucket = 0; bucket < BTN_LATENCY_BUCKETS; bucket++)
+                {
+                    diagnosticsReport->LifecycleBuckets[phase][bucket] =
+                        (ULONG)ReadNoFence(&devContext->LifecycleBuckets[phase][bucket]);
+                }
+            }
+
+            WdfRequestSetInformation(Request, sizeof(BTN_DIAGNOSTICS_FEATURE_REPORT));
+            break;
+        }
+
 		default:
 		{
 			Trace(
 				TRACE_LEVEL_INFORMATION,
 				TRACE_DRIVER,
-				"%!FUNC! Unsupported type %d is requested",
+				"Unsupported type %d is requested",
 				featurePacket->reportId
 			);
 
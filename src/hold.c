@@ -0,0 +1,210 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <device.h>
+#include <deadline.h>
+#include <hold.h>
+#include <eventlog.h>
+#include <trace.h>
+
+static
+VOID
+BtnSendTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN const BTN_TRANSITION* Transition,
+    IN ULONGLONG EdgeTime
+    )
+{
+    for (UCHAR i = 0; i < Transition->ReportCount; i++)
+    {
+        SendReport(DeviceContext, Transition->Reports[i], ButtonType, EdgeTime);
+    }
+}
+
+static
+VOID
+BtnReleaseFollowedKeys(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
+    )
+{
+    const BTN_ACTION* action = &DeviceContext->Actions[ButtonType];
+    BTN_REPORT released = { 0 };
+
+    if (action->Mode != ActionModeFollow)
+    {
+        return;
+    }
+
+    released.ReportID = action->Report.ReportID;
+
+    SendReport(DeviceContext, released, ButtonType, EdgeTime);
+}
+
+VOID
+BtnHoldOnTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONG StateMask,
+    IN const BTN_TRANSITION* Transition
+    )
+/*++
+
+Routine Description:
+
+    Schedules or cancels hold and autorepeat deadlines after an edge has
+    been evaluated. A key going down stops every other key repeating, a
+    chord cancels every pending hold and repeat.
+
+    Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line that changed state
+    StateMask - Button mask after the edge
+    Transition - Outcome the edge was evaluated to
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    ULONGLONG now;
+
+    if (!BUTTON_PRESSED(StateMask, ButtonType))
+    {
+        line->HoldFired = FALSE;
+
+        BtnClearDeadline(DeviceContext, ButtonType, DeadlineHold);
+        BtnClearDeadline(DeviceContext, ButtonType, DeadlineRepeat);
+        return;
+    }
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        BtnClearDeadline(DeviceContext, (BUTTON_TYPE)button, DeadlineRepeat);
+
+        if (Transition->IgnoreButtonPresses)
+        {
+            BtnClearDeadline(DeviceContext, (BUTTON_TYPE)button, DeadlineHold);
+        }
+    }
+
+    if (Transition->IgnoreButtonPresses || Transition->PressIgnored)
+    {
+        return;
+    }
+
+    now = BtnQueryInterruptTime();
+
+    if (DeviceContext->Actions[BTN_HOLD_SLOT(ButtonType)].Mode != ActionModeNone)
+    {
+        BtnSetDeadline(DeviceContext, ButtonType, DeadlineHold, now + BTN_MS_TO_INTERRUPT_TIME(BTN_HOLD_DELAY_MS));
+    }
+
+    if ((BUTTON_BIT(ButtonType) & BTN_REPEAT_BUTTONS) != 0 &&
+        DeviceContext->Actions[ButtonType].Mode == ActionModeFollow)
+    {
+        line->RepeatInterval = BTN_MS_TO_INTERRUPT_TIME(BTN_REPEAT_INTERVAL_MS);
+
+        BtnSetDeadline(DeviceContext, ButtonType, DeadlineRepeat, now + BTN_MS_TO_INTERRUPT_TIME(BTN_REPEAT_DELAY_MS));
+    }
+}
+
+VOID
+BtnHoldExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Hold deadline of the deadline wheel. The button's own keys are let go
+    and the hold action takes over until the button is released.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line held down
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    //
+    // A multi-tap gesture owns the press it completed on
+    //
+    if (!BUTTON_PRESSED(ReadNoFence(&DeviceContext->ButtonMask), ButtonType) ||
+        DeviceContext->IgnoreButtonPresses ||
+        DeviceContext->Lines[ButtonType].Tap.Active)
+    {
+        return;
+    }
+
+    DeviceContext->Lines[ButtonType].HoldFired = TRUE;
+
+    BtnClearDeadline(DeviceContext, ButtonType, DeadlineRepeat);
+
+    BtnTraceEvent(DeviceContext, BtnEventHold, ButtonType, 0);
+
+    BtnReleaseFollowedKeys(DeviceContext, ButtonType, Now);
+    BtnSendTransition(DeviceContext, ButtonType, &DeviceContext->HoldPress[ButtonType], Now);
+}
+
+VOID
+BtnRepeatExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Repeat deadline of the deadline wheel. Repeats the held button's keys as
+    a release and press pair, and schedules the next repeat a little sooner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line held down
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+
+    if (!BUTTON_PRESSED(ReadNoFence(&DeviceContext->ButtonMask), ButtonType) ||
+        DeviceContext->IgnoreButtonPresses ||
+        line->HoldFired ||
+        line->Tap.Active)
+    {
+        return;
+    }
+
+    BtnTraceEvent(DeviceContext, BtnEventRepeat, ButtonType, (ULONG)(line->RepeatInterval / 10000));
+
+    BtnReleaseFollowedKeys(DeviceContext, ButtonType, Now);
+    SendReport(DeviceContext, DeviceContext->Actions[ButtonType].Report, ButtonType, Now);
+
+    BtnSetDeadline(DeviceContext, ButtonType, DeadlineRepeat, Now + line->RepeatInterval);
+
+    line->RepeatInterval = max(
+        line->RepeatInterval - line->RepeatInterval / 4,
+        BTN_MS_TO_INTERRUPT_TIME(BTN_REPEAT_MIN_INTERVAL_MS));
+}
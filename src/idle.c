@@ -1,7 +1,70 @@
 #include <internal.h>
 #include <idle.h>
+#include <level.h>
+#include <eventlog.h>
 #include <trace.h>
 
+#ifdef ALLOC_PRAGMA
+  #pragma alloc_text(PAGE, BtnCreateIdleWorkItem)
+#endif
+
+NTSTATUS
+BtnCreateIdleWorkItem(
+    IN PDEVICE_EXTENSION FxDeviceContext
+    )
+/*++
+
+Routine Description:
+
+    Creates the work item making HIDClass's idle callback, once per device.
+    Every idle notification reuses it, so the idle path allocates nothing.
+
+Arguments:
+
+    FxDeviceContext - Pointer to Device Context for the device
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+    WDF_OBJECT_ATTRIBUTES workItemAttributes;
+    WDF_WORKITEM_CONFIG workitemConfig;
+
+    PAGED_CODE();
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&workItemAttributes, IDLE_WORKITEM_CONTEXT);
+    workItemAttributes.ParentObject = FxDeviceContext->FxDevice;
+
+    WDF_WORKITEM_CONFIG_INIT(&workitemConfig, BtnIdleIrpWorkitem);
+
+    status = WdfWorkItemCreate(
+                &workitemConfig,
+                &workItemAttributes,
+                &FxDeviceContext->IdleWorkItem
+                );
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error creating idle work item - 0x%08X",
+            status);
+
+        return status;
+    }
+
+    GetWorkItemContext(FxDeviceContext->IdleWorkItem)->FxDevice = FxDeviceContext->FxDevice;
+    GetWorkItemContext(FxDeviceContext->IdleWorkItem)->FxRequest = NULL;
+
+    FxDeviceContext->IdleInFlight = FALSE;
+
+    return status;
+}
+
 NTSTATUS
 BtnProcessIdleRequest(
     IN WDFDEVICE Device,
@@ -69,7 +132,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Error: Input buffer is too small to process idle request - %!STATUS!", 
+            "Error: Input buffer is too small to process idle request - 0x%08X", 
             status);
 
         goto exit;
@@ -89,59 +152,42 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_HID,
-            "Error: Idle Notification request %p has no idle callback info - %!STATUS!",
+            "Error: Idle Notification request %p has no idle callback info - 0x%08X",
             Request,
             status);
         goto exit;
     }
 
+    //
+    // HIDClass has one idle notification outstanding at a time. The work
+    // item is shared, a request arriving while it still carries the
+    // previous one to IdleQueue is turned away rather than overwriting it.
+    //
+    if (InterlockedCompareExchange(&devContext->IdleInFlight, TRUE, FALSE) != FALSE)
     {
-        //
-        // Create a workitem for the idle callback
-        //
-        WDF_OBJECT_ATTRIBUTES workItemAttributes;
-        WDF_WORKITEM_CONFIG workitemConfig;
-        WDFWORKITEM idleWorkItem;
-        PIDLE_WORKITEM_CONTEXT idleWorkItemContext;
-
-        WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&workItemAttributes, IDLE_WORKITEM_CONTEXT);
-        workItemAttributes.ParentObject = devContext->FxDevice;
-
-        WDF_WORKITEM_CONFIG_INIT(&workitemConfig, BtnIdleIrpWorkitem);
-
-        status = WdfWorkItemCreate(
-                    &workitemConfig,
-                    &workItemAttributes,
-                    &idleWorkItem
-                    );
-
-        if (!NT_SUCCESS(status)) {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_HID,
-                "Error creating creating idle work item - %!STATUS!",
-                status);
-            goto exit;
-        }
+        status = STATUS_DEVICE_BUSY;
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_HID,
+            "Error: Idle Notification request %p arrived while another is in flight - 0x%08X",
+            Request,
+            status);
+        goto exit;
+    }
 
-        //
-        // Set the workitem context
-        //
-        idleWorkItemContext = GetWorkItemContext(idleWorkItem);
-        idleWorkItemContext->FxDevice = devContext->FxDevice;
-        idleWorkItemContext->FxRequest = Request;
-    
-        //
-        // Enqueue a workitem for the idle callback
-        //
-        WdfWorkItemEnqueue(idleWorkItem);
+    //
+    // Enqueue the workitem for the idle callback
+    //
+    GetWorkItemContext(devContext->IdleWorkItem)->FxRequest = Request;
 
-        //
-        // Mark the request as pending so that 
-        // we can complete it when we come out of idle
-        //
-        *Pending = TRUE;
-    }
+    WdfWorkItemEnqueue(devContext->IdleWorkItem);
+
+    //
+    // Mark the request as pending so that 
+    // we can complete it when we come out of idle
+    //
+    *Pending = TRUE;
+    status = STATUS_SUCCESS;
 
 exit:
 
@@ -213,7 +259,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_IDLE,
-            "Error forwarding idle notification Request:0x%p to IdleQueue:0x%p - %!STATUS!",
+            "Error forwarding idle notification Request:0x%p to IdleQueue:0x%p - 0x%08X",
             idleWorkItemContext->FxRequest,
             deviceContext->IdleQueue,
             status);
@@ -225,25 +271,34 @@ Return Value:
     }
     else
     {
+        //
+        // From here on a button edge completes the request, see
+        // BtnWakeFromIdle. A previous wake that produced no report is not
+        // carried over.
+        //
+        InterlockedExchange64(&deviceContext->WakeTime, 0);
+        InterlockedExchange(&deviceContext->IdleParked, TRUE);
+
         Trace(
             TRACE_LEVEL_INFORMATION,
             TRACE_IDLE,
-            "Forwarded idle notification Request:0x%p to IdleQueue:0x%p - %!STATUS!",
+            "Forwarded idle notification Request:0x%p to IdleQueue:0x%p - 0x%08X",
             idleWorkItemContext->FxRequest,
             deviceContext->IdleQueue,
             status);
     }
     
     //
-    // Delete the workitem since we're done with it
+    // The work item may carry the next request from here on
     //
-    WdfObjectDelete(IdleWorkItem);
+    idleWorkItemContext->FxRequest = NULL;
+    InterlockedExchange(&deviceContext->IdleInFlight, FALSE);
 
     return;
 }
 
 
-VOID
+BOOLEAN
 BtnCompleteIdleIrp(
     IN PDEVICE_EXTENSION FxDeviceContext
     )
@@ -251,7 +306,7 @@ BtnCompleteIdleIrp(
 
 Routine Description:
  
-    This is invoked when we enter D0. 
+    This is invoked when we enter D0, or by BtnWakeFromIdle.
     We simply complete the Idle Irp if it hasn't been cancelled already.
 
 Arguments:
@@ -260,13 +315,15 @@ Arguments:
 
 Return Value:
 
-    
+    TRUE if an Idle Irp was completed
 
 --*/
 {
     NTSTATUS status;
     WDFREQUEST request = NULL;
 
+    InterlockedExchange(&FxDeviceContext->IdleParked, FALSE);
+
     //
     // Lets try to retrieve the Idle IRP from the Idle queue
     //
@@ -282,7 +339,7 @@ Return Value:
         Trace(
             TRACE_LEVEL_WARNING,
             TRACE_IDLE,
-            "Error finding idle notification request in IdleQueue:0x%p - %!STATUS!",
+            "Error finding idle notification request in IdleQueue:0x%p - 0x%08X",
             FxDeviceContext->IdleQueue,
             status);
     }
@@ -296,11 +353,61 @@ Return Value:
         Trace(
             TRACE_LEVEL_INFORMATION,
             TRACE_IDLE,
-            "Completed idle notification Request:0x%p from IdleQueue:0x%p - %!STATUS!",
+            "Completed idle notification Request:0x%p from IdleQueue:0x%p - 0x%08X",
             request,
             FxDeviceContext->IdleQueue,
             status);
     }
 
-    return;
-}
\ No newline at end of file
+    return NT_SUCCESS(status) && (request != NULL);
+}
+
+VOID
+BtnWakeFromIdle(
+    IN PDEVICE_EXTENSION FxDeviceContext,
+    IN BUTTON_TYPE ButtonType
+    )
+/*++
+
+Routine Description:
+
+    Called by OnInterruptIsr for an edge seen while an idle notification is
+    parked in IdleQueue. Completing it brings the stack back out of idle
+    while buttons are in use. The line is recorded as the wake source, and
+    the time of the completion in WakeTime as the start of
+    LifecyclePhaseWakeToD0 and LifecyclePhaseWakeReport.
+
+    HIDCLASS is the power policy owner, the interrupts cannot be armed for
+    wake: once the device has left D0 an edge no longer reaches the ISR,
+    and the line is only reconciled from its level at the next D0 entry.
+
+Arguments:
+
+    FxDeviceContext - Pointer to Device Context for the device
+    ButtonType - Line the edge was seen on
+
+Return Value:
+
+    None
+
+--*/
+{
+    if (!InterlockedExchange(&FxDeviceContext->IdleParked, FALSE))
+    {
+        return;
+    }
+
+    //
+    // HIDCLASS may have cancelled the request meanwhile
+    //
+    if (!BtnCompleteIdleIrp(FxDeviceContext))
+    {
+        return;
+    }
+
+    InterlockedExchange(&FxDeviceContext->WakeMask, BUTTON_BIT(ButtonType));
+    InterlockedExchange64(&FxDeviceContext->WakeTime, (LONGLONG)BtnQueryInterruptTime());
+
+    BtnCountEvent(FxDeviceContext, ButtonType, CounterWakes);
+    BtnTraceEvent(FxDeviceContext, BtnEventWake, ButtonType, 0);
+}
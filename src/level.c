@@ -0,0 +1,324 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <gpio.h>
+#include <debounce.h>
+#include <level.h>
+#include <eventlog.h>
+#include <trace.h>
+
+#ifdef ALLOC_PRAGMA
+  #pragma alloc_text(PAGE, BtnOpenLevelTarget)
+  #pragma alloc_text(PAGE, BtnCloseLevelTarget)
+#endif
+
+C_ASSERT(ButtonCount <= 8 * sizeof(ULONG));
+
+NTSTATUS
+BtnOpenLevelTarget(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    Opens the GPIO IO connection covering the pins of every wired line and
+    preallocates the request and buffer all reads go through. Lines are
+    active low unless their bit is set in ActiveHighButtons in the device's
+    hardware registry key.
+
+    Without a connection, or if it cannot be opened, levels are unknown:
+    lines are assumed released at start-up and only followed through their
+    edges.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+    WDFKEY key = NULL;
+    WDF_OBJECT_ATTRIBUTES attributes;
+    WDF_IO_TARGET_OPEN_PARAMS openParams;
+    DECLARE_CONST_UNICODE_STRING(activeHighValueName, L"ActiveHighButtons");
+    DECLARE_UNICODE_STRING_SIZE(devicePath, RESOURCE_HUB_PATH_SIZE);
+
+    PAGED_CODE();
+
+    DeviceContext->ActiveHighMask = 0;
+
+    status = WdfDeviceOpenRegistryKey(
+        DeviceContext->FxDevice,
+        PLUGPLAY_REGISTRY_DEVICE,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &key);
+
+    if (NT_SUCCESS(status))
+    {
+        (VOID)WdfRegistryQueryULong(key, &activeHighValueName, &DeviceContext->ActiveHighMask);
+
+        WdfRegistryClose(key);
+    }
+
+    if (DeviceContext->LevelConnectionId.QuadPart == 0 || DeviceContext->LevelTarget != NULL)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    status = RESOURCE_HUB_CREATE_PATH_FROM_ID(
+        &devicePath,
+        DeviceContext->LevelConnectionId.LowPart,
+        DeviceContext->LevelConnectionId.HighPart);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = DeviceContext->FxDevice;
+
+    status = WdfIoTargetCreate(DeviceContext->FxDevice, &attributes, &DeviceContext->LevelTarget);
+
+    if (!NT_SUCCESS(status))
+    {
+        DeviceContext->LevelTarget = NULL;
+        goto exit;
+    }
+
+    WDF_IO_TARGET_OPEN_PARAMS_INIT_OPEN_BY_NAME(&openParams, &devicePath, FILE_GENERIC_READ);
+
+    status = WdfIoTargetOpen(DeviceContext->LevelTarget, &openParams);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    //
+    // The request and its memory are children of the target and go away
+    // with it
+    //
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = DeviceContext->LevelTarget;
+
+    status = WdfRequestCreate(&attributes, DeviceContext->LevelTarget, &DeviceContext->LevelRequest);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = WdfMemoryCreatePreallocated(
+        &attributes,
+        &DeviceContext->LevelPins,
+        sizeof(DeviceContext->LevelPins),
+        &DeviceContext->LevelMemory);
+
+exit:
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_INIT,
+            "Error opening GPIO IO connection, line levels unknown - 0x%08X",
+            status);
+
+        BtnCloseLevelTarget(DeviceContext);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+BtnCloseLevelTarget(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+{
+    PAGED_CODE();
+
+    if (DeviceContext->LevelTarget != NULL)
+    {
+        WdfObjectDelete(DeviceContext->LevelTarget);
+    }
+
+    DeviceContext->LevelTarget = NULL;
+    DeviceContext->LevelRequest = NULL;
+    DeviceContext->LevelMemory = NULL;
+}
+
+NTSTATUS
+BtnReadLevels(
+    IN PDEVICE_EXTENSION DeviceContext,
+    OUT PULONG PressedMask
+    )
+/*++
+
+Routine Description:
+
+    Reads the levels of all lines with one IOCTL_GPIO_READ_PINS, bit n of
+    the pins read is line n. The preallocated request is reused, a read
+    allocates nothing.
+
+    Only called by the drain owner, which serializes use of the request.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    PressedMask - Receives one BUTTON_BIT per pressed line
+
+Return Value:
+
+    STATUS_NOT_FOUND if there is no GPIO IO connection,
+    otherwise the status of the read
+
+--*/
+{
+    NTSTATUS status;
+    WDF_REQUEST_REUSE_PARAMS reuseParams;
+    WDF_REQUEST_SEND_OPTIONS sendOptions;
+
+    *PressedMask = 0;
+
+    if (DeviceContext->LevelRequest == NULL)
+    {
+        return STATUS_NOT_FOUND;
+    }
+
+    WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+
+    status = WdfRequestReuse(DeviceContext->LevelRequest, &reuseParams);
+
+    if (NT_SUCCESS(status))
+    {
+        status = WdfIoTargetFormatRequestForIoctl(
+            DeviceContext->LevelTarget,
+            DeviceContext->LevelRequest,
+            IOCTL_GPIO_READ_PINS,
+            NULL,
+            NULL,
+            DeviceContext->LevelMemory,
+            NULL);
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        WDF_REQUEST_SEND_OPTIONS_INIT(&sendOptions, WDF_REQUEST_SEND_OPTION_SYNCHRONOUS);
+
+        (VOID)WdfRequestSend(DeviceContext->LevelRequest, DeviceContext->LevelTarget, &sendOptions);
+
+        status = WdfRequestGetStatus(DeviceContext->LevelRequest);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        BtnTraceEvent(DeviceContext, BtnEventLevelReadFailed, DeviceContext->LevelLines, (ULONG)status);
+        return status;
+    }
+
+    *PressedMask = (DeviceContext->LevelPins ^ ~DeviceContext->ActiveHighMask) & DeviceContext->LevelLines;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+BtnReadLineLevel(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    OUT PBOOLEAN Pressed
+    )
+{
+    NTSTATUS status;
+    ULONG pressedMask;
+
+    *Pressed = FALSE;
+
+    if (!(DeviceContext->LevelLines & BUTTON_BIT(ButtonType)))
+    {
+        return STATUS_NOT_FOUND;
+    }
+
+    status = BtnReadLevels(DeviceContext, &pressedMask);
+
+    if (NT_SUCCESS(status))
+    {
+        *Pressed = BUTTON_PRESSED(pressedMask, ButtonType) == ButtonStatePressed;
+    }
+
+    return status;
+}
+
+VOID
+BtnResyncLines(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Reads every line's level and reconciles the reported state with it,
+    see BtnDebounceResync. Edges still pending are dropped: they happened
+    before the read and the levels already include them. Lines whose level
+    cannot be read keep their state and edges.
+
+    Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    ULONG pressedMask;
+    LONG edges[ButtonCount];
+
+    if (DeviceContext->LevelRequest == NULL)
+    {
+        return;
+    }
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        edges[button] = (DeviceContext->LevelLines & BUTTON_BIT(button)) ?
+            InterlockedExchange(&DeviceContext->Lines[button].PendingEdges, 0) : 0;
+    }
+
+    if (!NT_SUCCESS(BtnReadLevels(DeviceContext, &pressedMask)))
+    {
+        //
+        // Hand the edges back, they are all there is to go by
+        //
+        for (ULONG button = 0; button < ButtonCount; button++)
+        {
+            InterlockedAdd(&DeviceContext->Lines[button].PendingEdges, edges[button]);
+        }
+
+        return;
+    }
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        if (!(DeviceContext->LevelLines & BUTTON_BIT(button)))
+        {
+            continue;
+        }
+
+        BtnTraceEvent(DeviceContext, BtnEventLevelRead, button, BUTTON_PRESSED(pressedMask, button));
+
+        BtnDebounceResync(DeviceContext, (BUTTON_TYPE)button, BUTTON_PRESSED(pressedMask, button) == ButtonStatePressed, Now);
+    }
+}
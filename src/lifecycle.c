@@ -0,0 +1,121 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <lifecycle.h>
+#include <eventlog.h>
+#include <trace.h>
+
+//
+// States every state may be entered from, one bit per BTN_LIFECYCLE_STATE
+//
+#define LIFECYCLE_BIT(State)                (1ul << (State))
+
+static const ULONG gLifecycleEnteredFrom[LifecycleStateCount] =
+{
+    // Released
+    LIFECYCLE_BIT(LifecyclePrepared) | LIFECYCLE_BIT(LifecyclePoweredDown),
+    // Prepared
+    LIFECYCLE_BIT(LifecycleReleased),
+    // PoweringUp
+    LIFECYCLE_BIT(LifecyclePrepared) | LIFECYCLE_BIT(LifecyclePoweredDown),
+    // Ready
+    LIFECYCLE_BIT(LifecyclePoweringUp),
+    // PoweredDown, also when a D0 entry fails half-way
+    LIFECYCLE_BIT(LifecyclePoweringUp) | LIFECYCLE_BIT(LifecycleReady),
+};
+
+VOID
+BtnLifecycleEnter(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BTN_LIFECYCLE_STATE State
+    )
+/*++
+
+Routine Description:
+
+    Moves the device to State and records when. The framework serializes
+    the PnP and power callbacks, the only callers, so the previous state
+    is only checked, never raced for. An unexpected transition is traced
+    and taken anyway: the framework's view of the device wins.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    State - State entered
+
+Return Value:
+
+    None
+
+--*/
+{
+    ULONGLONG now = BtnQueryInterruptTime();
+    BTN_LIFECYCLE_STATE previous = BtnLifecycleState(DeviceContext);
+
+    DeviceContext->LifecycleTimes[State] = now;
+
+    switch (State)
+    {
+    case LifecyclePoweringUp:
+        InterlockedExchange(&DeviceContext->AwaitingFirstReport, TRUE);
+
+        //
+        // Only set if the button's report has not gone out before the
+        // device left D0
+        //
+        BtnLifecycleRecordPhase(
+            DeviceContext,
+            LifecyclePhaseWakeToD0,
+            (ULONGLONG)ReadNoFence64(&DeviceContext->WakeTime),
+            now);
+        break;
+
+    case LifecycleReady:
+        BtnLifecycleRecordPhase(
+            DeviceContext,
+            LifecyclePhasePowerUp,
+            DeviceContext->LifecycleTimes[LifecyclePoweringUp],
+            now);
+        break;
+
+    default:
+        break;
+    }
+
+    //
+    // Full barrier, the times above are published with the state
+    //
+    InterlockedExchange(&DeviceContext->Lifecycle, (LONG)State);
+
+    if (!(gLifecycleEnteredFrom[State] & LIFECYCLE_BIT(previous)))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_FLAG_POWER,
+            "Lifecycle state %d entered from unexpected state %d",
+            State,
+            previous);
+
+        BtnTraceEvent(DeviceContext, BtnEventLifecycleUnexpected, State, previous);
+        return;
+    }
+
+    BtnTraceEvent(DeviceContext, BtnEventLifecycle, State, previous);
+}
+
+VOID
+BtnLifecycleRecordPhase(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BTN_LIFECYCLE_PHASE Phase,
+    IN ULONGLONG StartTime,
+    IN ULONGLONG EndTime
+    )
+{
+    if (StartTime == 0 || EndTime < StartTime)
+    {
+        return;
+    }
+
+    InterlockedIncrement(&DeviceContext->LifecycleBuckets[Phase][BtnDurationBucket(EndTime - StartTime)]);
+}
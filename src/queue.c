@@ -54,7 +54,6 @@ Return Value:
 --*/
 {
     NTSTATUS status;
-    PDEVICE_EXTENSION devContext;
     WDFDEVICE device;
     BOOLEAN requestPending;
 
@@ -62,7 +61,6 @@ Return Value:
     UNREFERENCED_PARAMETER(InputBufferLength);
     
     device = WdfIoQueueGetDevice(Queue);
-    devContext = GetDeviceContext(device);
     requestPending = FALSE;
 
     //
@@ -0,0 +1,206 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <device.h>
+#include <deadline.h>
+#include <debounce.h>
+#include <level.h>
+#include <storm.h>
+#include <eventlog.h>
+#include <trace.h>
+
+//
+// Interrupt time it takes the bucket to earn one token
+//
+#define BTN_STORM_TOKEN_INTERVAL            (BTN_MS_TO_INTERRUPT_TIME(1000) / BTN_STORM_RATE)
+
+BOOLEAN
+BtnStormAdmit(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
+    )
+/*++
+
+Routine Description:
+
+    Takes a token from the line's bucket for one interrupt. Called from
+    OnInterruptIsr only; the interrupts of one line are serialized by its
+    passive interrupt lock, so the bucket needs no interlocked operations.
+    The bucket starts out full, even if the first call comes sooner after
+    boot than it takes to earn BTN_STORM_BURST tokens.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line that interrupted
+    EdgeTime - Interrupt time of the interrupt
+
+Return Value:
+
+    TRUE if the line is within its budget
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    ULONGLONG earned;
+
+    if (EdgeTime > line->StormRefillTime)
+    {
+        earned = (EdgeTime - line->StormRefillTime) / BTN_STORM_TOKEN_INTERVAL;
+
+        if (line->StormRefillTime == 0 || line->StormTokens + earned >= BTN_STORM_BURST)
+        {
+            line->StormTokens = BTN_STORM_BURST;
+            line->StormRefillTime = EdgeTime;
+        }
+        else
+        {
+            line->StormTokens += (ULONG)earned;
+            line->StormRefillTime += earned * BTN_STORM_TOKEN_INTERVAL;
+        }
+    }
+
+    if (line->StormTokens == 0)
+    {
+        return FALSE;
+    }
+
+    line->StormTokens--;
+
+    return TRUE;
+}
+
+VOID
+BtnStormMaskLines(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Masks every line OnInterruptIsr found over its budget and schedules it
+    to be unmasked after its backoff. Only called by the drain owner, at
+    passive level outside of the line's ISR.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    LONG stormMask = InterlockedExchange(&DeviceContext->StormMask, 0);
+    ULONG button;
+
+    while (stormMask != 0)
+    {
+        PBUTTON_LINE line;
+
+        BitScanForward(&button, (ULONG)stormMask);
+        stormMask &= stormMask - 1;
+
+        line = &DeviceContext->Lines[button];
+
+        if (line->StormMasked || line->Interrupt == NULL)
+        {
+            continue;
+        }
+
+        WdfInterruptDisable(line->Interrupt);
+        line->StormMasked = TRUE;
+
+        if (line->StormBackoff == 0 ||
+            Now - line->StormUnmaskedTime >= BTN_MS_TO_INTERRUPT_TIME(BTN_STORM_BACKOFF_RESET_MS))
+        {
+            line->StormBackoff = BTN_MS_TO_INTERRUPT_TIME(BTN_STORM_MIN_BACKOFF_MS);
+        }
+        else
+        {
+            line->StormBackoff = min(line->StormBackoff * 2, BTN_MS_TO_INTERRUPT_TIME(BTN_STORM_MAX_BACKOFF_MS));
+        }
+
+        BtnSetDeadline(DeviceContext, (BUTTON_TYPE)button, DeadlineStorm, Now + line->StormBackoff);
+
+        BtnCountEvent(DeviceContext, button, CounterStorms);
+        BtnTraceEvent(DeviceContext, BtnEventStormMasked, button, (ULONG)(line->StormBackoff / 10000));
+
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_DRIVER,
+            "%s: interrupt storm, line masked for %llu ms",
+            gButtonDescriptors[button].Name,
+            line->StormBackoff / 10000);
+    }
+}
+
+VOID
+BtnStormExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Storm deadline of the deadline wheel. Unmasks the line and
+    resynchronizes its state with its level, edges were lost while it was
+    masked. A line whose level cannot be read is taken to be released.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line whose backoff has run out
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    BOOLEAN pressed;
+
+    if (!line->StormMasked)
+    {
+        return;
+    }
+
+    line->StormMasked = FALSE;
+    line->StormUnmaskedTime = Now;
+
+    WdfInterruptEnable(line->Interrupt);
+
+    BtnTraceEvent(DeviceContext, BtnEventStormUnmasked, ButtonType, 0);
+
+    //
+    // Read after enabling, a change in between raises an edge
+    //
+    (VOID)BtnReadLineLevel(DeviceContext, ButtonType, &pressed);
+
+    BtnDebounceResync(DeviceContext, ButtonType, pressed, Now);
+}
+
+VOID
+BtnStormReset(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+{
+    //
+    // The framework enables every line again on the next D0 entry
+    //
+    InterlockedExchange(&DeviceContext->StormMask, 0);
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        DeviceContext->Lines[button].StormMasked = FALSE;
+    }
+}
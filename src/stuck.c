@@ -0,0 +1,286 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <device.h>
+#include <deadline.h>
+#include <stuck.h>
+#include <debounce.h>
+#include <level.h>
+#include <lifecycle.h>
+#include <eventlog.h>
+#include <trace.h>
+
+#ifdef ALLOC_PRAGMA
+  #pragma alloc_text(PAGE, BtnLoadStuckConfig)
+#endif
+
+NTSTATUS
+BtnLoadStuckConfig(
+    IN PDEVICE_EXTENSION DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    Reads the stuck timeout, StuckButtonTimeoutS, from the device's
+    hardware registry key. Values that are absent or above
+    BTN_STUCK_MAX_TIMEOUT_S keep the default, 0 disables the detector.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+    WDFKEY key = NULL;
+    ULONG value;
+    ULONG timeoutS = BTN_STUCK_DEFAULT_TIMEOUT_S;
+    DECLARE_CONST_UNICODE_STRING(timeoutValueName, L"StuckButtonTimeoutS");
+
+    PAGED_CODE();
+
+    status = WdfDeviceOpenRegistryKey(
+        DeviceContext->FxDevice,
+        PLUGPLAY_REGISTRY_DEVICE,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &key);
+
+    if (NT_SUCCESS(status))
+    {
+        if (NT_SUCCESS(WdfRegistryQueryULong(key, &timeoutValueName, &value)))
+        {
+            if (value <= BTN_STUCK_MAX_TIMEOUT_S)
+            {
+                timeoutS = value;
+            }
+            else
+            {
+                Trace(
+                    TRACE_LEVEL_ERROR,
+                    TRACE_INIT,
+                    "Ignoring invalid stuck timeout StuckButtonTimeoutS=%lu",
+                    value);
+            }
+        }
+
+        WdfRegistryClose(key);
+    }
+
+    DeviceContext->StuckTimeout = BTN_MS_TO_INTERRUPT_TIME(timeoutS) * 1000;
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        InterlockedExchange(&DeviceContext->Lines[button].Stuck, FALSE);
+        DeviceContext->Lines[button].PressedSince = 0;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+BtnStuckOnTransition(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG EdgeTime
+    )
+/*++
+
+Routine Description:
+
+    Times every press of a key against the stuck timeout. Called for every
+    debounced transition, after LogicalPressed has been updated. The
+    release of a stuck line lifts the quarantine; it has already been
+    reported when the line was found stuck.
+
+    Only called by the drain owner.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line that changed state
+    EdgeTime - Interrupt time of the transition
+
+Return Value:
+
+    TRUE if the transition is to be reported
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+
+    if (line->LogicalPressed)
+    {
+        line->PressedSince = EdgeTime;
+
+        if (DeviceContext->StuckTimeout != 0 && (BUTTON_BIT(ButtonType) & BTN_STUCK_BUTTONS))
+        {
+            BtnSetDeadline(DeviceContext, ButtonType, DeadlineStuck, EdgeTime + DeviceContext->StuckTimeout);
+        }
+
+        return TRUE;
+    }
+
+    line->PressedSince = 0;
+    BtnClearDeadline(DeviceContext, ButtonType, DeadlineStuck);
+
+    if (!line->Stuck)
+    {
+        return TRUE;
+    }
+
+    InterlockedExchange(&line->Stuck, FALSE);
+
+    BtnTraceEvent(DeviceContext, BtnEventStuckCleared, ButtonType, 0);
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_DRIVER,
+        "%s: released, no longer stuck",
+        gButtonDescriptors[ButtonType].Name);
+
+    return FALSE;
+}
+
+VOID
+BtnStuckExpired(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Stuck deadline of the deadline wheel. Quarantines a key held for the
+    whole stuck timeout: its release is reported now, so that it no longer
+    counts towards the keys held down, blocks the others or autorepeats,
+    and its edges are ignored until the line is seen released. For a line
+    already quarantined the deadline is the poll of its level, see
+    BtnStuckMask.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Line held for the whole timeout
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+    BOOLEAN pressed;
+
+    //
+    // Before the device is ready the release could not be reported, the
+    // timeout starts over once the line levels are reconciled
+    //
+    if (!line->LogicalPressed || BtnLifecycleState(DeviceContext) != LifecycleReady)
+    {
+        return;
+    }
+
+    if (line->Stuck)
+    {
+        if (!line->StormMasked)
+        {
+            WdfInterruptEnable(line->Interrupt);
+        }
+
+        //
+        // Read after enabling, a change in between raises an edge. A
+        // line still pressed, or whose level cannot be read, is masked
+        // again by BtnDebounceResync.
+        //
+        if (!NT_SUCCESS(BtnReadLineLevel(DeviceContext, ButtonType, &pressed)))
+        {
+            pressed = TRUE;
+        }
+
+        BtnDebounceResync(DeviceContext, ButtonType, pressed, Now);
+        return;
+    }
+
+    InterlockedExchange(&line->Stuck, TRUE);
+
+    BtnCountEvent(DeviceContext, ButtonType, CounterStuck);
+    BtnTraceEvent(DeviceContext, BtnEventStuck, ButtonType, (ULONG)((Now - line->PressedSince) / 10000000));
+
+    Trace(
+        TRACE_LEVEL_WARNING,
+        TRACE_DRIVER,
+        "%s: held for %llu s, line quarantined",
+        gButtonDescriptors[ButtonType].Name,
+        (Now - line->PressedSince) / 10000000);
+
+    //
+    // The press may have come in before the device was ready and never made
+    // it into ButtonMask, there is nothing to release then
+    //
+    if (BUTTON_PRESSED(ReadNoFence(&DeviceContext->ButtonMask), ButtonType))
+    {
+        HandleButtonPress(DeviceContext, ButtonType, Now);
+    }
+
+    BtnStuckMask(DeviceContext, ButtonType, Now);
+}
+
+VOID
+BtnStuckMask(
+    IN PDEVICE_EXTENSION DeviceContext,
+    IN BUTTON_TYPE ButtonType,
+    IN ULONGLONG Now
+    )
+/*++
+
+Routine Description:
+
+    Disables the interrupt of a line found stuck, or found still pressed
+    when its level was read again, so that its edges neither reach the
+    drain nor bring the stack out of idle. The level is polled every
+    BTN_STUCK_POLL_MS until it reads released, see BtnStuckExpired. A line
+    whose level cannot be read keeps its interrupt, its release edge lifts
+    the quarantine.
+
+    Only called by the drain owner, at passive level outside of the line's
+    ISR.
+
+Arguments:
+
+    DeviceContext - Pointer to the device context
+    ButtonType - Stuck line
+    Now - Current interrupt time
+
+Return Value:
+
+    None
+
+--*/
+{
+    PBUTTON_LINE line = &DeviceContext->Lines[ButtonType];
+
+    if (line->Interrupt == NULL || !(DeviceContext->LevelLines & BUTTON_BIT(ButtonType)))
+    {
+        return;
+    }
+
+    //
+    // A line masked for a storm is already disabled, BtnStormExpired
+    // enables it again and resynchronizes it, which masks it again here
+    //
+    if (!line->StormMasked)
+    {
+        WdfInterruptDisable(line->Interrupt);
+    }
+
+    BtnSetDeadline(DeviceContext, ButtonType, DeadlineStuck, Now + BTN_MS_TO_INTERRUPT_TIME(BTN_STUCK_POLL_MS));
+}
@@ -0,0 +1,124 @@
+// Copyright (c) Microsoft Corporation. All Rights Reserved.
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#include <internal.h>
+#include <trace.h>
+
+#ifdef ALLOC_PRAGMA
+  #pragma alloc_text(INIT, TraceInitialize)
+#endif
+
+ULONG gTraceLevel = TRACE_LEVEL_WARNING;
+ULONG gTraceFlags = TRACE_FLAG_ALL;
+
+VOID
+TraceInitialize(
+    IN WDFDRIVER Driver
+    )
+/*++
+
+Routine Description:
+
+    Reads the runtime trace filter from the driver's Parameters key.
+    Missing values keep the defaults, warnings and errors for every flag.
+
+Arguments:
+
+    Driver - Handle to the framework driver object
+
+Return Value:
+
+    None
+
+--*/
+{
+    NTSTATUS status;
+    WDFKEY key = NULL;
+    ULONG value;
+    DECLARE_CONST_UNICODE_STRING(traceLevelName, L"TraceLevel");
+    DECLARE_CONST_UNICODE_STRING(traceFlagsName, L"TraceFlags");
+
+    status = WdfDriverOpenParametersRegistryKey(
+        Driver,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &key);
+
+    if (!NT_SUCCESS(status))
+    {
+        return;
+    }
+
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &traceLevelName, &value)))
+    {
+        gTraceLevel = min(value, TRACE_LEVEL_VERBOSE);
+    }
+
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &traceFlagsName, &value)))
+    {
+        gTraceFlags = value;
+    }
+
+    WdfRegistryClose(key);
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_INIT,
+        "Trace level %u, flags 0x%08X",
+        gTraceLevel,
+        gTraceFlags);
+}
+
+BOOLEAN
+TraceRateLimit(
+    IN PTRACE_CALLSITE Callsite
+    )
+/*++
+
+Routine Description:
+
+    Decides whether a call site that passed the level and flag filters may
+    print. Lock-free; concurrent callers racing on a window boundary may let
+    a message or two more through, which is fine for a log limiter.
+
+Arguments:
+
+    Callsite - Per call site state, a static declared by the Trace macro
+
+Return Value:
+
+    TRUE if the message should be printed
+
+--*/
+{
+    LONGLONG now = (LONGLONG)KeQueryInterruptTime();
+    LONGLONG windowStart = ReadNoFence64(&Callsite->WindowStart);
+    LONG suppressed;
+
+    if (now - windowStart >= TRACE_RATE_LIMIT_WINDOW &&
+        InterlockedCompareExchange64(&Callsite->WindowStart, now, windowStart) == windowStart)
+    {
+        InterlockedExchange(&Callsite->Count, 1);
+
+        suppressed = InterlockedExchange(&Callsite->Suppressed, 0);
+        if (suppressed != 0)
+        {
+            DbgPrintEx(
+                DPFLTR_IHVDRIVER_ID,
+                DPFLTR_ERROR_LEVEL,
+                "LumiaButtonsGPIO: %d similar messages suppressed\n",
+                suppressed);
+        }
+
+        return TRUE;
+    }
+
+    if (InterlockedIncrement(&Callsite->Count) <= TRACE_RATE_LIMIT_BURST)
+    {
+        return TRUE;
+    }
+
+    InterlockedIncrement(&Callsite->Suppressed);
+
+    return FALSE;
+}
@@ -0,0 +1,334 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Equivalence of the transition table with the original action chain.
+//
+// Builds the whole driver against the stand-in framework in ../wdk, starts
+// it with every line wired and the default mapping, and walks every
+// (IgnoreButtonPresses, button mask after the edge, button) the table is
+// indexed by. Each entry, together with the chord the chord rules complete
+// for a press, must send the same reports and leave the same
+// IgnoreButtonPresses as EvaluateButtonAction did before the table
+// replaced it; that chain is kept below as it was.
+//
+// Chords fire in any order since they were compiled into rules: Power
+// pressed while VolumeUp or VolumeDown is held completes the chord as well,
+// where the chain reported nothing. Those entries are counted apart and
+// must be exactly the ones the chain left alone with both keys held. A
+// second device checks that chords set in the registry replace the built-in
+// ones. Build and run on any host with
+//
+//   cc -O2 -pthread -I../wdk -I../../include -o action-table action_table.c ../wdk/framework.c ../../src/*.c && ./action-table
+//
+// The program exits with 1 if any check fails.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <internal.h>
+#include <action.h>
+#include <standin.h>
+
+DRIVER_INITIALIZE DriverEntry;
+
+typedef struct
+{
+    ULONG ReportCount;
+    BTN_REPORT Reports[BTN_TRANSITION_MAX_REPORTS];
+    BOOLEAN IgnoreButtonPresses;
+} outcome;
+
+static void add(outcome* Outcome, BTN_REPORT Report)
+{
+    if (Outcome->ReportCount < BTN_TRANSITION_MAX_REPORTS)
+    {
+        Outcome->Reports[Outcome->ReportCount] = Report;
+    }
+
+    Outcome->ReportCount++;
+}
+
+//
+// EvaluateButtonAction as of the baseline, SendReport replaced by add and
+// the device context's button states by the mask
+//
+static void chain(BOOLEAN IgnoreButtonPresses, ULONG Mask, BUTTON_TYPE ButtonType, outcome* Outcome)
+{
+    BTN_REPORT hidReportFromDriver = { 0 };
+    BOOLEAN StatePower = BUTTON_PRESSED(Mask, Power);
+    BOOLEAN StateVolumeUp = BUTTON_PRESSED(Mask, VolumeUp);
+    BOOLEAN StateVolumeDown = BUTTON_PRESSED(Mask, VolumeDown);
+    BOOLEAN StateCameraFocus = BUTTON_PRESSED(Mask, CameraFocus);
+    BOOLEAN StateCamera = BUTTON_PRESSED(Mask, Camera);
+    BOOLEAN StateSlider = BUTTON_PRESSED(Mask, Slider);
+
+    int RelevantButtonActiveCount = (int)StateCamera + (int)StateCameraFocus +
+                                    (int)StatePower +
+                                    (int)StateVolumeUp + (int)StateVolumeDown;
+
+    memset(Outcome, 0, sizeof(*Outcome));
+    Outcome->IgnoreButtonPresses = IgnoreButtonPresses;
+
+    if (RelevantButtonActiveCount <= 2)
+    {
+        if (StatePower && StateVolumeUp && ButtonType == VolumeUp)
+        {
+            hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
+            hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStatePressed;
+            hidReportFromDriver.KeysData.Keyboard.F15 = ButtonStatePressed;
+            add(Outcome, hidReportFromDriver);
+
+            hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStateUnpressed;
+            hidReportFromDriver.KeysData.Keyboard.F15 = ButtonStateUnpressed;
+            add(Outcome, hidReportFromDriver);
+
+            Outcome->IgnoreButtonPresses = TRUE;
+        }
+        else if (StatePower && StateVolumeDown && ButtonType == VolumeDown)
+        {
+            hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
+            hidReportFromDriver.KeysData.Keyboard.LeftCtrl = ButtonStatePressed;
+            hidReportFromDriver.KeysData.Keyboard.LeftAlt = ButtonStatePressed;
+            hidReportFromDriver.KeysData.Keyboard.Del = ButtonStatePressed;
+            add(Outcome, hidReportFromDriver);
+
+            hidReportFromDriver.KeysData.Keyboard.LeftCtrl = ButtonStateUnpressed;
+            hidReportFromDriver.KeysData.Keyboard.LeftAlt = ButtonStateUnpressed;
+            hidReportFromDriver.KeysData.Keyboard.Del = ButtonStateUnpressed;
+            add(Outcome, hidReportFromDriver);
+
+            Outcome->IgnoreButtonPresses = TRUE;
+        }
+        else if (RelevantButtonActiveCount <= 1)
+        {
+            if (ButtonType == Power && !StatePower && !IgnoreButtonPresses)
+            {
+                hidReportFromDriver.ReportID = REPORTID_CAPKEY_CONTROL;
+                hidReportFromDriver.KeysData.Control.SystemPowerDown = ButtonStatePressed;
+                add(Outcome, hidReportFromDriver);
+
+                hidReportFromDriver.KeysData.Control.SystemPowerDown = ButtonStateUnpressed;
+                add(Outcome, hidReportFromDriver);
+            }
+
+            if (ButtonType == VolumeUp && !IgnoreButtonPresses)
+            {
+                hidReportFromDriver.ReportID = REPORTID_CAPKEY_CONSUMER;
+                hidReportFromDriver.KeysData.Consumer.VolumeUp = StateVolumeUp;
+                add(Outcome, hidReportFromDriver);
+            }
+
+            if (ButtonType == VolumeDown && !IgnoreButtonPresses)
+            {
+                hidReportFromDriver.ReportID = REPORTID_CAPKEY_CONSUMER;
+                hidReportFromDriver.KeysData.Consumer.VolumeDown = StateVolumeDown;
+                add(Outcome, hidReportFromDriver);
+            }
+
+            if (ButtonType == CameraFocus && !IgnoreButtonPresses)
+            {
+                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
+                hidReportFromDriver.KeysData.Keyboard.LeftWin = StateCameraFocus;
+                add(Outcome, hidReportFromDriver);
+            }
+
+            if (ButtonType == Camera && !IgnoreButtonPresses)
+            {
+                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
+                hidReportFromDriver.KeysData.Keyboard.LeftWin = StateCamera;
+                add(Outcome, hidReportFromDriver);
+            }
+
+            if (StateSlider && ButtonType == Slider)
+            {
+                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
+                hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStatePressed;
+                hidReportFromDriver.KeysData.Keyboard.F14 = ButtonStatePressed;
+                add(Outcome, hidReportFromDriver);
+
+                hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStateUnpressed;
+                hidReportFromDriver.KeysData.Keyboard.F14 = ButtonStateUnpressed;
+                add(Outcome, hidReportFromDriver);
+            }
+            else if (!StateSlider && ButtonType == Slider)
+            {
+                hidReportFromDriver.ReportID = REPORTID_CAPKEY_KEYBOARD;
+                hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStatePressed;
+                hidReportFromDriver.KeysData.Keyboard.F14 = ButtonStatePressed;
+                add(Outcome, hidReportFromDriver);
+
+                hidReportFromDriver.KeysData.Keyboard.LeftWin = ButtonStateUnpressed;
+                hidReportFromDriver.KeysData.Keyboard.F14 = ButtonStateUnpressed;
+                add(Outcome, hidReportFromDriver);
+            }
+        }
+    }
+
+    if (RelevantButtonActiveCount == 0)
+    {
+        Outcome->IgnoreButtonPresses = FALSE;
+    }
+}
+
+//
+// What the driver does with the edge: the table entry, unless the press
+// completes a chord, see BtnChordOnTransition. Returns the chord, or -1.
+//
+static long table(PDEVICE_EXTENSION devContext, BOOLEAN IgnoreButtonPresses, ULONG Mask, BUTTON_TYPE ButtonType, outcome* Outcome)
+{
+    const BTN_TRANSITION* transition = &devContext->Transitions[BTN_TRANSITION_INDEX(IgnoreButtonPresses, Mask, ButtonType)];
+    long chord = -1;
+
+    if ((BUTTON_BIT(ButtonType) & BUTTON_MASK_KEYS) != 0 && BUTTON_PRESSED(Mask, ButtonType))
+    {
+        chord = BtnRuleMatch(&devContext->ChordRules, Mask & BUTTON_MASK_KEYS, ButtonType).Complete;
+    }
+
+    if (chord >= 0)
+    {
+        transition = &devContext->ChordPress[chord];
+    }
+
+    memset(Outcome, 0, sizeof(*Outcome));
+    Outcome->ReportCount = transition->ReportCount;
+    Outcome->IgnoreButtonPresses = transition->IgnoreButtonPresses;
+    memcpy(Outcome->Reports, transition->Reports, sizeof(Outcome->Reports));
+
+    return chord;
+}
+
+static BOOLEAN same(const outcome* A, const outcome* B)
+{
+    if (A->ReportCount != B->ReportCount || A->IgnoreButtonPresses != B->IgnoreButtonPresses)
+    {
+        return FALSE;
+    }
+
+    for (ULONG i = 0; i < A->ReportCount && i < BTN_TRANSITION_MAX_REPORTS; i++)
+    {
+        if (A->Reports[i].ReportID != B->Reports[i].ReportID ||
+            A->Reports[i].KeysData.Raw != B->Reports[i].KeysData.Raw)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void print(const char* what, const outcome* Outcome)
+{
+    printf("  %-6s ignore %u, %lu reports", what, Outcome->IgnoreButtonPresses, (unsigned long)Outcome->ReportCount);
+
+    for (ULONG i = 0; i < Outcome->ReportCount && i < BTN_TRANSITION_MAX_REPORTS; i++)
+    {
+        printf(" %02X:%02X", Outcome->Reports[i].ReportID, Outcome->Reports[i].KeysData.Raw);
+    }
+
+    printf("\n");
+}
+
+int main(void)
+{
+    WDFDEVICE device;
+    PDEVICE_EXTENSION devContext;
+    unsigned long entries = 0;
+    unsigned long reporting = 0;
+    unsigned long chords = 0;
+    unsigned long anyOrder = 0;
+    unsigned long failures = 0;
+
+    device = StandInAddDevice(DriverEntry);
+    if (device == NULL || !NT_SUCCESS(StandInStartDevice(device, ButtonCount, TRUE)))
+    {
+        fprintf(stderr, "Device failed to start\n");
+        return 1;
+    }
+
+    devContext = GetDeviceContext(device);
+
+    for (ULONG ignore = 0; ignore < 2; ignore++)
+    {
+        for (ULONG mask = 0; mask <= BUTTON_MASK_ALL; mask++)
+        {
+            for (ULONG button = 0; button < ButtonCount; button++)
+            {
+                outcome expected;
+                outcome actual;
+                long chord;
+
+                chain((BOOLEAN)ignore, mask, (BUTTON_TYPE)button, &expected);
+                chord = table(devContext, (BOOLEAN)ignore, mask, (BUTTON_TYPE)button, &actual);
+
+                entries++;
+                reporting += actual.ReportCount != 0;
+                chords += chord >= 0;
+
+                if (same(&expected, &actual))
+                {
+                    continue;
+                }
+
+                //
+                // A chord completed by Power, the chain only fired on the
+                // volume key going down last
+                //
+                if (chord >= 0 &&
+                    button == Power &&
+                    expected.ReportCount == 0 &&
+                    expected.IgnoreButtonPresses == (BOOLEAN)ignore)
+                {
+                    anyOrder++;
+                    continue;
+                }
+
+                printf("ignore %lu, mask 0x%02lx, %s %s:\n",
+                    (unsigned long)ignore,
+                    (unsigned long)mask,
+                    gButtonDescriptors[button].Name,
+                    BUTTON_PRESSED(mask, button) ? "pressed" : "released");
+                print("chain", &expected);
+                print("table", &actual);
+                failures++;
+            }
+        }
+    }
+
+    //
+    // Chords set by the SKU replace the built-in ones, invalid ones are
+    // dropped
+    //
+    StandInSetRegistryValue(L"Chord0", BTN_CHORD_VALUE(BUTTON_BIT(VolumeUp) | BUTTON_BIT(VolumeDown), ActionChordPowerVolumeUp, 50));
+    StandInSetRegistryValue(L"Chord1", BTN_CHORD_VALUE(BUTTON_BIT(Power), ActionChordPowerVolumeDown, 50));
+
+    device = StandInAddDevice(DriverEntry);
+    if (device == NULL || !NT_SUCCESS(StandInStartDevice(device, ButtonCount, TRUE)))
+    {
+        fprintf(stderr, "Device with registry chords failed to start\n");
+        return 1;
+    }
+
+    devContext = GetDeviceContext(device);
+
+    {
+        outcome actual;
+
+        if (devContext->ChordCount != 1 ||
+            devContext->ChordTolerancesMs[0] != 50 ||
+            table(devContext, FALSE, BUTTON_BIT(VolumeUp) | BUTTON_BIT(VolumeDown), VolumeDown, &actual) != 0 ||
+            table(devContext, FALSE, BUTTON_BIT(Power) | BUTTON_BIT(VolumeUp), VolumeUp, &actual) != -1)
+        {
+            printf("registry chords not loaded\n");
+            failures++;
+        }
+    }
+
+    printf("entries compared                %lu\n", entries);
+    printf("entries sending reports         %lu\n", reporting);
+    printf("presses completing a chord      %lu\n", chords);
+    printf("chords completed by Power       %lu\n", anyOrder);
+    printf("failed checks                   %lu\n", failures);
+
+    return failures != 0;
+}
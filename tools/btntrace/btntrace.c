@@ -0,0 +1,147 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Offline decoder for the driver's binary trace ring.
+//
+// Input is the raw REPORTID_TRACE feature report as returned by
+// HidD_GetFeature: one report ID byte, the latest sequence number, then
+// BTN_TRACE_RING_SIZE records. Build on any host with
+//
+//   cc -O2 -I../../include -o btntrace btntrace.c
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btnevents.h"
+
+#define REPORTID_TRACE      9
+#define TRACE_RING_SIZE     128
+
+#pragma pack(push, 1)
+typedef struct
+{
+    uint32_t Sequence;
+    uint16_t EventId;
+    uint16_t Reserved;
+    uint64_t Timestamp;
+    uint32_t Arg1;
+    uint32_t Arg2;
+} trace_record;
+
+typedef struct
+{
+    uint8_t ReportID;
+    uint32_t Sequence;
+    trace_record Records[TRACE_RING_SIZE];
+} trace_report;
+#pragma pack(pop)
+
+_Static_assert(sizeof(trace_record) == 24, "record layout must match BTN_TRACE_RECORD");
+
+#define EVENT_NAME_ENTRY(Name, Format) #Name,
+#define EVENT_FORMAT_ENTRY(Name, Format) Format,
+
+static const char* const event_names[] = { BTN_EVENT_LIST(EVENT_NAME_ENTRY) };
+static const char* const event_formats[] = { BTN_EVENT_LIST(EVENT_FORMAT_ENTRY) };
+
+#define EVENT_COUNT (sizeof(event_names) / sizeof(event_names[0]))
+
+static int compare_sequence(const void* a, const void* b)
+{
+    const trace_record* ra = a;
+    const trace_record* rb = b;
+
+    // Sequence numbers wrap, compare by signed distance
+    return (int32_t)(ra->Sequence - rb->Sequence) < 0 ? -1 :
+           (int32_t)(ra->Sequence - rb->Sequence) > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    trace_report report;
+    trace_record records[TRACE_RING_SIZE];
+    size_t count = 0;
+    size_t torn = 0;
+    FILE* file;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <trace feature report>\n", argv[0]);
+        return 2;
+    }
+
+    file = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "rb");
+    if (file == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    if (fread(&report, sizeof(report), 1, file) != 1)
+    {
+        fprintf(stderr, "%s: expected %zu bytes\n", argv[1], sizeof(report));
+        return 1;
+    }
+
+    if (report.ReportID != REPORTID_TRACE)
+    {
+        fprintf(stderr, "%s: report ID %u is not a trace report\n", argv[1], report.ReportID);
+        return 1;
+    }
+
+    //
+    // Keep records that were complete when the report was taken: a record
+    // being written has sequence 0, one overwritten mid-copy lands in a slot
+    // that does not match its sequence.
+    //
+    for (size_t slot = 0; slot < TRACE_RING_SIZE; slot++)
+    {
+        const trace_record* record = &report.Records[slot];
+
+        if (record->Sequence == 0)
+        {
+            continue;
+        }
+
+        if ((record->Sequence & (TRACE_RING_SIZE - 1)) != slot ||
+            (int32_t)(report.Sequence - record->Sequence) < 0)
+        {
+            torn++;
+            continue;
+        }
+
+        records[count++] = *record;
+    }
+
+    qsort(records, count, sizeof(trace_record), compare_sequence);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const trace_record* record = &records[i];
+        double offset = (double)(record->Timestamp - records[0].Timestamp) / 10.0;
+
+        printf("%10u %12.1fus  ", record->Sequence, offset);
+
+        if (record->EventId < EVENT_COUNT)
+        {
+            printf("%-18s ", event_names[record->EventId]);
+            printf(event_formats[record->EventId], record->Arg1, record->Arg2);
+        }
+        else
+        {
+            printf("%-18s 0x%08x 0x%08x", "Unknown", record->Arg1, record->Arg2);
+        }
+
+        putchar('\n');
+    }
+
+    if (torn != 0)
+    {
+        fprintf(stderr, "%zu records torn by concurrent writers were skipped\n", torn);
+    }
+
+    return 0;
+}
@@ -0,0 +1,536 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Button presses racing the D0 entry sequence.
+//
+// Builds the whole driver against the stand-in framework in ../wdk. Every
+// trial puts the device through one D3 exit and D0 entry while a few
+// buttons are pressed and released around it: edges before the framework
+// enables the interrupts find the device in D3 and at most wake it, edges
+// between then and OnD0EntryPostInterruptsEnabled arrive before the device
+// is ready and are held back by HandleButtonPress, later ones are reported
+// as usual. One in ten entries is slow enough for held back edges to go
+// stale. A worker thread runs the work items and timers the way the
+// framework's worker threads do, so drains and debounce deadlines race the
+// D0 entry, BtnReplayEarlyEdges and the level reconciliation that follows.
+// Every other trial, the drain of the last edge before the device is ready
+// is held up in its level read until it is, so that it hands its edges to
+// HandleButtonPress while held back ones still wait to be replayed.
+//
+// What the driver reported is read back from the trace feature report,
+// one ButtonState record per reported press or release. Every trial must
+// end with the reported state matching the buttons, report no more
+// presses than were made and report every press made after the interrupts
+// were enabled that is not stale; only presses pushed out of a full ring
+// may go missing. The program exits with 1 if any trial fails. Build and
+// run on any host with
+//
+//   cc -O2 -pthread -I../wdk -I../../include -o d0-race-sim d0_race_sim.c ../wdk/framework.c ../../src/*.c && ./d0-race-sim [trials]
+//
+// Times are in 100ns units, like interrupt time.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <internal.h>
+#include <standin.h>
+
+#define BUTTONS             3       // Power, VolumeUp and VolumeDown
+#define MAX_EVENTS          (BUTTONS * 12)
+#define MS                  10000ull
+#define SETTLE              (200 * MS)  // Past debouncing and chord tolerance
+
+DRIVER_INITIALIZE DriverEntry;
+
+typedef struct
+{
+    unsigned long long Time;
+    unsigned char Button;
+    unsigned char Pressed;
+} event;
+
+typedef struct
+{
+    event Events[MAX_EVENTS];
+    unsigned long Count;
+    unsigned long long Enable;      // Interrupts enabled
+    unsigned long long Ready;       // OnD0EntryPostInterruptsEnabled
+    unsigned long long End;
+    unsigned int HeldBefore;        // Buttons held, and reported, before D3
+} trial;
+
+typedef struct
+{
+    unsigned long Trials;
+    unsigned long Failed;
+    unsigned long StuckKeys;
+    unsigned long PressesExpected;
+    unsigned long PressesMissed;
+    unsigned long Phantom;
+    unsigned long EdgesHeld;
+    unsigned long EdgesDropped;
+} totals;
+
+//
+// What the trace says the driver did since the last reset
+//
+typedef struct
+{
+    unsigned long Presses[BUTTONS];
+    unsigned long Held;
+    unsigned long Dropped;
+    unsigned long DroppedFresh;
+    int Wrapped;
+} observed;
+
+static WDFDEVICE device;
+static PDEVICE_EXTENSION devContext;
+static volatile int stop;
+static ULONG trace_sequence;
+static observed seen;
+static const trial* current;
+static unsigned long long base;
+static unsigned long next_event;
+static volatile int stall;
+
+static unsigned long long rng_state = 1;
+
+static unsigned long rng(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned long)((rng_state * 2685821657736338717ull) >> 33);
+}
+
+static unsigned long long uniform(unsigned long long low, unsigned long long high)
+{
+    return low + rng() % (high - low + 1);
+}
+
+static int compare_event(const void* a, const void* b)
+{
+    const event* ea = a;
+    const event* eb = b;
+
+    return ea->Time < eb->Time ? -1 : ea->Time > eb->Time ? 1 : 0;
+}
+
+static void generate(trial* t)
+{
+    const unsigned long long d0 = 1000 * MS;
+
+    memset(t, 0, sizeof(*t));
+
+    t->Enable = d0 + uniform(5 * MS, 50 * MS);
+    t->Ready = t->Enable + uniform(1 * MS, 300 * MS);
+
+    // Now and then a slow D0 entry, long enough for edges to go stale
+    if (rng() % 10 == 0)
+    {
+        t->Ready += uniform(700 * MS, 1500 * MS);
+    }
+
+    for (unsigned char button = 0; button < BUTTONS; button++)
+    {
+        unsigned long long time = d0 - uniform(0, 400 * MS);
+        unsigned long presses = rng() % 6;
+
+        // Sometimes held since before the device went to D3
+        if (rng() % 6 == 0)
+        {
+            t->HeldBefore |= 1u << button;
+            time = d0 + uniform(0, 600 * MS);
+            t->Events[t->Count++] = (event){ time, button, 0 };
+            time += uniform(40 * MS, 200 * MS);
+        }
+
+        for (unsigned long p = 0; p < presses; p++)
+        {
+            t->Events[t->Count++] = (event){ time, button, 1 };
+            time += uniform(40 * MS, 400 * MS);
+
+            // The last press may still be held at the end
+            if (p + 1 < presses || rng() % 5 != 0)
+            {
+                t->Events[t->Count++] = (event){ time, button, 0 };
+            }
+
+            time += uniform(40 * MS, 300 * MS);
+        }
+    }
+
+    qsort(t->Events, t->Count, sizeof(event), compare_event);
+
+    t->End = t->Count != 0 && t->Events[t->Count - 1].Time > t->Ready ? t->Events[t->Count - 1].Time : t->Ready;
+}
+
+static unsigned int levels_at(const trial* t, unsigned long long time)
+{
+    unsigned int levels = t->HeldBefore;
+
+    for (unsigned long i = 0; i < t->Count && t->Events[i].Time <= time; i++)
+    {
+        levels = (levels & ~(1u << t->Events[i].Button)) | ((unsigned int)t->Events[i].Pressed << t->Events[i].Button);
+    }
+
+    return levels;
+}
+
+static void* worker(void* context)
+{
+    (void)context;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_SEQ_CST))
+    {
+        if (StandInRunWorkItems() == 0 && StandInRunTimers() == 0)
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void quiesce(void)
+{
+    while (!StandInQuiet())
+    {
+        sched_yield();
+    }
+}
+
+//
+// Picks up the trace records written since the last call from the trace
+// feature report
+//
+static void read_trace(void)
+{
+    static BTN_TRACE_FEATURE_REPORT report;
+    HID_XFER_PACKET packet = { (PUCHAR)&report, sizeof(report), REPORTID_TRACE };
+    WDFREQUEST request = StandInCreateRequest(IOCTL_HID_GET_FEATURE, NULL, 0, &packet, sizeof(packet));
+    NTSTATUS status;
+
+    report.ReportID = REPORTID_TRACE;
+
+    StandInDispatch(device, request);
+
+    if (StandInCompleted(request, &status, NULL) != 1 || !NT_SUCCESS(status))
+    {
+        seen.Wrapped = 1;
+        StandInDeleteRequest(request);
+        return;
+    }
+
+    StandInDeleteRequest(request);
+
+    if (report.Sequence - trace_sequence > BTN_TRACE_RING_SIZE)
+    {
+        seen.Wrapped = 1;
+    }
+
+    for (ULONG sequence = trace_sequence + 1; sequence != report.Sequence + 1; sequence++)
+    {
+        const BTN_TRACE_RECORD* record = &report.Records[sequence & (BTN_TRACE_RING_SIZE - 1)];
+
+        if ((ULONG)record->Sequence != sequence)
+        {
+            continue;
+        }
+
+        switch (record->EventId)
+        {
+        case BtnEventButtonState:
+            if (record->Arg1 < BUTTONS && (record->Arg2 & BUTTON_BIT(record->Arg1)) != 0)
+            {
+                seen.Presses[record->Arg1]++;
+            }
+            break;
+
+        case BtnEventEdgeHeldUntilReady:
+            seen.Held++;
+            break;
+
+        case BtnEventEarlyEdgeDropped:
+            seen.Dropped++;
+            seen.DroppedFresh += record->Arg2 <= BTN_EARLY_MAX_AGE_MS;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    trace_sequence = report.Sequence;
+}
+
+//
+// Lines are active low
+//
+static void set_level(BUTTON_TYPE button, BOOLEAN pressed)
+{
+    if (pressed)
+    {
+        __atomic_and_fetch(&StandInPins, ~BUTTON_BIT(button), __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        __atomic_or_fetch(&StandInPins, BUTTON_BIT(button), __ATOMIC_SEQ_CST);
+    }
+
+    StandInInterrupt(device, button);
+}
+
+static void advance_to(unsigned long long time)
+{
+    if (base + time > StandInTime)
+    {
+        StandInAdvance(base + time - StandInTime);
+    }
+}
+
+//
+// An armed stall holds up the next level read, on the worker's drain,
+// until released
+//
+static VOID level_read(VOID)
+{
+    int armed = 1;
+
+    if (__atomic_compare_exchange_n(&stall, &armed, 2, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    {
+        while (__atomic_load_n(&stall, __ATOMIC_SEQ_CST) == 2)
+        {
+            sched_yield();
+        }
+    }
+}
+
+//
+// Plays the events of the current trial up to Until, racing the worker.
+// With StallLast the drain of the last one is left stalled.
+//
+static void play(unsigned long long until, int stallLast)
+{
+    for (; next_event < current->Count && current->Events[next_event].Time < until; next_event++)
+    {
+        const event* e = &current->Events[next_event];
+        int last = next_event + 1 == current->Count || current->Events[next_event + 1].Time >= until;
+
+        advance_to(e->Time);
+
+        if (stallLast && last)
+        {
+            __atomic_store_n(&stall, 1, __ATOMIC_SEQ_CST);
+            set_level((BUTTON_TYPE)e->Button, e->Pressed);
+
+            while (__atomic_load_n(&stall, __ATOMIC_SEQ_CST) != 2)
+            {
+                sched_yield();
+            }
+
+            break;
+        }
+
+        set_level((BUTTON_TYPE)e->Button, e->Pressed);
+        sched_yield();
+        read_trace();
+    }
+
+    advance_to(until);
+}
+
+//
+// Between the interrupts being enabled and the device being ready. Every
+// other trial, the drain of the last edge in between only goes on once the
+// device is ready, so that it runs into BtnReplayEarlyEdges.
+//
+static void interrupts_enabled(WDFDEVICE Device)
+{
+    (void)Device;
+
+    play(current->Ready, rng() % 2 == 0);
+}
+
+static void run(const trial* t, totals* totals)
+{
+    unsigned int held;
+    unsigned long expected[BUTTONS] = { 0 };
+    unsigned long made[BUTTONS] = { 0 };
+    unsigned long missed = 0;
+    int failed = 0;
+
+    //
+    // Before D3, the buttons held then have been reported
+    //
+    for (ULONG button = 0; button < BUTTONS; button++)
+    {
+        if (t->HeldBefore & (1u << button))
+        {
+            set_level((BUTTON_TYPE)button, TRUE);
+        }
+    }
+
+    StandInAdvance(SETTLE);
+    quiesce();
+    read_trace();
+
+    if ((ULONG)ReadNoFence(&devContext->ButtonMask) != t->HeldBefore)
+    {
+        failed = 1;
+    }
+
+    memset(&seen, 0, sizeof(seen));
+    current = t;
+    next_event = 0;
+    base = StandInTime;
+
+    StandInPowerDown(device, WdfPowerDeviceD3);
+
+    play(t->Enable, 0);
+    StandInPowerUp(device);
+
+    if (__atomic_load_n(&stall, __ATOMIC_SEQ_CST) == 2)
+    {
+        next_event++;
+        __atomic_store_n(&stall, 0, __ATOMIC_SEQ_CST);
+    }
+
+    //
+    // The post interrupts enabled callback drains unless the worker is,
+    // then the worker replays the held back edges. Either way at Ready.
+    //
+    while (ReadAcquire(&devContext->ResyncRequested))
+    {
+        sched_yield();
+    }
+
+    play(t->End + 1, 0);
+
+    StandInAdvance(SETTLE);
+    quiesce();
+    read_trace();
+
+    if ((ULONG)ReadNoFence(&devContext->ButtonMask) != levels_at(t, t->End))
+    {
+        totals->StuckKeys++;
+        failed = 1;
+    }
+
+    for (unsigned long i = 0; i < t->Count; i++)
+    {
+        const event* e = &t->Events[i];
+
+        if (!e->Pressed)
+        {
+            continue;
+        }
+
+        made[e->Button]++;
+
+        if (e->Time >= t->Enable && (e->Time >= t->Ready || t->Ready - e->Time <= BTN_EARLY_MAX_AGE_MS * MS))
+        {
+            expected[e->Button]++;
+        }
+    }
+
+    for (ULONG button = 0; button < BUTTONS; button++)
+    {
+        totals->PressesExpected += expected[button];
+
+        if (seen.Presses[button] < expected[button])
+        {
+            missed += expected[button] - seen.Presses[button];
+        }
+
+        if (seen.Presses[button] > made[button])
+        {
+            totals->Phantom += seen.Presses[button] - made[button];
+            failed = 1;
+        }
+    }
+
+    // A press pushed out of the full ring may be lost, nothing else
+    totals->PressesMissed += missed;
+    totals->EdgesHeld += seen.Held;
+    totals->EdgesDropped += seen.Dropped;
+
+    if (missed > seen.DroppedFresh || seen.Wrapped)
+    {
+        failed = 1;
+    }
+
+    //
+    // Let go of everything for the next trial
+    //
+    held = levels_at(t, t->End);
+
+    for (ULONG button = 0; button < BUTTONS; button++)
+    {
+        if (held & (1u << button))
+        {
+            set_level((BUTTON_TYPE)button, FALSE);
+        }
+    }
+
+    StandInAdvance(SETTLE);
+    quiesce();
+    read_trace();
+
+    totals->Trials++;
+    totals->Failed += failed;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long trials = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    pthread_t thread;
+    totals totals;
+    trial t;
+
+    memset(&totals, 0, sizeof(totals));
+
+    // Keys may stay held across many trials' worth of virtual time
+    StandInSetRegistryValue(L"StuckButtonTimeoutS", 0);
+
+    device = StandInAddDevice(DriverEntry);
+    if (device == NULL || !NT_SUCCESS(StandInStartDevice(device, BUTTONS, TRUE)))
+    {
+        fprintf(stderr, "Device failed to start\n");
+        return 1;
+    }
+
+    devContext = GetDeviceContext(device);
+    StandInInterruptsEnabledHook = interrupts_enabled;
+    StandInLevelReadHook = level_read;
+
+    pthread_create(&thread, NULL, worker, NULL);
+
+    quiesce();
+    read_trace();
+
+    for (unsigned long i = 0; i < trials; i++)
+    {
+        generate(&t);
+        run(&t, &totals);
+    }
+
+    __atomic_store_n(&stop, 1, __ATOMIC_SEQ_CST);
+    pthread_join(thread, NULL);
+
+    printf("%lu trials, %d buttons, %u early edges at most, %u ms maximum age\n\n",
+        trials, BUTTONS, BTN_EARLY_EDGES, BTN_EARLY_MAX_AGE_MS);
+    printf("trials failed       %lu\n", totals.Failed);
+    printf("stuck keys          %lu\n", totals.StuckKeys);
+    printf("presses missed      %lu/%lu\n", totals.PressesMissed, totals.PressesExpected);
+    printf("phantom presses     %lu\n", totals.Phantom);
+    printf("edges held back     %lu\n", totals.EdgesHeld);
+    printf("edges dropped       %lu\n", totals.EdgesDropped);
+
+    return totals.Failed != 0;
+}
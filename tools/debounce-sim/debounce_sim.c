@@ -0,0 +1,287 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Host simulator for the self-tuning debounce.
+//
+// Replays edge traces through the driver's debounce rules twice, once with
+// the window fixed at its upper bound and once tuned by BtnTuneWindowUs,
+// and reports how long tuning takes to converge and how much settle
+// latency it saves. Build on any host with
+//
+//   cc -O2 -I../../include -o debounce-sim debounce_sim.c
+//
+// A trace is a text file with one edge time in microseconds per line, '#'
+// starts a comment. Traces recorded on a device can be extracted from the
+// trace feature report, e.g. for VolumeUp (button 1):
+//
+//   ./btntrace report.bin | awk '$3 == "Interrupt" && $5 == "1:" { sub("us", "", $2); print $2 }'
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btntune.h"
+
+typedef struct
+{
+    // Configuration
+    int Adaptive;
+    unsigned long MinimumUs;
+    unsigned long MaximumUs;
+
+    // Debounce state, mirrors BUTTON_LINE
+    unsigned long WindowUs;
+    unsigned long long QuietUntil;
+    unsigned long long LastEdge;
+    int RawPressed;
+    int LogicalPressed;
+    unsigned long Intervals[BTN_TUNE_BUCKETS];
+    unsigned long EdgesSinceTuning;
+
+    // Results
+    unsigned long Transitions;
+    unsigned long Settled;
+    unsigned long long DivergedAt;
+    unsigned long long SettleLatencyUs;
+    unsigned long long MaxSettleLatencyUs;
+    unsigned long long LastTuneChange;
+    unsigned long TransitionsAtLastChange;
+} debouncer;
+
+static unsigned long duration_bucket(unsigned long long us)
+{
+    unsigned long bucket = 0;
+
+    while (us != 0 && bucket < BTN_TUNE_BUCKETS - 1)
+    {
+        us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static void accept(debouncer* d)
+{
+    d->LogicalPressed = !d->LogicalPressed;
+    d->Transitions++;
+}
+
+static void settle(debouncer* d, unsigned long long now)
+{
+    unsigned long long latency;
+
+    if (d->RawPressed == d->LogicalPressed || now < d->QuietUntil)
+    {
+        return;
+    }
+
+    // The deadline timer fires at QuietUntil
+    latency = d->QuietUntil - d->DivergedAt;
+
+    accept(d);
+    d->Settled++;
+    d->SettleLatencyUs += latency;
+    if (latency > d->MaxSettleLatencyUs)
+    {
+        d->MaxSettleLatencyUs = latency;
+    }
+}
+
+static void tune(debouncer* d, unsigned long long now)
+{
+    unsigned long samples = 0;
+    unsigned long window;
+
+    d->EdgesSinceTuning = 0;
+
+    for (unsigned long bucket = 0; bucket < BTN_TUNE_BUCKETS; bucket++)
+    {
+        samples += d->Intervals[bucket];
+    }
+
+    window = BtnTuneWindowUs(d->Intervals, d->MinimumUs, d->MaximumUs);
+
+    if (window != 0 && window != d->WindowUs)
+    {
+        d->WindowUs = window;
+        d->LastTuneChange = now;
+        d->TransitionsAtLastChange = d->Transitions;
+    }
+
+    if (samples > BTN_TUNE_AGE_SAMPLES)
+    {
+        for (unsigned long bucket = 0; bucket < BTN_TUNE_BUCKETS; bucket++)
+        {
+            d->Intervals[bucket] -= d->Intervals[bucket] / 2;
+        }
+    }
+}
+
+static void edge(debouncer* d, unsigned long long now)
+{
+    int wasDiverged;
+
+    if (d->LastEdge != 0 && now > d->LastEdge)
+    {
+        d->Intervals[duration_bucket(now - d->LastEdge)]++;
+    }
+
+    // Same order as BtnDebounceEdges with one edge per batch
+    settle(d, now);
+
+    wasDiverged = d->RawPressed != d->LogicalPressed;
+    d->RawPressed = !d->RawPressed;
+
+    if (now >= d->QuietUntil)
+    {
+        accept(d);
+    }
+
+    if (d->RawPressed != d->LogicalPressed && !wasDiverged)
+    {
+        d->DivergedAt = now;
+    }
+
+    d->LastEdge = now;
+    d->QuietUntil = now + d->WindowUs;
+
+    if (d->Adaptive && ++d->EdgesSinceTuning >= BTN_TUNE_PERIOD)
+    {
+        tune(d, now);
+    }
+}
+
+static void init(debouncer* d, int adaptive, unsigned long minimumUs, unsigned long maximumUs)
+{
+    memset(d, 0, sizeof(*d));
+    d->Adaptive = adaptive;
+    d->MinimumUs = minimumUs;
+    d->MaximumUs = maximumUs;
+    d->WindowUs = maximumUs;
+}
+
+static int run(const char* path, unsigned long minimumUs, unsigned long maximumUs)
+{
+    debouncer fixed;
+    debouncer adaptive;
+    unsigned long long first = 0;
+    unsigned long long time = 0;
+    unsigned long edges = 0;
+    char line[256];
+    FILE* file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    init(&fixed, 0, minimumUs, maximumUs);
+    init(&adaptive, 1, minimumUs, maximumUs);
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char* end;
+        unsigned long long value;
+
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        value = strtoull(line, &end, 10);
+        if (end == line)
+        {
+            continue;
+        }
+
+        if (edges == 0)
+        {
+            first = value;
+        }
+
+        time = value;
+        edges++;
+
+        edge(&fixed, time);
+        edge(&adaptive, time);
+    }
+
+    fclose(file);
+
+    // Let both lines go quiet
+    settle(&fixed, time + maximumUs);
+    settle(&adaptive, time + maximumUs);
+
+    printf("%s\n", path);
+    printf("  edges                     %lu over %.1f s\n", edges, (double)(time - first) / 1e6);
+    printf("  transitions               fixed %lu, tuned %lu\n", fixed.Transitions, adaptive.Transitions);
+    printf("  window                    fixed %lu us, tuned %lu us\n", fixed.WindowUs, adaptive.WindowUs);
+
+    if (adaptive.LastTuneChange != 0)
+    {
+        printf("  converged after           %.2f s, %lu transitions\n",
+            (double)(adaptive.LastTuneChange - first) / 1e6,
+            adaptive.TransitionsAtLastChange);
+    }
+    else
+    {
+        printf("  converged after           never, not enough bounce observed\n");
+    }
+
+    printf("  settled transitions       fixed %lu, tuned %lu\n", fixed.Settled, adaptive.Settled);
+
+    if (fixed.Settled != 0 && adaptive.Settled != 0)
+    {
+        double fixedMean = (double)fixed.SettleLatencyUs / fixed.Settled;
+        double adaptiveMean = (double)adaptive.SettleLatencyUs / adaptive.Settled;
+
+        printf("  mean settle latency       fixed %.0f us, tuned %.0f us, saved %.0f us\n",
+            fixedMean, adaptiveMean, fixedMean - adaptiveMean);
+        printf("  max settle latency        fixed %llu us, tuned %llu us\n",
+            fixed.MaxSettleLatencyUs, adaptive.MaxSettleLatencyUs);
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long minimumUs = 2000;
+    unsigned long maximumUs = 10000;
+    int arg = 1;
+    int status = 0;
+
+    while (arg + 1 < argc && argv[arg][0] == '-')
+    {
+        if (strcmp(argv[arg], "-min") == 0)
+        {
+            minimumUs = strtoul(argv[arg + 1], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "-max") == 0)
+        {
+            maximumUs = strtoul(argv[arg + 1], NULL, 10);
+        }
+        else
+        {
+            break;
+        }
+
+        arg += 2;
+    }
+
+    if (arg >= argc)
+    {
+        fprintf(stderr, "usage: %s [-min us] [-max us] trace...\n", argv[0]);
+        return 2;
+    }
+
+    for (; arg < argc; arg++)
+    {
+        status |= run(argv[arg], minimumUs, maximumUs);
+    }
+
+    return status;
+}
@@ -0,0 +1,282 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Edge accounting of the interrupt path under bursts.
+//
+// Builds the whole driver against the stand-in framework in ../wdk and
+// raises edges on every line at 10 kHz, the rate of a badly bouncing
+// contact, while two threads run the work items and timers the way the
+// framework's worker threads do. More edges are raised from within the
+// drain's level reads, after it has taken the pending edges. Every
+// interrupt must end up either drained to BtnDebounceEdges or throttled by
+// the storm budget, none may be lost between OnInterruptIsr and
+// BtnDrainPendingEdges however the drains and the ISRs interleave. The
+// drained edges are counted by wrapping BtnDebounceEdges at link time.
+//
+// Bursts of about 400 edges per line stay within the storm budget and must
+// not be throttled at all; after each one, once the lines have settled,
+// the reported state of every line must match its level. A sustained
+// storm on one line is then masked by storm protection, and its state
+// must again match the level once the line is unmasked. Build and run on
+// a host with GNU ld with
+//
+//   cc -O2 -pthread -I../wdk -I../../include -Wl,--wrap=BtnDebounceEdges -o edge-burst edge_burst.c ../wdk/framework.c ../../src/*.c && ./edge-burst [bursts]
+//
+// The program exits with 1 if any check fails.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <internal.h>
+#include <standin.h>
+
+#define LINES           ButtonCount
+#define EDGE_INTERVAL   1000                            // 100us, 10 kHz
+#define BURST_EDGES     400                             // Within BTN_STORM_BURST with those raced in
+#define BURST_GAP       BTN_MS_TO_INTERRUPT_TIME(2000)  // Refills the budget
+#define STORM_EDGES     30000
+#define STORM_GAP       BTN_MS_TO_INTERRUPT_TIME(5000)  // Past the first backoff
+
+DRIVER_INITIALIZE DriverEntry;
+
+VOID __real_BtnDebounceEdges(PDEVICE_EXTENSION, BUTTON_TYPE, ULONG, ULONGLONG, ULONGLONG);
+
+typedef struct
+{
+    unsigned long Raised;
+    unsigned long Isr;
+    unsigned long Drained;
+} line_count;
+
+static line_count counts[LINES];
+static volatile int stop;
+static volatile int bursting;
+static ULONG level_reads;
+static WDFDEVICE burst_device;
+static unsigned long failures;
+
+VOID __wrap_BtnDebounceEdges(
+    PDEVICE_EXTENSION DeviceContext,
+    BUTTON_TYPE ButtonType,
+    ULONG Edges,
+    ULONGLONG FirstEdgeTime,
+    ULONGLONG LastEdgeTime)
+{
+    __atomic_add_fetch(&counts[ButtonType].Drained, Edges, __ATOMIC_SEQ_CST);
+
+    __real_BtnDebounceEdges(DeviceContext, ButtonType, Edges, FirstEdgeTime, LastEdgeTime);
+}
+
+static void* worker(void* context)
+{
+    (void)context;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_SEQ_CST))
+    {
+        if (StandInRunWorkItems() == 0 && StandInRunTimers() == 0)
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Lines are active low, every edge flips the pin before it interrupts
+//
+static void edge(WDFDEVICE device, BUTTON_TYPE button)
+{
+    __atomic_xor_fetch(&StandInPins, BUTTON_BIT(button), __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&counts[button].Raised, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&counts[button].Isr, StandInInterrupt(device, button), __ATOMIC_SEQ_CST);
+}
+
+//
+// During bursts every other level read is raced by one more edge, on the
+// drain's own thread after it has taken the pending edges, so that the
+// drain is interrupted halfway even on a single core
+//
+static VOID level_read(VOID)
+{
+    ULONG read = __atomic_fetch_add(&level_reads, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&bursting, __ATOMIC_SEQ_CST) && read % 2 == 0)
+    {
+        edge(burst_device, (BUTTON_TYPE)(read / 2 % LINES));
+    }
+}
+
+//
+// Lets the clock run for Gap in 1ms steps, waits for the workers to catch
+// up and checks that nothing is left pending and every line reports its
+// level
+//
+static void settle(PDEVICE_EXTENSION devContext, ULONGLONG gap, const char* phase)
+{
+    for (ULONGLONG elapsed = 0; elapsed < gap; elapsed += BTN_MS_TO_INTERRUPT_TIME(1))
+    {
+        StandInAdvance(BTN_MS_TO_INTERRUPT_TIME(1));
+        sched_yield();
+    }
+
+    while (!StandInQuiet())
+    {
+        sched_yield();
+    }
+
+    if (ReadAcquire(&devContext->PendingMask) != 0)
+    {
+        fprintf(stderr, "%s: PendingMask 0x%lx left\n", phase, (unsigned long)devContext->PendingMask);
+        failures++;
+    }
+
+    for (ULONG button = 0; button < LINES; button++)
+    {
+        BOOLEAN pressed = !(StandInPins & BUTTON_BIT(button));
+
+        if (ReadAcquire(&devContext->Lines[button].PendingEdges) != 0)
+        {
+            fprintf(stderr, "%s: %s has edges pending\n", phase, gButtonDescriptors[button].Name);
+            failures++;
+        }
+
+        if (BUTTON_PRESSED(ReadAcquire(&devContext->ButtonMask), button) != (pressed ? ButtonStatePressed : ButtonStateUnpressed))
+        {
+            fprintf(stderr, "%s: %s reported %s, level is %s\n", phase, gButtonDescriptors[button].Name,
+                pressed ? "released" : "pressed", pressed ? "pressed" : "released");
+            failures++;
+        }
+    }
+}
+
+//
+// Every interrupt that reached the ISR was drained or throttled
+//
+static void account(PDEVICE_EXTENSION devContext, const char* phase, BOOLEAN withinBudget)
+{
+    printf("\n%s\n", phase);
+    printf("line          raised       isr   drained throttled    masked  filtered  reported      lost\n");
+
+    for (ULONG button = 0; button < LINES; button++)
+    {
+        const line_count* count = &counts[button];
+        LONG* counters = (LONG*)devContext->Counters[button];
+        long lost = (long)count->Isr - (long)count->Drained - counters[CounterEdgesThrottled];
+
+        printf("%-12s %7lu %9lu %9lu %9ld %9lu %9ld %9ld %9ld\n",
+            gButtonDescriptors[button].Name,
+            count->Raised,
+            count->Isr,
+            count->Drained,
+            (long)counters[CounterEdgesThrottled],
+            count->Raised - count->Isr,
+            (long)counters[CounterEdgesFiltered],
+            (long)counters[CounterTransitions],
+            lost);
+
+        if (lost != 0 || (LONG)count->Isr != counters[CounterInterrupts])
+        {
+            failures++;
+        }
+
+        if (withinBudget && (counters[CounterEdgesThrottled] != 0 || count->Raised != count->Isr))
+        {
+            failures++;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long bursts = argc > 1 ? strtoul(argv[1], NULL, 10) : 50;
+    pthread_t workers[2];
+    WDFDEVICE device;
+    PDEVICE_EXTENSION devContext;
+
+    // The storm holds the line down for longer than the default stuck timeout
+    StandInSetRegistryValue(L"StuckButtonTimeoutS", 0);
+
+    device = StandInAddDevice(DriverEntry);
+    if (device == NULL || !NT_SUCCESS(StandInStartDevice(device, LINES, TRUE)))
+    {
+        fprintf(stderr, "Device failed to start\n");
+        return 1;
+    }
+
+    devContext = GetDeviceContext(device);
+    burst_device = device;
+    StandInLevelReadHook = level_read;
+
+    for (ULONG i = 0; i < sizeof(workers) / sizeof(workers[0]); i++)
+    {
+        pthread_create(&workers[i], NULL, worker, NULL);
+    }
+
+    settle(devContext, 0, "start");
+
+    //
+    // Bursts on every line at once. Their lengths differ by one from line
+    // to line and burst to burst, so that they end pressed as often as
+    // released.
+    //
+    for (unsigned long burst = 0; burst < bursts; burst++)
+    {
+        __atomic_store_n(&bursting, 1, __ATOMIC_SEQ_CST);
+
+        for (ULONG step = 0; step < BURST_EDGES; step++)
+        {
+            StandInAdvance(EDGE_INTERVAL);
+
+            for (ULONG button = 0; button < LINES; button++)
+            {
+                if (step < BURST_EDGES - (burst + button) % 2)
+                {
+                    edge(device, (BUTTON_TYPE)button);
+                }
+            }
+
+            sched_yield();
+        }
+
+        __atomic_store_n(&bursting, 0, __ATOMIC_SEQ_CST);
+
+        settle(devContext, BURST_GAP, "burst");
+    }
+
+    account(devContext, "Bursts within the storm budget", TRUE);
+
+    //
+    // A storm on the power line only
+    //
+    for (ULONG step = 0; step < STORM_EDGES + 1; step++)
+    {
+        StandInAdvance(EDGE_INTERVAL);
+        edge(device, Power);
+        sched_yield();
+    }
+
+    settle(devContext, STORM_GAP, "storm");
+
+    account(devContext, "After a storm on the power line", FALSE);
+
+    if (devContext->Counters[Power][CounterStorms] == 0)
+    {
+        failures++;
+    }
+
+    __atomic_store_n(&stop, 1, __ATOMIC_SEQ_CST);
+
+    for (ULONG i = 0; i < sizeof(workers) / sizeof(workers[0]); i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    printf("\nfailed checks %lu\n", failures);
+
+    return failures != 0;
+}
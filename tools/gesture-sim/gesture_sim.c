@@ -0,0 +1,349 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Host benchmark for the multi-tap recognizer.
+//
+// Generates a seeded stream of human-like single presses, long presses,
+// double and triple taps and runs it through the driver's recognizer for a
+// range of tap windows. For every window it reports the delay added to
+// single presses, how often each pattern was recognized as intended and
+// the recognizer's own cost per edge. Build on any host with
+//
+//   cc -O2 -I../../include -o gesture-sim gesture_sim.c
+//
+// Deadlines are serviced -slack microseconds late, the driver's timer may
+// fire up to BTN_DEADLINE_TOLERABLE_DELAY_MS after its due time.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "btngesture.h"
+
+#define MAX_EDGES           (2 * BTN_GESTURE_MAX_TAPS)
+
+typedef struct
+{
+    unsigned long Taps;             // 1 for single and long presses
+    unsigned long Edges;
+    unsigned long long Time[MAX_EDGES];
+} pattern;
+
+typedef struct
+{
+    // Single press delays in microseconds, one per single press
+    unsigned long long* Delays;
+    unsigned long DelayCount;
+
+    // Outcome[intended taps][recognized taps], 1 when replayed
+    unsigned long Outcome[BTN_GESTURE_MAX_TAPS + 1][BTN_GESTURE_MAX_TAPS + 1];
+} results;
+
+static unsigned long long rng_state;
+
+static unsigned long rng(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned long)((rng_state * 2685821657736338717ull) >> 33);
+}
+
+static unsigned long long uniform(unsigned long long low, unsigned long long high)
+{
+    return low + rng() % (high - low + 1);
+}
+
+static pattern* generate(unsigned long count, unsigned long long seed)
+{
+    pattern* patterns = calloc(count, sizeof(pattern));
+    unsigned long long time = 1000000;
+
+    rng_state = seed != 0 ? seed : 1;
+
+    for (unsigned long i = 0; i < count; i++)
+    {
+        pattern* p = &patterns[i];
+        unsigned long kind = rng() % 10;
+
+        // 60% single presses, 10% long presses, 20% double, 10% triple taps
+        p->Taps = kind < 7 ? 1 : kind < 9 ? 2 : 3;
+
+        //
+        // Taps of a deliberate multi-tap are quicker than a lone press:
+        // 30 to 110 ms down, 40 to 140 ms up
+        //
+        for (unsigned long tap = 0; tap < p->Taps; tap++)
+        {
+            unsigned long long held =
+                kind == 6 ? uniform(400000, 1000000) :
+                p->Taps == 1 ? uniform(40000, 150000) :
+                uniform(30000, 110000);
+
+            if (tap != 0)
+            {
+                time += uniform(40000, 140000);
+            }
+
+            p->Time[p->Edges++] = time;
+            time += held;
+            p->Time[p->Edges++] = time;
+        }
+
+        time += uniform(600000, 1500000);
+    }
+
+    return patterns;
+}
+
+typedef struct
+{
+    BTN_TAP_STATE State;
+    const pattern* Pattern;
+    int Pressed;
+    results* Results;
+} recognizer;
+
+static void deliver(recognizer* r, BTN_TAP_RESULT result, unsigned long taps, unsigned long long now)
+{
+    const pattern* p = r->Pattern;
+
+    switch (result)
+    {
+    case BtnTapFire:
+        r->Results->Outcome[p->Taps][taps]++;
+        break;
+
+    case BtnTapReplay:
+        r->Results->Outcome[p->Taps][1]++;
+
+        if (p->Taps == 1)
+        {
+            r->Results->Delays[r->Results->DelayCount++] = now - p->Time[0];
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void service(recognizer* r, unsigned long long now, unsigned long long slack)
+{
+    unsigned long taps;
+    BTN_TAP_RESULT result;
+
+    // The deadline timer, if it came due before the next edge
+    if (r->State.Deadline != 0 && r->State.Deadline + slack <= now)
+    {
+        unsigned long long fired = r->State.Deadline + slack;
+
+        result = BtnTapOnDeadline(&r->State, r->Pressed, &taps);
+        deliver(r, result, taps, fired);
+    }
+}
+
+static void edge(recognizer* r, unsigned long long now, int pressed, unsigned long long window, unsigned long long slack)
+{
+    unsigned long taps;
+    BTN_TAP_RESULT result;
+
+    service(r, now, slack);
+
+    // Same order as BtnGestureOnTransition
+    if (r->State.Deadline != 0 && now >= r->State.Deadline)
+    {
+        result = BtnTapOnDeadline(&r->State, !pressed, &taps);
+        deliver(r, result, taps, now);
+    }
+
+    r->Pressed = pressed;
+
+    result = BtnTapOnEdge(&r->State, pressed, now, window, &taps);
+
+    if (result == BtnTapPass && pressed && r->Pattern->Taps == 1 && r->Pattern->Time[0] == now)
+    {
+        r->Results->Delays[r->Results->DelayCount++] = 0;
+    }
+
+    deliver(r, result, taps, now);
+}
+
+static int compare_delay(const void* a, const void* b)
+{
+    unsigned long long da = *(const unsigned long long*)a;
+    unsigned long long db = *(const unsigned long long*)b;
+
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+static void run(const pattern* patterns, unsigned long count, unsigned char tapMask, unsigned long long windowUs, unsigned long long slackUs)
+{
+    recognizer r;
+    results res;
+    unsigned long long sum = 0;
+    unsigned long long last = 0;
+
+    memset(&r, 0, sizeof(r));
+    memset(&res, 0, sizeof(res));
+
+    res.Delays = calloc(count, sizeof(unsigned long long));
+    r.State.TapMask = tapMask;
+    r.Results = &res;
+
+    for (unsigned long i = 0; i < count; i++)
+    {
+        r.Pattern = &patterns[i];
+
+        for (unsigned long e = 0; e < patterns[i].Edges; e++)
+        {
+            edge(&r, patterns[i].Time[e], (e & 1) == 0, windowUs, slackUs);
+            last = patterns[i].Time[e];
+        }
+
+        // Let the pattern run out before the next one starts
+        service(&r, last + windowUs + slackUs, slackUs);
+    }
+
+    qsort(res.Delays, res.DelayCount, sizeof(unsigned long long), compare_delay);
+
+    for (unsigned long i = 0; i < res.DelayCount; i++)
+    {
+        sum += res.Delays[i];
+    }
+
+    printf("%8llu ms %9.1f %9llu %9llu %9llu",
+        windowUs / 1000,
+        res.DelayCount != 0 ? (double)sum / res.DelayCount / 1000.0 : 0.0,
+        res.DelayCount != 0 ? res.Delays[res.DelayCount / 2] / 1000 : 0,
+        res.DelayCount != 0 ? res.Delays[res.DelayCount * 99 / 100] / 1000 : 0,
+        res.DelayCount != 0 ? res.Delays[res.DelayCount - 1] / 1000 : 0);
+
+    for (unsigned long taps = 1; taps <= BTN_GESTURE_MAX_TAPS; taps++)
+    {
+        unsigned long total = 0;
+
+        for (unsigned long outcome = 1; outcome <= BTN_GESTURE_MAX_TAPS; outcome++)
+        {
+            total += res.Outcome[taps][outcome];
+        }
+
+        printf(" %8.1f%%", total != 0 ? 100.0 * res.Outcome[taps][taps] / total : 0.0);
+    }
+
+    putchar('\n');
+
+    free(res.Delays);
+}
+
+static void benchmark(const pattern* patterns, unsigned long count, unsigned char tapMask, unsigned long long windowUs)
+{
+    struct timespec start;
+    struct timespec end;
+    unsigned long long edges = 0;
+    volatile unsigned long sink = 0;
+    BTN_TAP_STATE state;
+    const int rounds = 20;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int round = 0; round < rounds; round++)
+    {
+        memset(&state, 0, sizeof(state));
+        state.TapMask = tapMask;
+
+        for (unsigned long i = 0; i < count; i++)
+        {
+            for (unsigned long e = 0; e < patterns[i].Edges; e++)
+            {
+                unsigned long taps;
+
+                if (state.Deadline != 0 && patterns[i].Time[e] >= state.Deadline)
+                {
+                    sink += BtnTapOnDeadline(&state, (e & 1) != 0, &taps);
+                }
+
+                sink += BtnTapOnEdge(&state, (e & 1) == 0, patterns[i].Time[e], windowUs, &taps);
+                edges++;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("recognizer cost             %.1f ns per edge over %llu edges\n",
+        ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / edges,
+        edges);
+}
+
+int main(int argc, char** argv)
+{
+    static const unsigned long long windowsMs[] = { 150, 200, 250, 300, 400 };
+    unsigned long count = 10000;
+    unsigned long long seed = 1;
+    unsigned long long slackUs = 4000;
+    unsigned char tapMask = 1 << 2;
+    pattern* patterns;
+    int arg = 1;
+
+    while (arg < argc && argv[arg][0] == '-')
+    {
+        if (strcmp(argv[arg], "-triple") == 0)
+        {
+            tapMask |= 1 << 3;
+            arg++;
+            continue;
+        }
+
+        if (arg + 1 >= argc)
+        {
+            break;
+        }
+
+        if (strcmp(argv[arg], "-n") == 0)
+        {
+            count = strtoul(argv[arg + 1], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "-seed") == 0)
+        {
+            seed = strtoull(argv[arg + 1], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "-slack") == 0)
+        {
+            slackUs = strtoull(argv[arg + 1], NULL, 10);
+        }
+        else
+        {
+            break;
+        }
+
+        arg += 2;
+    }
+
+    if (arg != argc || count == 0)
+    {
+        fprintf(stderr, "usage: %s [-n patterns] [-seed n] [-slack us] [-triple]\n", argv[0]);
+        return 2;
+    }
+
+    patterns = generate(count, seed);
+
+    printf("%lu patterns, seed %llu, deadline slack %llu us, gestures 0x%02x\n\n", count, seed, slackUs, tapMask);
+    printf("  window   single press delay (ms)              recognized as intended\n");
+    printf("             mean       p50       p99       max    single    double    triple\n");
+
+    for (size_t i = 0; i < sizeof(windowsMs) / sizeof(windowsMs[0]); i++)
+    {
+        run(patterns, count, tapMask, windowsMs[i] * 1000, slackUs);
+    }
+
+    putchar('\n');
+    benchmark(patterns, count, tapMask, 250000);
+
+    free(patterns);
+
+    return 0;
+}
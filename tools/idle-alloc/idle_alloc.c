@@ -0,0 +1,426 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Allocation count of the idle notification path.
+//
+// Builds the whole driver against the stand-in framework in ../wdk and
+// runs it through many idle cycles the way HIDCLASS does: an idle
+// notification arrives, the work item makes the idle callback and parks
+// the request in IdleQueue, the device goes to D3 and the request is
+// completed again by the next D0 entry. Now and then a button edge
+// completes it before the device left D0, or HIDCLASS cancels it. Every
+// framework object the driver creates or deletes is counted; steady state
+// must do neither. A second notification sent while the first is still in
+// flight must be turned away with STATUS_DEVICE_BUSY. Only an edge that
+// completed the request counts as a wake: in D3 the interrupts are not
+// armed for wake, a press there is lost until the levels are read at D0
+// entry. A wake is timed from the completion to its first report, and to
+// D0 entry when HIDCLASS had the device out of D0 before that report went
+// out. Last, a button held past the stuck timeout must have its interrupt
+// disabled, so that it no longer completes the request, until it is let
+// go. Build and run on any host with
+//
+//   cc -O2 -pthread -I../wdk -I../../include -o idle-alloc idle_alloc.c ../wdk/framework.c ../../src/*.c && ./idle-alloc [cycles]
+//
+// The program exits with 1 if any check fails.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <internal.h>
+#include <gesture.h>
+#include <stuck.h>
+#include <standin.h>
+
+#define BUTTONS     5   // Power to Camera, no slider
+
+DRIVER_INITIALIZE DriverEntry;
+
+static unsigned long idle_callbacks;
+
+static VOID idle_callback(PVOID Context)
+{
+    (void)Context;
+    idle_callbacks++;
+}
+
+//
+// Runs work items and timers, moving the clock on to the next timer, until
+// the driver has nothing left to do for the longest a press is held back.
+// A button still held is not let autorepeat, fire its hold action or time
+// out as stuck.
+//
+static void settle(void)
+{
+    ULONGLONG until = StandInTime + BTN_MS_TO_INTERRUPT_TIME(BTN_GESTURE_MAX_WINDOW_MS);
+
+    for (;;)
+    {
+        ULONGLONG next;
+
+        StandInRunWorkItems();
+        StandInRunTimers();
+
+        next = StandInNextTimer();
+        if (next == 0 || next > until)
+        {
+            if (StandInRunWorkItems() == 0)
+            {
+                return;
+            }
+
+            continue;
+        }
+
+        if (next > StandInTime)
+        {
+            StandInAdvance(next - StandInTime);
+        }
+    }
+}
+
+//
+// Lines are active low
+//
+static void set_level(BUTTON_TYPE button, BOOLEAN pressed)
+{
+    if (pressed)
+    {
+        __atomic_and_fetch(&StandInPins, ~BUTTON_BIT(button), __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        __atomic_or_fetch(&StandInPins, BUTTON_BIT(button), __ATOMIC_SEQ_CST);
+    }
+}
+
+//
+// Moves the clock on by Duration, running every work item and timer that
+// comes due on the way
+//
+static void run_for(ULONGLONG Duration)
+{
+    ULONGLONG until = StandInTime + Duration;
+
+    for (;;)
+    {
+        ULONGLONG next;
+
+        StandInRunWorkItems();
+        StandInRunTimers();
+
+        next = StandInNextTimer();
+        if (next == 0 || next > until)
+        {
+            break;
+        }
+
+        if (next > StandInTime)
+        {
+            StandInAdvance(next - StandInTime);
+        }
+    }
+
+    if (until > StandInTime)
+    {
+        StandInAdvance(until - StandInTime);
+    }
+
+    StandInRunWorkItems();
+    StandInRunTimers();
+}
+
+static unsigned long phase_samples(PDEVICE_EXTENSION devContext, BTN_LIFECYCLE_PHASE phase)
+{
+    unsigned long samples = 0;
+
+    for (ULONG bucket = 0; bucket < BTN_LATENCY_BUCKETS; bucket++)
+    {
+        samples += (unsigned long)devContext->LifecycleBuckets[phase][bucket];
+    }
+
+    return samples;
+}
+
+static void release(WDFDEVICE device, BUTTON_TYPE button)
+{
+    StandInAdvance(BTN_MS_TO_INTERRUPT_TIME(20));
+    set_level(button, FALSE);
+    StandInInterrupt(device, button);
+    settle();
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long cycles = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    HID_SUBMIT_IDLE_NOTIFICATION_CALLBACK_INFO info = { idle_callback, NULL };
+    WDFDEVICE device;
+    PDEVICE_EXTENSION devContext;
+    LONG createdAtStart;
+    LONG deletedAtStart;
+    unsigned long busy = 0;
+    unsigned long cancelled = 0;
+    unsigned long woken = 0;
+    unsigned long wokenInFlight = 0;
+    unsigned long wokenHeldOverD0 = 0;
+    unsigned long pressedInD3 = 0;
+    unsigned long failures = 0;
+
+    device = StandInAddDevice(DriverEntry);
+    if (device == NULL || !NT_SUCCESS(StandInStartDevice(device, BUTTONS, TRUE)))
+    {
+        fprintf(stderr, "Device failed to start\n");
+        return 1;
+    }
+
+    devContext = GetDeviceContext(device);
+    settle();
+
+    createdAtStart = StandInObjectsCreated;
+    deletedAtStart = StandInObjectsDeleted;
+
+    for (unsigned long cycle = 0; cycle < cycles; cycle++)
+    {
+        BUTTON_TYPE button = (BUTTON_TYPE)(cycle % BUTTONS);
+        WDFREQUEST request;
+        NTSTATUS status;
+
+        request = StandInCreateRequest(IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST, &info, sizeof(info), NULL, 0);
+        StandInDispatch(device, request);
+
+        if (StandInCompleted(request, NULL, NULL) != 0)
+        {
+            failures++;
+            StandInDeleteRequest(request);
+            continue;
+        }
+
+        // Now and then a second notification before the work item has run
+        if (cycle % 4 == 0)
+        {
+            WDFREQUEST second = StandInCreateRequest(IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST, &info, sizeof(info), NULL, 0);
+
+            StandInDispatch(device, second);
+
+            if (StandInCompleted(second, &status, NULL) != 1 || status != STATUS_DEVICE_BUSY)
+            {
+                failures++;
+            }
+
+            StandInDeleteRequest(second);
+            busy++;
+        }
+
+        StandInRunWorkItems();
+
+        if (StandInQueueLength(devContext->IdleQueue) != 1 || StandInCompleted(request, NULL, NULL) != 0)
+        {
+            failures++;
+        }
+
+        if (cycle % 8 == 3)
+        {
+            // HIDCLASS cancels the parked request and the device stays in D0
+            if (!StandInCancelRequest(request))
+            {
+                failures++;
+            }
+
+            cancelled++;
+        }
+        else if (cycle % 8 == 6 || cycle % 8 == 1)
+        {
+            // A button edge before HIDCLASS took the device out of D0
+            BOOLEAN inFlight = cycle % 8 == 1;
+            BOOLEAN heldOverD0 = FALSE;
+            LONG wakes = devContext->Counters[button][CounterWakes];
+            LONG reports = devContext->Counters[button][CounterReportsEmitted];
+            unsigned long toD0 = phase_samples(devContext, LifecyclePhaseWakeToD0);
+            unsigned long toReport = phase_samples(devContext, LifecyclePhaseWakeReport);
+
+            set_level(button, TRUE);
+            StandInInterrupt(device, button);
+
+            if (StandInCompleted(request, &status, NULL) != 1 || status != STATUS_SUCCESS)
+            {
+                failures++;
+            }
+
+            if (inFlight)
+            {
+                //
+                // HIDCLASS was already powering down. Disabling the
+                // interrupts flushes the edge and D0 exit reports what was
+                // held back, a press reported on its release only goes
+                // out after the next D0 entry.
+                //
+                StandInPowerDown(device, WdfPowerDeviceD3);
+                heldOverD0 = phase_samples(devContext, LifecyclePhaseWakeReport) == toReport;
+                StandInAdvance(BTN_MS_TO_INTERRUPT_TIME(40));
+                StandInPowerUp(device);
+            }
+
+            settle();
+
+            // Power only reports on its release
+            release(device, button);
+
+            if (devContext->Counters[button][CounterWakes] != wakes + 1 ||
+                devContext->WakeMask != (LONG)BUTTON_BIT(button) ||
+                phase_samples(devContext, LifecyclePhaseWakeToD0) != toD0 + heldOverD0 ||
+                phase_samples(devContext, LifecyclePhaseWakeReport) != toReport + 1 ||
+                devContext->WakeTime != 0 ||
+                devContext->Counters[button][CounterReportsEmitted] - reports != 2)
+            {
+                failures++;
+            }
+
+            woken++;
+            wokenInFlight += inFlight;
+            wokenHeldOverD0 += heldOverD0;
+        }
+        else
+        {
+            // Off to D3, now and then with a button pressed there
+            BOOLEAN pressed = cycle % 8 == 5 || cycle % 8 == 7;
+            LONG wakes = devContext->Counters[button][CounterWakes];
+            unsigned long toD0 = phase_samples(devContext, LifecyclePhaseWakeToD0);
+            unsigned long toReport = phase_samples(devContext, LifecyclePhaseWakeReport);
+
+            StandInPowerDown(device, WdfPowerDeviceD3);
+
+            if (pressed)
+            {
+                set_level(button, TRUE);
+
+                // Not armed for wake, the edge is lost
+                if (StandInInterrupt(device, button))
+                {
+                    failures++;
+                }
+            }
+
+            StandInAdvance(BTN_MS_TO_INTERRUPT_TIME(40));
+
+            // OnD0Entry completes the request, the press is reconciled from the level
+            StandInPowerUp(device);
+            StandInRunWorkItems();
+
+            if (BUTTON_PRESSED(ReadAcquire(&devContext->ButtonMask), button) != (pressed ? ButtonStatePressed : ButtonStateUnpressed))
+            {
+                failures++;
+            }
+
+            settle();
+
+            if (StandInCompleted(request, &status, NULL) != 1 || status != STATUS_SUCCESS)
+            {
+                failures++;
+            }
+
+            if (devContext->Counters[button][CounterWakes] != wakes ||
+                devContext->WakeMask != 0 ||
+                phase_samples(devContext, LifecyclePhaseWakeToD0) != toD0 ||
+                phase_samples(devContext, LifecyclePhaseWakeReport) != toReport)
+            {
+                failures++;
+            }
+
+            if (pressed)
+            {
+                release(device, button);
+            }
+
+            pressedInD3 += pressed;
+        }
+
+        if (StandInQueueLength(devContext->IdleQueue) != 0 || StandInCompleted(request, NULL, NULL) != 1)
+        {
+            failures++;
+        }
+
+        StandInDeleteRequest(request);
+    }
+
+    //
+    // A button held past the stuck timeout is quarantined: its release is
+    // reported, its interrupt disabled so that it no longer brings the stack
+    // out of idle, and its level polled until it is let go
+    //
+    {
+        BUTTON_TYPE button = VolumeUp;
+        LONG stuck = devContext->Counters[button][CounterStuck];
+        LONG wakes = devContext->Counters[button][CounterWakes];
+        WDFREQUEST request;
+
+        set_level(button, TRUE);
+        StandInInterrupt(device, button);
+        run_for(BTN_MS_TO_INTERRUPT_TIME(BTN_STUCK_DEFAULT_TIMEOUT_S * 1000 + 1000));
+
+        if (devContext->Counters[button][CounterStuck] != stuck + 1 ||
+            !devContext->Lines[button].Stuck ||
+            BUTTON_PRESSED(ReadAcquire(&devContext->ButtonMask), button))
+        {
+            failures++;
+        }
+
+        request = StandInCreateRequest(IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST, &info, sizeof(info), NULL, 0);
+        StandInDispatch(device, request);
+        StandInRunWorkItems();
+
+        // The line bounces, nothing reaches the ISR
+        if (StandInInterrupt(device, button) || StandInCompleted(request, NULL, NULL) != 0)
+        {
+            failures++;
+        }
+
+        // Let go, the poll lifts the quarantine and enables the interrupt
+        set_level(button, FALSE);
+        run_for(BTN_MS_TO_INTERRUPT_TIME(BTN_STUCK_POLL_MS));
+
+        if (devContext->Lines[button].Stuck || BUTTON_PRESSED(ReadAcquire(&devContext->ButtonMask), button))
+        {
+            failures++;
+        }
+
+        // The next press is reported and brings the stack out of idle again
+        set_level(button, TRUE);
+
+        if (!StandInInterrupt(device, button) ||
+            StandInCompleted(request, NULL, NULL) != 1 ||
+            devContext->Counters[button][CounterWakes] != wakes + 1)
+        {
+            failures++;
+        }
+
+        settle();
+
+        if (!BUTTON_PRESSED(ReadAcquire(&devContext->ButtonMask), button))
+        {
+            failures++;
+        }
+
+        release(device, button);
+        StandInDeleteRequest(request);
+    }
+
+    if (idle_callbacks != cycles + 1 ||
+        StandInObjectsCreated != createdAtStart ||
+        StandInObjectsDeleted != deletedAtStart)
+    {
+        failures++;
+    }
+
+    printf("%lu idle cycles: %lu cancelled, %lu woken by a button, %lu with one pressed in D3\n", cycles, cancelled, woken, pressedInD3);
+    printf("%lu woken while leaving D0, %lu of them reported after the next D0 entry\n", wokenInFlight, wokenHeldOverD0);
+    printf("%lu notifications turned away while one was in flight\n\n", busy);
+    printf("framework objects created by start       %ld\n", (long)createdAtStart);
+    printf("framework objects created while idling    %ld\n", (long)(StandInObjectsCreated - createdAtStart));
+    printf("framework objects deleted while idling    %ld\n", (long)(StandInObjectsDeleted - deletedAtStart));
+    printf("idle callbacks made                       %lu\n", idle_callbacks);
+    printf("times a held button was quarantined       %ld\n", (long)devContext->Counters[VolumeUp][CounterStuck]);
+    printf("failed checks                             %lu\n", failures);
+
+    return failures != 0;
+}
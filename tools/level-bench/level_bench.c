@@ -0,0 +1,196 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Benchmark for reading line levels from the GPIO controller.
+//
+// A thread stands in for the GPIO controller: it owns a bank of 32 pins
+// and answers read requests sent over a pipe, so that every request costs
+// a real round trip through the kernel, as IOCTL_GPIO_READ_PINS does on a
+// device. For 1 to 32 lines it compares the cost of one evaluation done
+// the way the driver used to, one request per line with a buffer
+// allocated per read, with the way it does now, one request for the whole
+// bank into a preallocated buffer. Build on any host with
+//
+//   cc -O2 -pthread -o level-bench level_bench.c
+//
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PINS                32
+#define EVALUATIONS         20000
+
+typedef struct
+{
+    unsigned int Mask;          // Pins to read, bit n is pin n
+    unsigned int Length;        // Bytes of output buffer
+} request;
+
+typedef struct
+{
+    int Requests[2];
+    int Replies[2];
+    volatile unsigned int Bank;
+    unsigned long long RoundTrips;
+} controller;
+
+static void* serve(void* context)
+{
+    controller* c = context;
+    request r;
+
+    while (read(c->Requests[0], &r, sizeof(r)) == sizeof(r))
+    {
+        // Pins are packed from bit 0 in the order they were asked for
+        unsigned int pins = 0;
+        unsigned int out = 0;
+        unsigned char reply[4] = { 0 };
+
+        for (unsigned int pin = 0; pin < PINS; pin++)
+        {
+            if (r.Mask & (1u << pin))
+            {
+                pins |= ((c->Bank >> pin) & 1u) << out++;
+            }
+        }
+
+        memcpy(reply, &pins, r.Length < sizeof(reply) ? r.Length : sizeof(reply));
+
+        if (write(c->Replies[1], reply, r.Length) != (ssize_t)r.Length)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int transact(controller* c, unsigned int mask, unsigned char* buffer, unsigned int length)
+{
+    request r = { mask, length };
+
+    c->RoundTrips++;
+
+    if (write(c->Requests[1], &r, sizeof(r)) != sizeof(r))
+    {
+        return -1;
+    }
+
+    return read(c->Replies[0], buffer, length) == (ssize_t)length ? 0 : -1;
+}
+
+// One request per line, each into a freshly allocated buffer
+static unsigned int read_per_line(controller* c, unsigned int lines)
+{
+    unsigned int levels = 0;
+
+    for (unsigned int line = 0; line < lines; line++)
+    {
+        unsigned char* buffer = malloc(1);
+
+        if (transact(c, 1u << line, buffer, 1) == 0)
+        {
+            levels |= (buffer[0] & 1u) << line;
+        }
+
+        free(buffer);
+    }
+
+    return levels;
+}
+
+// One request for every line into the preallocated buffer
+static unsigned int read_bank(controller* c, unsigned int lines, unsigned char* buffer)
+{
+    unsigned int mask = lines < 32 ? (1u << lines) - 1 : ~0u;
+    unsigned int levels = 0;
+    unsigned int length = (lines + 7) / 8;
+
+    if (transact(c, mask, buffer, length) == 0)
+    {
+        memcpy(&levels, buffer, length);
+    }
+
+    return levels;
+}
+
+static double elapsed_us(const struct timespec* start, const struct timespec* end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+int main(void)
+{
+    static const unsigned int counts[] = { 1, 3, 6, 8, 16, 32 };
+    controller c;
+    pthread_t thread;
+    unsigned char bankBuffer[4];
+
+    memset(&c, 0, sizeof(c));
+
+    if (pipe(c.Requests) != 0 || pipe(c.Replies) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    c.Bank = 0x5A5A5A5A;
+    pthread_create(&thread, NULL, serve, &c);
+
+    printf("%d evaluations per row\n\n", EVALUATIONS);
+    printf("   lines      per line: us/eval  round trips      bank: us/eval  round trips\n");
+
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        unsigned int lines = counts[i];
+        unsigned int mask = lines < 32 ? (1u << lines) - 1 : ~0u;
+        struct timespec start;
+        struct timespec end;
+        double perLineUs;
+        double bankUs;
+        unsigned long long perLineTrips;
+        unsigned long long bankTrips;
+
+        if (read_per_line(&c, lines) != (c.Bank & mask) || read_bank(&c, lines, bankBuffer) != (c.Bank & mask))
+        {
+            fprintf(stderr, "levels read back wrong with %u lines\n", lines);
+            return 1;
+        }
+
+        c.RoundTrips = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int e = 0; e < EVALUATIONS; e++)
+        {
+            read_per_line(&c, lines);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        perLineUs = elapsed_us(&start, &end) / EVALUATIONS;
+        perLineTrips = c.RoundTrips;
+
+        c.RoundTrips = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int e = 0; e < EVALUATIONS; e++)
+        {
+            read_bank(&c, lines, bankBuffer);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        bankUs = elapsed_us(&start, &end) / EVALUATIONS;
+        bankTrips = c.RoundTrips;
+
+        printf("%8u %18.2f %12.1f %18.2f %12.1f\n",
+            lines,
+            perLineUs,
+            (double)perLineTrips / EVALUATIONS,
+            bankUs,
+            (double)bankTrips / EVALUATIONS);
+    }
+
+    close(c.Requests[1]);
+    pthread_join(thread, NULL);
+
+    return 0;
+}
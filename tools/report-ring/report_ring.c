@@ -0,0 +1,397 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Report accounting of SendReport and BtnReadReport.
+//
+// Builds the whole driver against the stand-in framework in ../wdk and
+// plays HIDCLASS's reads. First the reader stalls while a button is
+// pressed and released: the first BTN_REPORT_RING_SIZE reports must be
+// parked, every one after them dropped, counted in CounterReportsDropped
+// and traced as ReportDropped. The reader then comes back and must get the
+// parked reports, oldest first, until the ring is empty, after which its
+// reads stay pending until the next reports complete them. Finally a
+// reader thread that stalls at random races the reports produced by two
+// work item threads; every report must be delivered, dropped or still
+// parked at the end. The trace is read through the trace feature report,
+// the way a diagnostic tool would. Build and run on any host with
+//
+//   cc -O2 -pthread -I../wdk -I../../include -o report-ring report_ring.c ../wdk/framework.c ../../src/*.c && ./report-ring [presses]
+//
+// The program exits with 1 if any check fails.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <internal.h>
+#include <standin.h>
+
+#define BUTTONS         3       // Power, VolumeUp and VolumeDown
+#define EXTRA_REPORTS   8       // Reports past a full ring in the stalled phase
+#define PRESS_MS        100
+
+DRIVER_INITIALIZE DriverEntry;
+
+static WDFDEVICE device;
+static PDEVICE_EXTENSION devContext;
+static unsigned long failures;
+
+//
+// Trace records seen so far, by event
+//
+static ULONG trace_sequence;
+static ULONG trace_events[BtnEventCount];
+
+static volatile int stop;
+static unsigned long delivered;
+
+static void check(int condition, const char* what)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "failed: %s\n", what);
+        failures++;
+    }
+}
+
+//
+// Picks up the trace records written since the last call from the trace
+// feature report. Fails if the ring wrapped past records not seen yet.
+//
+static void read_trace(void)
+{
+    static BTN_TRACE_FEATURE_REPORT report;
+    HID_XFER_PACKET packet = { (PUCHAR)&report, sizeof(report), REPORTID_TRACE };
+    WDFREQUEST request = StandInCreateRequest(IOCTL_HID_GET_FEATURE, NULL, 0, &packet, sizeof(packet));
+    NTSTATUS status;
+
+    report.ReportID = REPORTID_TRACE;
+
+    StandInDispatch(device, request);
+
+    if (StandInCompleted(request, &status, NULL) != 1 || !NT_SUCCESS(status))
+    {
+        check(FALSE, "trace feature report");
+        StandInDeleteRequest(request);
+        return;
+    }
+
+    StandInDeleteRequest(request);
+
+    check(report.Sequence - trace_sequence <= BTN_TRACE_RING_SIZE, "trace read before the ring wrapped");
+
+    for (ULONG sequence = trace_sequence + 1; sequence != report.Sequence + 1; sequence++)
+    {
+        const BTN_TRACE_RECORD* record = &report.Records[sequence & (BTN_TRACE_RING_SIZE - 1)];
+
+        if ((ULONG)record->Sequence == sequence && record->EventId < BtnEventCount)
+        {
+            trace_events[record->EventId]++;
+        }
+    }
+
+    trace_sequence = report.Sequence;
+}
+
+//
+// Lets Ms pass in 1ms steps, running what is due at each
+//
+static void run(ULONG ms)
+{
+    for (ULONG i = 0; i < ms; i++)
+    {
+        StandInAdvance(BTN_MS_TO_INTERRUPT_TIME(1));
+
+        while (StandInRunWorkItems() + StandInRunTimers() != 0)
+        {
+            // A timer may queue a work item and the other way around
+        }
+    }
+}
+
+//
+// Lines are active low
+//
+static void set_level(BUTTON_TYPE button, BOOLEAN pressed)
+{
+    if (pressed)
+    {
+        __atomic_and_fetch(&StandInPins, ~BUTTON_BIT(button), __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        __atomic_or_fetch(&StandInPins, BUTTON_BIT(button), __ATOMIC_SEQ_CST);
+    }
+
+    StandInInterrupt(device, button);
+}
+
+//
+// A press and release, each left to be handled for PRESS_MS. Every step
+// is followed by a trace read.
+//
+static void press(BUTTON_TYPE button)
+{
+    set_level(button, TRUE);
+    run(PRESS_MS);
+    read_trace();
+
+    set_level(button, FALSE);
+    run(PRESS_MS);
+    read_trace();
+}
+
+static LONG counter(BTN_COUNTER Counter)
+{
+    LONG total = 0;
+
+    for (ULONG button = 0; button < ButtonCount; button++)
+    {
+        total += ReadNoFence(&devContext->Counters[button][Counter]);
+    }
+
+    return total;
+}
+
+static WDFREQUEST send_read(BTN_REPORT* report)
+{
+    WDFREQUEST request = StandInCreateRequest(IOCTL_HID_READ_REPORT, NULL, 0, report, sizeof(*report));
+
+    StandInDispatch(device, request);
+
+    return request;
+}
+
+//
+// Reader that keeps one read outstanding but now and then stops reading
+// for a while, as a busy HIDCLASS would
+//
+static void* reader(void* context)
+{
+    unsigned int seed = 1;
+
+    (void)context;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_SEQ_CST))
+    {
+        BTN_REPORT report;
+        WDFREQUEST request = send_read(&report);
+        NTSTATUS status;
+
+        while (StandInCompleted(request, &status, NULL) == 0)
+        {
+            if (__atomic_load_n(&stop, __ATOMIC_SEQ_CST) && StandInCancelRequest(request))
+            {
+                break;
+            }
+
+            sched_yield();
+        }
+
+        if (status == STATUS_SUCCESS)
+        {
+            __atomic_add_fetch(&delivered, 1, __ATOMIC_SEQ_CST);
+        }
+
+        StandInDeleteRequest(request);
+
+        if (rand_r(&seed) % 8 == 0)
+        {
+            for (int i = rand_r(&seed) % 2000; i != 0; i--)
+            {
+                sched_yield();
+            }
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Lets Ms pass in 1ms steps while the worker threads run what is due
+//
+static void tick(ULONG ms)
+{
+    for (ULONG i = 0; i < ms; i++)
+    {
+        StandInAdvance(BTN_MS_TO_INTERRUPT_TIME(1));
+        sched_yield();
+    }
+}
+
+static void* worker(void* context)
+{
+    (void)context;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_SEQ_CST))
+    {
+        if (StandInRunWorkItems() == 0 && StandInRunTimers() == 0)
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long presses = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    ULONG stalled = (BTN_REPORT_RING_SIZE + EXTRA_REPORTS) / 2;
+    BTN_REPORT reports[BTN_REPORT_RING_SIZE + EXTRA_REPORTS];
+    WDFREQUEST reads[BTN_REPORT_RING_SIZE + EXTRA_REPORTS];
+    pthread_t threads[3];
+    LONG emitted;
+    LONG dropped;
+    ULONG parked;
+
+    device = StandInAddDevice(DriverEntry);
+    if (device == NULL || !NT_SUCCESS(StandInStartDevice(device, BUTTONS, TRUE)))
+    {
+        fprintf(stderr, "Device failed to start\n");
+        return 1;
+    }
+
+    devContext = GetDeviceContext(device);
+    run(PRESS_MS);
+    read_trace();
+
+    //
+    // Stalled reader: VolumeDown pressed and released until the ring has
+    // overflowed by EXTRA_REPORTS
+    //
+    for (ULONG i = 0; i < stalled; i++)
+    {
+        press(VolumeDown);
+    }
+
+    emitted = counter(CounterReportsEmitted);
+    dropped = counter(CounterReportsDropped);
+
+    printf("Stalled reader\n");
+    printf("reports emitted      %ld\n", (long)emitted);
+    printf("parked               %lu, traced %lu\n", (unsigned long)devContext->PendingReportCount, (unsigned long)trace_events[BtnEventReportParked]);
+    printf("dropped              %ld, traced %lu\n", (long)dropped, (unsigned long)trace_events[BtnEventReportDropped]);
+
+    check(emitted == BTN_REPORT_RING_SIZE + EXTRA_REPORTS, "a report for every press and release");
+    check(devContext->PendingReportCount == BTN_REPORT_RING_SIZE, "ring full");
+    check(trace_events[BtnEventReportParked] == BTN_REPORT_RING_SIZE, "every parked report traced");
+    check(dropped == EXTRA_REPORTS, "every report past the ring dropped");
+    check(devContext->Counters[VolumeDown][CounterReportsDropped] == EXTRA_REPORTS, "drops counted on the line");
+    check(trace_events[BtnEventReportDropped] == EXTRA_REPORTS, "every dropped report traced");
+    check(trace_events[BtnEventReportCompleted] == 0, "nothing completed without a read");
+
+    //
+    // The reader is back: the parked reports come out oldest first, press
+    // then release, and the reads after them are left pending
+    //
+    for (ULONG i = 0; i < BTN_REPORT_RING_SIZE + EXTRA_REPORTS; i++)
+    {
+        NTSTATUS status;
+        ULONG_PTR information;
+
+        memset(&reports[i], 0xFF, sizeof(reports[i]));
+        reads[i] = send_read(&reports[i]);
+
+        if (i < BTN_REPORT_RING_SIZE)
+        {
+            check(StandInCompleted(reads[i], &status, &information) == 1 &&
+                  status == STATUS_SUCCESS &&
+                  information == sizeof(BTN_REPORT), "parked report delivered");
+
+            check(reports[i].ReportID == REPORTID_CAPKEY_CONSUMER &&
+                  reports[i].KeysData.Consumer.VolumeDown == (i % 2 == 0), "parked reports in order");
+        }
+        else
+        {
+            check(StandInCompleted(reads[i], NULL, NULL) == 0, "read pending once the ring is empty");
+        }
+    }
+
+    read_trace();
+
+    printf("\nReader back\n");
+    printf("delivered from ring  %lu\n", (unsigned long)trace_events[BtnEventReportCompleted]);
+    printf("reads left pending   %lu\n", (unsigned long)StandInQueueLength(devContext->PingPongQueue));
+
+    check(devContext->PendingReportCount == 0, "ring empty");
+    check(StandInQueueLength(devContext->PingPongQueue) == EXTRA_REPORTS, "reads parked in PingPongQueue");
+
+    //
+    // The next reports go straight to the pending reads
+    //
+    for (ULONG i = 0; i < EXTRA_REPORTS / 2; i++)
+    {
+        press(VolumeUp);
+    }
+
+    for (ULONG i = BTN_REPORT_RING_SIZE; i < BTN_REPORT_RING_SIZE + EXTRA_REPORTS; i++)
+    {
+        check(StandInCompleted(reads[i], NULL, NULL) == 1 &&
+              reports[i].ReportID == REPORTID_CAPKEY_CONSUMER &&
+              reports[i].KeysData.Consumer.VolumeUp == (i % 2 == 0), "pending read completed in order");
+    }
+
+    for (ULONG i = 0; i < BTN_REPORT_RING_SIZE + EXTRA_REPORTS; i++)
+    {
+        StandInDeleteRequest(reads[i]);
+    }
+
+    check(trace_events[BtnEventReportCompleted] == BTN_REPORT_RING_SIZE + EXTRA_REPORTS, "every delivery traced");
+    check(counter(CounterReportsDropped) == EXTRA_REPORTS, "no drop with reads pending");
+    check(devContext->PendingReportCount == 0 && StandInQueueLength(devContext->PingPongQueue) == 0, "nothing left over");
+
+    //
+    // A reader that stalls at random against reports from two threads
+    //
+    emitted = counter(CounterReportsEmitted);
+    dropped = counter(CounterReportsDropped);
+
+    pthread_create(&threads[0], NULL, reader, NULL);
+    pthread_create(&threads[1], NULL, worker, NULL);
+    pthread_create(&threads[2], NULL, worker, NULL);
+
+    for (unsigned long i = 0; i < presses; i++)
+    {
+        BUTTON_TYPE button = (BUTTON_TYPE)(i % BUTTONS);
+
+        set_level(button, TRUE);
+        tick(PRESS_MS);
+        set_level(button, FALSE);
+        tick(PRESS_MS);
+    }
+
+    // Let the last presses settle with the workers still running
+    tick(1000);
+
+    while (!StandInQuiet())
+    {
+        sched_yield();
+    }
+
+    __atomic_store_n(&stop, 1, __ATOMIC_SEQ_CST);
+
+    for (ULONG i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    emitted = counter(CounterReportsEmitted) - emitted;
+    dropped = counter(CounterReportsDropped) - dropped;
+    parked = devContext->PendingReportCount;
+
+    printf("\nReader stalling at random\n");
+    printf("reports emitted      %ld\n", (long)emitted);
+    printf("delivered            %lu\n", delivered);
+    printf("dropped              %ld\n", (long)dropped);
+    printf("still parked         %lu\n", (unsigned long)parked);
+
+    check(emitted >= (LONG)(2 * presses), "a report for every press and release");
+    check((unsigned long)emitted == delivered + (unsigned long)dropped + parked, "every report delivered, dropped or parked");
+
+    printf("\nfailed checks        %lu\n", failures);
+
+    return failures != 0;
+}
@@ -0,0 +1,1314 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Stand-in framework for the host harnesses, see standin.h.
+//
+// Every handle points to an object below. Objects form the framework's
+// parent tree and are deleted with their parent. One lock covers the
+// tree, queues, work items and timers; callbacks never run under it.
+// Every interrupt has a lock of its own, held while its ISR runs, like the
+// passive interrupt lock of the framework.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <standin.h>
+#include <gpio.h>
+
+#define MAX_INTERRUPTS  8
+#define MAX_VALUES      32
+
+enum
+{
+    ObjectDriver,
+    ObjectDevice,
+    ObjectQueue,
+    ObjectRequest,
+    ObjectMemory,
+    ObjectWorkItem,
+    ObjectInterrupt,
+    ObjectTimer,
+    ObjectSpinLock,
+    ObjectIoTarget,
+    ObjectKey,
+};
+
+typedef struct object
+{
+    int Kind;
+    int Counted;
+    void* Context;
+    EVT_WDF_OBJECT_CONTEXT_CLEANUP* Cleanup;
+
+    struct object* Parent;
+    struct object* Children;
+    struct object* Sibling;
+
+    // Work items and interrupts, in the work queue
+    EVT_WDF_WORKITEM* WorkItemFunction;
+    int Queued;
+    int Running;
+    struct object* NextWork;
+
+    // Interrupts
+    EVT_WDF_INTERRUPT_ISR* Isr;
+    EVT_WDF_INTERRUPT_WORKITEM* InterruptWorkItem;
+    pthread_mutex_t InterruptLock;
+    int Enabled;
+
+    // Timers
+    EVT_WDF_TIMER* TimerFunction;
+    int Armed;
+    ULONGLONG Due;
+    struct object* NextTimer;
+
+    // Spin locks
+    pthread_mutex_t SpinLock;
+
+    // Devices
+    WDF_PNPPOWER_EVENT_CALLBACKS Pnp;
+    BOOLEAN NotPowerPolicyOwner;
+    struct object* DefaultQueue;
+    struct object* Interrupts[MAX_INTERRUPTS];
+    ULONG InterruptCount;
+    WDF_POWER_DEVICE_STATE PowerState;
+    CM_PARTIAL_RESOURCE_DESCRIPTOR Resources[MAX_INTERRUPTS + 1];
+    ULONG ResourceCount;
+
+    // Queues, manual ones hold requests in order
+    WDF_IO_QUEUE_CONFIG QueueConfig;
+    struct object* Head;
+    struct object* Tail;
+
+    // Requests
+    IRP Irp;
+    ULONG Completions;
+    struct object* Queue;
+    struct object* NextRequest;
+    struct object* OutputMemory;
+
+    // Memory
+    PVOID Buffer;
+    size_t Length;
+} object;
+
+struct WDFDEVICE_INIT
+{
+    WDF_PNPPOWER_EVENT_CALLBACKS Pnp;
+    BOOLEAN NotPowerPolicyOwner;
+    object* Device;
+};
+
+struct WDFCMRESLIST__
+{
+    object* Device;
+};
+
+volatile ULONGLONG StandInTime = 10000000;
+volatile ULONG StandInPins = MAXULONG;
+volatile LONG StandInLevelReads;
+VOID (*StandInLevelReadHook)(VOID);
+VOID (*StandInInterruptsEnabledHook)(WDFDEVICE Device);
+volatile LONG StandInObjectsCreated;
+volatile LONG StandInObjectsDeleted;
+BOOLEAN StandInDebugOutput;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static object* work_head;
+static object* work_tail;
+static object* timers;
+static int running;
+static EVT_WDF_DRIVER_DEVICE_ADD* device_add;
+static object* driver;
+static DRIVER_OBJECT driver_object;
+
+static struct
+{
+    WCHAR Name[64];
+    ULONG Value;
+} values[MAX_VALUES];
+static ULONG value_count;
+
+//
+// Kernel routines
+//
+ULONGLONG KeQueryInterruptTime(VOID)
+{
+    return __atomic_load_n(&StandInTime, __ATOMIC_SEQ_CST);
+}
+
+ULONGLONG KeQueryInterruptTimePrecise(PULONGLONG QpcTimeStamp)
+{
+    *QpcTimeStamp = KeQueryInterruptTime();
+    return *QpcTimeStamp;
+}
+
+VOID StandInAdvance(ULONGLONG Ticks)
+{
+    __atomic_add_fetch(&StandInTime, Ticks, __ATOMIC_SEQ_CST);
+}
+
+ULONG DbgPrintEx(ULONG ComponentId, ULONG Level, PCSTR Format, ...)
+{
+    va_list args;
+
+    (void)ComponentId;
+    (void)Level;
+
+    if (StandInDebugOutput)
+    {
+        va_start(args, Format);
+        vfprintf(stderr, Format, args);
+        va_end(args);
+    }
+
+    return 0;
+}
+
+VOID RtlInitUnicodeString(PUNICODE_STRING Destination, PCWSTR Source)
+{
+    Destination->Buffer = (PWSTR)Source;
+    Destination->Length = Source != NULL ? (USHORT)(wcslen(Source) * sizeof(WCHAR)) : 0;
+    Destination->MaximumLength = Source != NULL ? Destination->Length + sizeof(WCHAR) : 0;
+}
+
+//
+// Objects
+//
+static object* make(int kind, PWDF_OBJECT_ATTRIBUTES attributes, object* parent, int counted)
+{
+    object* o = calloc(1, sizeof(object));
+
+    if (o == NULL)
+    {
+        abort();
+    }
+
+    o->Kind = kind;
+    o->Counted = counted;
+
+    if (attributes != NULL)
+    {
+        o->Context = attributes->ContextSize != 0 ? calloc(1, attributes->ContextSize) : NULL;
+        o->Cleanup = attributes->EvtCleanupCallback;
+
+        if (attributes->ParentObject != NULL)
+        {
+            parent = attributes->ParentObject;
+        }
+    }
+
+    pthread_mutex_init(&o->InterruptLock, NULL);
+    pthread_mutex_init(&o->SpinLock, NULL);
+
+    pthread_mutex_lock(&lock);
+
+    o->Parent = parent;
+
+    if (parent != NULL)
+    {
+        o->Sibling = parent->Children;
+        parent->Children = o;
+    }
+
+    if (kind == ObjectTimer)
+    {
+        o->NextTimer = timers;
+        timers = o;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    if (counted)
+    {
+        __atomic_add_fetch(&StandInObjectsCreated, 1, __ATOMIC_SEQ_CST);
+    }
+
+    return o;
+}
+
+static void unlink_locked(object** list, object* o, size_t offset)
+{
+    while (*list != NULL)
+    {
+        if (*list == o)
+        {
+            *list = *(object**)((char*)o + offset);
+            return;
+        }
+
+        list = (object**)((char*)*list + offset);
+    }
+}
+
+static void destroy(object* o)
+{
+    while (o->Children != NULL)
+    {
+        destroy(o->Children);
+    }
+
+    if (o->Cleanup != NULL)
+    {
+        o->Cleanup(o);
+    }
+
+    pthread_mutex_lock(&lock);
+
+    if (o->Parent != NULL)
+    {
+        unlink_locked(&o->Parent->Children, o, offsetof(object, Sibling));
+    }
+
+    if (o->Kind == ObjectTimer)
+    {
+        unlink_locked(&timers, o, offsetof(object, NextTimer));
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    if (o->OutputMemory != NULL)
+    {
+        free(o->OutputMemory);
+    }
+
+    if (o->Counted)
+    {
+        __atomic_add_fetch(&StandInObjectsDeleted, 1, __ATOMIC_SEQ_CST);
+    }
+
+    pthread_mutex_destroy(&o->InterruptLock);
+    pthread_mutex_destroy(&o->SpinLock);
+    free(o->Context);
+    free(o);
+}
+
+PVOID StandInObjectContext(PVOID Handle)
+{
+    return ((object*)Handle)->Context;
+}
+
+VOID WdfObjectDelete(WDFOBJECT Object)
+{
+    destroy(Object);
+}
+
+//
+// Driver and device
+//
+NTSTATUS WdfDriverCreate(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath, PWDF_OBJECT_ATTRIBUTES Attributes, PWDF_DRIVER_CONFIG Config, WDFDRIVER* Driver)
+{
+    (void)DriverObject;
+    (void)RegistryPath;
+
+    driver = make(ObjectDriver, Attributes, NULL, 0);
+    device_add = Config->EvtDriverDeviceAdd;
+
+    if (Driver != NULL)
+    {
+        *Driver = (WDFDRIVER)driver;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+PDRIVER_OBJECT WdfDriverWdmGetDriverObject(WDFDRIVER Driver)
+{
+    (void)Driver;
+    return &driver_object;
+}
+
+VOID WdfDeviceInitSetPnpPowerEventCallbacks(PWDFDEVICE_INIT DeviceInit, PWDF_PNPPOWER_EVENT_CALLBACKS Callbacks)
+{
+    DeviceInit->Pnp = *Callbacks;
+}
+
+VOID WdfDeviceInitSetPowerPolicyOwnership(PWDFDEVICE_INIT DeviceInit, BOOLEAN IsPowerPolicyOwner)
+{
+    DeviceInit->NotPowerPolicyOwner = !IsPowerPolicyOwner;
+}
+
+NTSTATUS WdfDeviceCreate(PWDFDEVICE_INIT* DeviceInit, PWDF_OBJECT_ATTRIBUTES Attributes, WDFDEVICE* Device)
+{
+    object* o = make(ObjectDevice, Attributes, driver, 1);
+
+    o->Pnp = (*DeviceInit)->Pnp;
+    o->NotPowerPolicyOwner = (*DeviceInit)->NotPowerPolicyOwner;
+    o->PowerState = WdfPowerDeviceD3Final;
+
+    (*DeviceInit)->Device = o;
+    *DeviceInit = NULL;
+
+    *Device = (WDFDEVICE)o;
+    return STATUS_SUCCESS;
+}
+
+WDFDEVICE StandInAddDevice(DRIVER_INITIALIZE* DriverEntry)
+{
+    struct WDFDEVICE_INIT deviceInit = { 0 };
+    UNICODE_STRING registryPath;
+
+    RtlInitUnicodeString(&registryPath, L"\\Registry\\Machine\\System\\CurrentControlSet\\Services\\LumiaButtonsGPIO");
+
+    if (!NT_SUCCESS(DriverEntry(&driver_object, &registryPath)) ||
+        !NT_SUCCESS(device_add((WDFDRIVER)driver, &deviceInit)))
+    {
+        return NULL;
+    }
+
+    return (WDFDEVICE)deviceInit.Device;
+}
+
+ULONG WdfCmResourceListGetCount(WDFCMRESLIST List)
+{
+    return List->Device->ResourceCount;
+}
+
+PCM_PARTIAL_RESOURCE_DESCRIPTOR WdfCmResourceListGetDescriptor(WDFCMRESLIST List, ULONG Index)
+{
+    return Index < List->Device->ResourceCount ? &List->Device->Resources[Index] : NULL;
+}
+
+//
+// Power
+//
+static void set_enabled(object* interrupt, int enabled)
+{
+    pthread_mutex_lock(&interrupt->InterruptLock);
+    interrupt->Enabled = enabled;
+    pthread_mutex_unlock(&interrupt->InterruptLock);
+}
+
+static int run_work(object* o)
+{
+    if (o->Kind == ObjectInterrupt)
+    {
+        o->InterruptWorkItem((WDFINTERRUPT)o, (WDFOBJECT)o->Parent);
+    }
+    else
+    {
+        o->WorkItemFunction((WDFWORKITEM)o);
+    }
+
+    pthread_mutex_lock(&lock);
+    o->Running--;
+    running--;
+    pthread_mutex_unlock(&lock);
+
+    return 1;
+}
+
+//
+// Takes o off the work queue and returns TRUE if it was queued
+//
+static int claim_locked(object* o)
+{
+    if (!o->Queued)
+    {
+        return 0;
+    }
+
+    unlink_locked(&work_head, o, offsetof(object, NextWork));
+
+    work_tail = work_head;
+    while (work_tail != NULL && work_tail->NextWork != NULL)
+    {
+        work_tail = work_tail->NextWork;
+    }
+
+    o->Queued = 0;
+    o->Running++;
+    running++;
+
+    return 1;
+}
+
+static void flush_work(object* o)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&lock);
+
+        if (claim_locked(o))
+        {
+            pthread_mutex_unlock(&lock);
+            run_work(o);
+            continue;
+        }
+
+        if (o->Running == 0)
+        {
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+
+        pthread_mutex_unlock(&lock);
+        sched_yield();
+    }
+}
+
+NTSTATUS StandInPowerDown(WDFDEVICE Device, WDF_POWER_DEVICE_STATE TargetState)
+{
+    object* device = (object*)Device;
+
+    if (device->Pnp.EvtDeviceD0ExitPreInterruptsDisabled != NULL)
+    {
+        device->Pnp.EvtDeviceD0ExitPreInterruptsDisabled(Device, TargetState);
+    }
+
+    //
+    // The framework flushes an interrupt's work item when it disconnects it
+    //
+    for (ULONG i = 0; i < device->InterruptCount; i++)
+    {
+        set_enabled(device->Interrupts[i], 0);
+        flush_work(device->Interrupts[i]);
+    }
+
+    __atomic_store_n(&device->PowerState, TargetState, __ATOMIC_SEQ_CST);
+
+    return device->Pnp.EvtDeviceD0Exit != NULL ? device->Pnp.EvtDeviceD0Exit(Device, TargetState) : STATUS_SUCCESS;
+}
+
+NTSTATUS StandInPowerUp(WDFDEVICE Device)
+{
+    object* device = (object*)Device;
+    WDF_POWER_DEVICE_STATE previousState = device->PowerState;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    if (device->Pnp.EvtDeviceD0Entry != NULL)
+    {
+        status = device->Pnp.EvtDeviceD0Entry(Device, previousState);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    __atomic_store_n(&device->PowerState, WdfPowerDeviceD0, __ATOMIC_SEQ_CST);
+
+    //
+    // Every line comes back enabled, whatever the driver disabled. The
+    // edge that woke the device is delivered once its line is.
+    //
+    for (ULONG i = 0; i < device->InterruptCount; i++)
+    {
+        object* interrupt = device->Interrupts[i];
+
+        pthread_mutex_lock(&interrupt->InterruptLock);
+
+        interrupt->Enabled = 1;
+
+        pthread_mutex_unlock(&interrupt->InterruptLock);
+    }
+
+    if (StandInInterruptsEnabledHook != NULL)
+    {
+        StandInInterruptsEnabledHook(Device);
+    }
+
+    if (device->Pnp.EvtDeviceD0EntryPostInterruptsEnabled != NULL)
+    {
+        status = device->Pnp.EvtDeviceD0EntryPostInterruptsEnabled(Device, previousState);
+    }
+
+    return status;
+}
+
+NTSTATUS StandInStartDevice(WDFDEVICE Device, ULONG Interrupts, BOOLEAN GpioIo)
+{
+    object* device = (object*)Device;
+    struct WDFCMRESLIST__ resources = { device };
+    NTSTATUS status;
+
+    device->ResourceCount = 0;
+
+    for (ULONG i = 0; i < Interrupts && i < MAX_INTERRUPTS; i++)
+    {
+        PCM_PARTIAL_RESOURCE_DESCRIPTOR descriptor = &device->Resources[device->ResourceCount++];
+
+        memset(descriptor, 0, sizeof(*descriptor));
+        descriptor->Type = CmResourceTypeInterrupt;
+        descriptor->u.Interrupt.Vector = 0x70 + i;
+    }
+
+    if (GpioIo)
+    {
+        PCM_PARTIAL_RESOURCE_DESCRIPTOR descriptor = &device->Resources[device->ResourceCount++];
+
+        memset(descriptor, 0, sizeof(*descriptor));
+        descriptor->Type = CmResourceTypeConnection;
+        descriptor->u.Connection.Class = CM_RESOURCE_CONNECTION_CLASS_GPIO;
+        descriptor->u.Connection.Type = CM_RESOURCE_CONNECTION_TYPE_GPIO_IO;
+        descriptor->u.Connection.IdLowPart = 1;
+    }
+
+    status = device->Pnp.EvtDevicePrepareHardware(Device, &resources, &resources);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    return StandInPowerUp(Device);
+}
+
+//
+// Interrupts
+//
+NTSTATUS WdfInterruptCreate(WDFDEVICE Device, PWDF_INTERRUPT_CONFIG Configuration, PWDF_OBJECT_ATTRIBUTES Attributes, WDFINTERRUPT* Interrupt)
+{
+    object* device = (object*)Device;
+    object* o;
+
+    if (device->InterruptCount == MAX_INTERRUPTS || !Configuration->PassiveHandling)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    //
+    // Wake interrupts are armed by the power policy owner, the framework
+    // refuses them to any other driver
+    //
+    if (Configuration->CanWakeDevice && device->NotPowerPolicyOwner)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    o = make(ObjectInterrupt, Attributes, device, 1);
+    o->Parent = device;
+    o->Isr = Configuration->EvtInterruptIsr;
+    o->InterruptWorkItem = Configuration->EvtInterruptWorkItem;
+
+    device->Interrupts[device->InterruptCount++] = o;
+
+    *Interrupt = (WDFINTERRUPT)o;
+    return STATUS_SUCCESS;
+}
+
+WDFDEVICE WdfInterruptGetDevice(WDFINTERRUPT Interrupt)
+{
+    return (WDFDEVICE)((object*)Interrupt)->Parent;
+}
+
+BOOLEAN WdfInterruptQueueWorkItemForIsr(WDFINTERRUPT Interrupt)
+{
+    object* o = (object*)Interrupt;
+    BOOLEAN queued = FALSE;
+
+    pthread_mutex_lock(&lock);
+
+    if (!o->Queued)
+    {
+        o->Queued = 1;
+        o->NextWork = NULL;
+
+        if (work_tail != NULL)
+        {
+            work_tail->NextWork = o;
+        }
+        else
+        {
+            work_head = o;
+        }
+
+        work_tail = o;
+        queued = TRUE;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return queued;
+}
+
+VOID WdfInterruptEnable(WDFINTERRUPT Interrupt)
+{
+    set_enabled((object*)Interrupt, 1);
+}
+
+VOID WdfInterruptDisable(WDFINTERRUPT Interrupt)
+{
+    // Waits for a running ISR, like the framework does for passive ones
+    set_enabled((object*)Interrupt, 0);
+}
+
+BOOLEAN StandInInterrupt(WDFDEVICE Device, ULONG Index)
+{
+    object* device = (object*)Device;
+    object* o;
+    BOOLEAN ran = FALSE;
+
+    if (Index >= device->InterruptCount)
+    {
+        return FALSE;
+    }
+
+    o = device->Interrupts[Index];
+
+    pthread_mutex_lock(&o->InterruptLock);
+
+    if (o->Enabled)
+    {
+        o->Isr((WDFINTERRUPT)o, 0);
+        ran = TRUE;
+    }
+
+    pthread_mutex_unlock(&o->InterruptLock);
+
+    return ran;
+}
+
+//
+// Work items and timers
+//
+NTSTATUS WdfWorkItemCreate(PWDF_WORKITEM_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes, WDFWORKITEM* WorkItem)
+{
+    object* o;
+
+    if (Attributes == NULL || Attributes->ParentObject == NULL)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    o = make(ObjectWorkItem, Attributes, NULL, 1);
+    o->WorkItemFunction = Config->EvtWorkItemFunc;
+
+    *WorkItem = (WDFWORKITEM)o;
+    return STATUS_SUCCESS;
+}
+
+VOID WdfWorkItemEnqueue(WDFWORKITEM WorkItem)
+{
+    // Like the framework, a work item already queued is not queued twice
+    (VOID)WdfInterruptQueueWorkItemForIsr((WDFINTERRUPT)WorkItem);
+}
+
+ULONG StandInRunWorkItems(VOID)
+{
+    ULONG ran = 0;
+
+    for (;;)
+    {
+        object* o;
+
+        pthread_mutex_lock(&lock);
+
+        o = work_head;
+        if (o == NULL || !claim_locked(o))
+        {
+            pthread_mutex_unlock(&lock);
+            return ran;
+        }
+
+        pthread_mutex_unlock(&lock);
+
+        ran += run_work(o);
+    }
+}
+
+NTSTATUS WdfTimerCreate(PWDF_TIMER_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes, WDFTIMER* Timer)
+{
+    object* o;
+
+    if (Attributes == NULL || Attributes->ParentObject == NULL)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    o = make(ObjectTimer, Attributes, NULL, 1);
+    o->TimerFunction = Config->EvtTimerFunc;
+
+    *Timer = (WDFTIMER)o;
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN WdfTimerStart(WDFTIMER Timer, LONGLONG DueTime)
+{
+    object* o = (object*)Timer;
+    BOOLEAN wasArmed;
+
+    pthread_mutex_lock(&lock);
+
+    wasArmed = o->Armed != 0;
+    o->Armed = 1;
+
+    // Negative due times are relative, positive ones taken as interrupt times
+    o->Due = DueTime < 0 ? KeQueryInterruptTime() + (ULONGLONG)-DueTime : (ULONGLONG)DueTime;
+
+    pthread_mutex_unlock(&lock);
+
+    return wasArmed;
+}
+
+BOOLEAN WdfTimerStop(WDFTIMER Timer, BOOLEAN Wait)
+{
+    object* o = (object*)Timer;
+    BOOLEAN wasArmed;
+
+    pthread_mutex_lock(&lock);
+
+    wasArmed = o->Armed != 0;
+    o->Armed = 0;
+
+    while (Wait && o->Running != 0)
+    {
+        pthread_mutex_unlock(&lock);
+        sched_yield();
+        pthread_mutex_lock(&lock);
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return wasArmed;
+}
+
+WDFOBJECT WdfTimerGetParentObject(WDFTIMER Timer)
+{
+    return ((object*)Timer)->Parent;
+}
+
+ULONG StandInRunTimers(VOID)
+{
+    ULONG ran = 0;
+
+    for (;;)
+    {
+        object* due = NULL;
+        ULONGLONG now = KeQueryInterruptTime();
+
+        pthread_mutex_lock(&lock);
+
+        for (object* o = timers; o != NULL; o = o->NextTimer)
+        {
+            if (o->Armed && o->Due <= now && (due == NULL || o->Due < due->Due))
+            {
+                due = o;
+            }
+        }
+
+        if (due == NULL)
+        {
+            pthread_mutex_unlock(&lock);
+            return ran;
+        }
+
+        due->Armed = 0;
+        due->Running++;
+        running++;
+
+        pthread_mutex_unlock(&lock);
+
+        due->TimerFunction((WDFTIMER)due);
+        ran++;
+
+        pthread_mutex_lock(&lock);
+        due->Running--;
+        running--;
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+ULONGLONG StandInNextTimer(VOID)
+{
+    ULONGLONG next = 0;
+
+    pthread_mutex_lock(&lock);
+
+    for (object* o = timers; o != NULL; o = o->NextTimer)
+    {
+        if (o->Armed && (next == 0 || o->Due < next))
+        {
+            next = o->Due;
+        }
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return next;
+}
+
+BOOLEAN StandInQuiet(VOID)
+{
+    ULONGLONG now = KeQueryInterruptTime();
+    BOOLEAN quiet;
+
+    pthread_mutex_lock(&lock);
+
+    quiet = work_head == NULL && running == 0;
+
+    for (object* o = timers; quiet && o != NULL; o = o->NextTimer)
+    {
+        quiet = !o->Armed || o->Due > now;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return quiet;
+}
+
+NTSTATUS WdfSpinLockCreate(PWDF_OBJECT_ATTRIBUTES SpinLockAttributes, WDFSPINLOCK* SpinLock)
+{
+    *SpinLock = (WDFSPINLOCK)make(ObjectSpinLock, SpinLockAttributes, NULL, 1);
+    return STATUS_SUCCESS;
+}
+
+VOID WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+    pthread_mutex_lock(&((object*)SpinLock)->SpinLock);
+}
+
+VOID WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+    pthread_mutex_unlock(&((object*)SpinLock)->SpinLock);
+}
+
+//
+// Registry
+//
+VOID StandInSetRegistryValue(PCWSTR Name, ULONG Value)
+{
+    ULONG i;
+
+    for (i = 0; i < value_count; i++)
+    {
+        if (wcscmp(values[i].Name, Name) == 0)
+        {
+            break;
+        }
+    }
+
+    if (i == MAX_VALUES)
+    {
+        abort();
+    }
+
+    wcsncpy(values[i].Name, Name, sizeof(values[i].Name) / sizeof(WCHAR) - 1);
+    values[i].Value = Value;
+    value_count = max(value_count, i + 1);
+}
+
+NTSTATUS WdfDriverOpenParametersRegistryKey(WDFDRIVER Driver, ULONG DesiredAccess, PWDF_OBJECT_ATTRIBUTES Attributes, WDFKEY* Key)
+{
+    (void)DesiredAccess;
+
+    *Key = (WDFKEY)make(ObjectKey, Attributes, (object*)Driver, 1);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfDeviceOpenRegistryKey(WDFDEVICE Device, ULONG DeviceInstanceKeyType, ULONG DesiredAccess, PWDF_OBJECT_ATTRIBUTES Attributes, WDFKEY* Key)
+{
+    (void)DeviceInstanceKeyType;
+    (void)DesiredAccess;
+
+    *Key = (WDFKEY)make(ObjectKey, Attributes, (object*)Device, 1);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRegistryQueryULong(WDFKEY Key, PCUNICODE_STRING ValueName, PULONG Value)
+{
+    size_t length = ValueName->Length / sizeof(WCHAR);
+
+    (void)Key;
+
+    for (ULONG i = 0; i < value_count; i++)
+    {
+        if (wcslen(values[i].Name) == length && wcsncmp(values[i].Name, ValueName->Buffer, length) == 0)
+        {
+            *Value = values[i].Value;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+VOID WdfRegistryClose(WDFKEY Key)
+{
+    destroy((object*)Key);
+}
+
+//
+// Queues and requests
+//
+NTSTATUS WdfIoQueueCreate(WDFDEVICE Device, PWDF_IO_QUEUE_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes, WDFQUEUE* Queue)
+{
+    object* o = make(ObjectQueue, Attributes, (object*)Device, 1);
+
+    o->QueueConfig = *Config;
+
+    if (Config->DefaultQueue)
+    {
+        ((object*)Device)->DefaultQueue = o;
+    }
+
+    *Queue = (WDFQUEUE)o;
+    return STATUS_SUCCESS;
+}
+
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue)
+{
+    return (WDFDEVICE)((object*)Queue)->Parent;
+}
+
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST* Request)
+{
+    object* q = (object*)Queue;
+    object* request;
+
+    pthread_mutex_lock(&lock);
+
+    request = q->Head;
+
+    if (request != NULL)
+    {
+        q->Head = request->NextRequest;
+        if (q->Head == NULL)
+        {
+            q->Tail = NULL;
+        }
+
+        request->Queue = NULL;
+        request->NextRequest = NULL;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    *Request = (WDFREQUEST)request;
+    return request != NULL ? STATUS_SUCCESS : STATUS_NO_MORE_ENTRIES;
+}
+
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE Queue)
+{
+    object* q = (object*)Queue;
+    object* request = (object*)Request;
+
+    if (q->QueueConfig.DispatchType != WdfIoQueueDispatchManual || request->Queue != NULL)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    pthread_mutex_lock(&lock);
+
+    request->Queue = q;
+    request->NextRequest = NULL;
+
+    if (q->Tail != NULL)
+    {
+        q->Tail->NextRequest = request;
+    }
+    else
+    {
+        q->Head = request;
+    }
+
+    q->Tail = request;
+
+    pthread_mutex_unlock(&lock);
+
+    return STATUS_SUCCESS;
+}
+
+ULONG StandInQueueLength(WDFQUEUE Queue)
+{
+    ULONG length = 0;
+
+    pthread_mutex_lock(&lock);
+
+    for (object* request = ((object*)Queue)->Head; request != NULL; request = request->NextRequest)
+    {
+        length++;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return length;
+}
+
+WDFREQUEST StandInCreateRequest(ULONG IoControlCode, PVOID InputBuffer, ULONG InputLength, PVOID OutputBuffer, ULONG OutputLength)
+{
+    object* o = make(ObjectRequest, NULL, NULL, 0);
+
+    o->Irp.UserBuffer = OutputBuffer;
+    o->Irp.Stack.Parameters.DeviceIoControl.IoControlCode = IoControlCode;
+    o->Irp.Stack.Parameters.DeviceIoControl.Type3InputBuffer = InputBuffer;
+    o->Irp.Stack.Parameters.DeviceIoControl.InputBufferLength = InputLength;
+    o->Irp.Stack.Parameters.DeviceIoControl.OutputBufferLength = OutputLength;
+
+    return (WDFREQUEST)o;
+}
+
+VOID StandInDispatch(WDFDEVICE Device, WDFREQUEST Request)
+{
+    object* q = ((object*)Device)->DefaultQueue;
+    PIO_STACK_LOCATION stack = &((object*)Request)->Irp.Stack;
+
+    q->QueueConfig.EvtIoInternalDeviceControl(
+        (WDFQUEUE)q,
+        Request,
+        stack->Parameters.DeviceIoControl.OutputBufferLength,
+        stack->Parameters.DeviceIoControl.InputBufferLength,
+        stack->Parameters.DeviceIoControl.IoControlCode);
+}
+
+ULONG StandInCompleted(WDFREQUEST Request, NTSTATUS* Status, ULONG_PTR* Information)
+{
+    object* o = (object*)Request;
+    ULONG completions;
+
+    pthread_mutex_lock(&lock);
+
+    completions = o->Completions;
+
+    if (Status != NULL)
+    {
+        *Status = o->Irp.IoStatus.Status;
+    }
+
+    if (Information != NULL)
+    {
+        *Information = o->Irp.IoStatus.Information;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return completions;
+}
+
+BOOLEAN StandInCancelRequest(WDFREQUEST Request)
+{
+    object* o = (object*)Request;
+    object* q;
+
+    pthread_mutex_lock(&lock);
+
+    q = o->Queue;
+
+    if (q != NULL)
+    {
+        unlink_locked(&q->Head, o, offsetof(object, NextRequest));
+
+        q->Tail = q->Head;
+        while (q->Tail != NULL && q->Tail->NextRequest != NULL)
+        {
+            q->Tail = q->Tail->NextRequest;
+        }
+
+        o->Queue = NULL;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    // Manual queues without a cancel callback complete the request as cancelled
+    if (q != NULL)
+    {
+        WdfRequestComplete(Request, STATUS_CANCELLED);
+    }
+
+    return q != NULL;
+}
+
+VOID StandInDeleteRequest(WDFREQUEST Request)
+{
+    destroy((object*)Request);
+}
+
+PIRP WdfRequestWdmGetIrp(WDFREQUEST Request)
+{
+    return &((object*)Request)->Irp;
+}
+
+VOID WdfRequestGetParameters(WDFREQUEST Request, PWDF_REQUEST_PARAMETERS Parameters)
+{
+    PIO_STACK_LOCATION stack = &((object*)Request)->Irp.Stack;
+
+    Parameters->Parameters.DeviceIoControl.OutputBufferLength = stack->Parameters.DeviceIoControl.OutputBufferLength;
+    Parameters->Parameters.DeviceIoControl.InputBufferLength = stack->Parameters.DeviceIoControl.InputBufferLength;
+    Parameters->Parameters.DeviceIoControl.IoControlCode = stack->Parameters.DeviceIoControl.IoControlCode;
+}
+
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID* Buffer, size_t* Length)
+{
+    PIRP irp = &((object*)Request)->Irp;
+    size_t length = irp->Stack.Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (irp->UserBuffer == NULL || length == 0)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    if (length < MinimumRequiredSize)
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    *Buffer = irp->UserBuffer;
+
+    if (Length != NULL)
+    {
+        *Length = length;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestRetrieveOutputMemory(WDFREQUEST Request, WDFMEMORY* Memory)
+{
+    object* o = (object*)Request;
+
+    if (o->Irp.UserBuffer == NULL || o->Irp.Stack.Parameters.DeviceIoControl.OutputBufferLength == 0)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    //
+    // Part of the request, made the first time it is asked for
+    //
+    if (o->OutputMemory == NULL)
+    {
+        o->OutputMemory = calloc(1, sizeof(object));
+        o->OutputMemory->Kind = ObjectMemory;
+    }
+
+    o->OutputMemory->Buffer = o->Irp.UserBuffer;
+    o->OutputMemory->Length = o->Irp.Stack.Parameters.DeviceIoControl.OutputBufferLength;
+
+    *Memory = (WDFMEMORY)o->OutputMemory;
+    return STATUS_SUCCESS;
+}
+
+VOID WdfRequestSetInformation(WDFREQUEST Request, ULONG_PTR Information)
+{
+    ((object*)Request)->Irp.IoStatus.Information = Information;
+}
+
+VOID WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status)
+{
+    object* o = (object*)Request;
+
+    pthread_mutex_lock(&lock);
+
+    o->Irp.IoStatus.Status = Status;
+    o->Completions++;
+
+    pthread_mutex_unlock(&lock);
+}
+
+NTSTATUS WdfRequestCreate(PWDF_OBJECT_ATTRIBUTES Attributes, WDFIOTARGET IoTarget, WDFREQUEST* Request)
+{
+    *Request = (WDFREQUEST)make(ObjectRequest, Attributes, (object*)IoTarget, 1);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestReuse(WDFREQUEST Request, PWDF_REQUEST_REUSE_PARAMS ReuseParams)
+{
+    object* o = (object*)Request;
+
+    o->Irp.IoStatus.Status = ReuseParams->Status;
+    o->Irp.IoStatus.Information = 0;
+    o->Completions = 0;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestGetStatus(WDFREQUEST Request)
+{
+    return ((object*)Request)->Irp.IoStatus.Status;
+}
+
+//
+// Memory and I/O targets. The only target is the GPIO controller.
+//
+NTSTATUS WdfMemoryCreatePreallocated(PWDF_OBJECT_ATTRIBUTES Attributes, PVOID Buffer, size_t BufferSize, WDFMEMORY* Memory)
+{
+    object* o = make(ObjectMemory, Attributes, NULL, 1);
+
+    o->Buffer = Buffer;
+    o->Length = BufferSize;
+
+    *Memory = (WDFMEMORY)o;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfMemoryCopyFromBuffer(WDFMEMORY Destination, size_t DestinationOffset, PVOID Buffer, size_t NumBytesToCopyFrom)
+{
+    object* o = (object*)Destination;
+
+    if (DestinationOffset > o->Length || NumBytesToCopyFrom > o->Length - DestinationOffset)
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    memcpy((char*)o->Buffer + DestinationOffset, Buffer, NumBytesToCopyFrom);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoTargetCreate(WDFDEVICE Device, PWDF_OBJECT_ATTRIBUTES Attributes, WDFIOTARGET* IoTarget)
+{
+    *IoTarget = (WDFIOTARGET)make(ObjectIoTarget, Attributes, (object*)Device, 1);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoTargetOpen(WDFIOTARGET IoTarget, PWDF_IO_TARGET_OPEN_PARAMS OpenParams)
+{
+    (void)IoTarget;
+
+    return OpenParams->TargetDeviceName != NULL && OpenParams->TargetDeviceName->Length != 0 ?
+        STATUS_SUCCESS : STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+NTSTATUS WdfIoTargetFormatRequestForIoctl(WDFIOTARGET IoTarget, WDFREQUEST Request, ULONG IoctlCode, WDFMEMORY InputBuffer, PVOID InputBufferOffset, WDFMEMORY OutputBuffer, PVOID OutputBufferOffset)
+{
+    object* o = (object*)Request;
+
+    (void)IoTarget;
+    (void)InputBuffer;
+    (void)InputBufferOffset;
+    (void)OutputBufferOffset;
+
+    o->Irp.Stack.Parameters.DeviceIoControl.IoControlCode = IoctlCode;
+    o->Irp.UserBuffer = OutputBuffer;
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN WdfRequestSend(WDFREQUEST Request, WDFIOTARGET Target, PWDF_REQUEST_SEND_OPTIONS Options)
+{
+    object* o = (object*)Request;
+    object* output = o->Irp.UserBuffer;
+    ULONG pins;
+
+    (void)Target;
+    (void)Options;
+
+    if (o->Irp.Stack.Parameters.DeviceIoControl.IoControlCode != IOCTL_GPIO_READ_PINS)
+    {
+        o->Irp.IoStatus.Status = STATUS_INVALID_DEVICE_REQUEST;
+        return TRUE;
+    }
+
+    if (output == NULL || output->Length < sizeof(ULONG))
+    {
+        o->Irp.IoStatus.Status = STATUS_BUFFER_TOO_SMALL;
+        return TRUE;
+    }
+
+    if (StandInLevelReadHook != NULL)
+    {
+        StandInLevelReadHook();
+    }
+
+    pins = __atomic_load_n(&StandInPins, __ATOMIC_SEQ_CST);
+    memcpy(output->Buffer, &pins, sizeof(pins));
+
+    __atomic_add_fetch(&StandInLevelReads, 1, __ATOMIC_SEQ_CST);
+
+    o->Irp.IoStatus.Status = STATUS_SUCCESS;
+    o->Irp.IoStatus.Information = sizeof(pins);
+
+    return TRUE;
+}
@@ -0,0 +1,6 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#pragma once
+
+#define IOCTL_GPIO_READ_PINS            0x00010000
+#define IOCTL_GPIO_WRITE_PINS           0x00018004
@@ -0,0 +1,69 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#pragma once
+
+#include <pshpack1.h>
+
+typedef struct _HID_DESCRIPTOR
+{
+    UCHAR bLength;
+    UCHAR bDescriptorType;
+    USHORT bcdHID;
+    UCHAR bCountry;
+    UCHAR bNumDescriptors;
+
+    struct _HID_DESCRIPTOR_DESC_LIST
+    {
+        UCHAR bReportType;
+        USHORT wReportLength;
+    } DescriptorList[1];
+} HID_DESCRIPTOR, *PHID_DESCRIPTOR;
+
+#include <poppack.h>
+
+#define HID_HID_DESCRIPTOR_TYPE         0x21
+#define HID_REPORT_DESCRIPTOR_TYPE      0x22
+#define HID_REVISION                    0x00000001
+
+#define HID_STRING_ID_IMANUFACTURER     14
+#define HID_STRING_ID_IPRODUCT          15
+#define HID_STRING_ID_ISERIALNUMBER     16
+
+typedef struct _HID_DEVICE_ATTRIBUTES
+{
+    ULONG Size;
+    USHORT VendorID;
+    USHORT ProductID;
+    USHORT VersionNumber;
+    USHORT Reserved[11];
+} HID_DEVICE_ATTRIBUTES, *PHID_DEVICE_ATTRIBUTES;
+
+typedef struct _HID_XFER_PACKET
+{
+    PUCHAR reportBuffer;
+    ULONG reportBufferLen;
+    UCHAR reportId;
+} HID_XFER_PACKET, *PHID_XFER_PACKET;
+
+typedef VOID (*HID_IDLE_CALLBACK)(PVOID Context);
+
+typedef struct _HID_SUBMIT_IDLE_NOTIFICATION_CALLBACK_INFO
+{
+    HID_IDLE_CALLBACK IdleCallback;
+    PVOID IdleContext;
+} HID_SUBMIT_IDLE_NOTIFICATION_CALLBACK_INFO, *PHID_SUBMIT_IDLE_NOTIFICATION_CALLBACK_INFO;
+
+//
+// Any distinct values do, requests only ever come from the harnesses
+//
+#define IOCTL_HID_GET_DEVICE_DESCRIPTOR             0x000B0003
+#define IOCTL_HID_GET_REPORT_DESCRIPTOR             0x000B0007
+#define IOCTL_HID_READ_REPORT                       0x000B000B
+#define IOCTL_HID_WRITE_REPORT                      0x000B000F
+#define IOCTL_HID_GET_STRING                        0x000B0013
+#define IOCTL_HID_ACTIVATE_DEVICE                   0x000B001F
+#define IOCTL_HID_DEACTIVATE_DEVICE                 0x000B0023
+#define IOCTL_HID_GET_DEVICE_ATTRIBUTES             0x000B0027
+#define IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST    0x000B002B
+#define IOCTL_HID_SET_FEATURE                       0x000B0191
+#define IOCTL_HID_GET_FEATURE                       0x000B0192
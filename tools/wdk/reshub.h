@@ -0,0 +1,28 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#pragma once
+
+#include <stdio.h>
+
+#define RESOURCE_HUB_PATH_SIZE          64
+
+//
+// The path only has to be well formed, framework.c opens any target
+//
+static inline NTSTATUS RESOURCE_HUB_CREATE_PATH_FROM_ID(PUNICODE_STRING DevicePath, ULONG IdLowPart, ULONG IdHighPart)
+{
+    int length = swprintf(
+        DevicePath->Buffer,
+        DevicePath->MaximumLength / sizeof(WCHAR),
+        L"\\Device\\RESOURCE_HUB\\%08X%08X",
+        IdHighPart,
+        IdLowPart);
+
+    if (length < 0)
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    DevicePath->Length = (USHORT)(length * sizeof(WCHAR));
+    return STATUS_SUCCESS;
+}
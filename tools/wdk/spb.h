@@ -0,0 +1,3 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+#pragma once
@@ -0,0 +1,120 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Harness side of the stand-in framework in framework.c.
+//
+// A harness plays the PnP and power managers, HIDCLASS and the GPIO
+// controller: it adds and starts the device, moves it between D0 and Dx,
+// raises interrupts and sends requests to the default queue. Nothing runs
+// on its own. Work items and timers run when a harness thread calls
+// StandInRunWorkItems or StandInRunTimers, which several threads may do at
+// once, and time only moves when the harness advances the virtual clock.
+//
+
+#pragma once
+
+#include <wdm.h>
+#include <wdf.h>
+
+//
+// Interrupt time of the virtual clock, in 100ns units. Starts at one
+// second so that no timestamp taken by the driver is ever 0.
+//
+extern volatile ULONGLONG StandInTime;
+
+VOID StandInAdvance(ULONGLONG Ticks);
+
+//
+// Pins of the GPIO IO connection as IOCTL_GPIO_READ_PINS returns them, and
+// the number of reads sent so far. StandInLevelReadHook, if set, runs just
+// before a read samples the pins, on the thread sending it.
+//
+extern volatile ULONG StandInPins;
+extern volatile LONG StandInLevelReads;
+extern VOID (*StandInLevelReadHook)(VOID);
+
+//
+// Framework objects the driver created and deleted. Requests made by
+// StandInCreateRequest are the system's and not counted.
+//
+extern volatile LONG StandInObjectsCreated;
+extern volatile LONG StandInObjectsDeleted;
+
+//
+// Debug output of the driver goes to stderr if set
+//
+extern BOOLEAN StandInDebugOutput;
+
+//
+// Sets a REG_DWORD value, seen by every key the driver opens
+//
+VOID StandInSetRegistryValue(PCWSTR Name, ULONG Value);
+
+//
+// Runs DriverEntry, then the device add callback it registered
+//
+WDFDEVICE StandInAddDevice(DRIVER_INITIALIZE* DriverEntry);
+
+//
+// Hands the device Interrupts interrupt resources, plus a GPIO IO
+// connection if GpioIo, prepares the hardware and brings it to D0
+//
+NTSTATUS StandInStartDevice(WDFDEVICE Device, ULONG Interrupts, BOOLEAN GpioIo);
+
+//
+// D0 exit: the interrupts are disabled and their work items flushed, then
+// the device's D0 exit callback runs. From here until the next D0 entry an
+// interrupt of a wake capable line wakes the device instead.
+//
+NTSTATUS StandInPowerDown(WDFDEVICE Device, WDF_POWER_DEVICE_STATE TargetState);
+
+//
+// D0 entry from the state the last power down went to: the device's D0
+// entry callback, then the interrupts are enabled, then the post
+// interrupts enabled callback
+//
+NTSTATUS StandInPowerUp(WDFDEVICE Device);
+
+//
+// Runs on the thread powering the device up, once its interrupts are
+// enabled and before the post interrupts enabled callback, if set
+//
+extern VOID (*StandInInterruptsEnabledHook)(WDFDEVICE Device);
+
+//
+// Raises the Index-th interrupt the device created, on the calling thread.
+// Returns TRUE if the ISR ran; otherwise the line was masked or the device
+// was between D0 exit and entry, and the edge is lost.
+//
+BOOLEAN StandInInterrupt(WDFDEVICE Device, ULONG Index);
+
+//
+// Runs queued work items until there are none left, returns how many ran
+//
+ULONG StandInRunWorkItems(VOID);
+
+//
+// Runs the timers due by StandInTime, returns how many ran
+//
+ULONG StandInRunTimers(VOID);
+
+//
+// Due time of the earliest timer started, 0 if none is
+//
+ULONGLONG StandInNextTimer(VOID);
+
+//
+// TRUE if no work item is queued or running and no timer is due or running
+//
+BOOLEAN StandInQuiet(VOID);
+
+//
+// Requests from HIDCLASS. Buffers are passed the way HIDCLASS passes them,
+// Type3InputBuffer and UserBuffer of the IRP.
+//
+WDFREQUEST StandInCreateRequest(ULONG IoControlCode, PVOID InputBuffer, ULONG InputLength, PVOID OutputBuffer, ULONG OutputLength);
+VOID StandInDispatch(WDFDEVICE Device, WDFREQUEST Request);
+ULONG StandInCompleted(WDFREQUEST Request, NTSTATUS* Status, ULONG_PTR* Information);
+BOOLEAN StandInCancelRequest(WDFREQUEST Request);
+VOID StandInDeleteRequest(WDFREQUEST Request);
+ULONG StandInQueueLength(WDFQUEUE Queue);
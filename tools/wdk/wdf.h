@@ -0,0 +1,319 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Host stand-in for the framework, enough of it to build every source of
+// the driver. The objects behind the handles, their contexts, queues,
+// interrupts, work items and timers are implemented by framework.c, which
+// the harnesses drive through standin.h.
+//
+
+#pragma once
+
+typedef PVOID WDFOBJECT;
+typedef struct WDFDRIVER__* WDFDRIVER;
+typedef struct WDFDEVICE__* WDFDEVICE;
+typedef struct WDFQUEUE__* WDFQUEUE;
+typedef struct WDFREQUEST__* WDFREQUEST;
+typedef struct WDFWORKITEM__* WDFWORKITEM;
+typedef struct WDFINTERRUPT__* WDFINTERRUPT;
+typedef struct WDFSPINLOCK__* WDFSPINLOCK;
+typedef struct WDFTIMER__* WDFTIMER;
+typedef struct WDFIOTARGET__* WDFIOTARGET;
+typedef struct WDFMEMORY__* WDFMEMORY;
+typedef struct WDFKEY__* WDFKEY;
+typedef struct WDFCMRESLIST__* WDFCMRESLIST;
+typedef struct WDFDEVICE_INIT* PWDFDEVICE_INIT;
+
+#define WDF_NO_OBJECT_ATTRIBUTES        NULL
+#define WDF_NO_HANDLE                   NULL
+
+typedef enum _WDF_TRI_STATE
+{
+    WdfFalse = 0,
+    WdfTrue = 1,
+    WdfUseDefault = 2,
+} WDF_TRI_STATE;
+
+typedef enum _WDF_EXECUTION_LEVEL
+{
+    WdfExecutionLevelInvalid = 0,
+    WdfExecutionLevelInheritFromParent,
+    WdfExecutionLevelPassive,
+    WdfExecutionLevelDispatch,
+} WDF_EXECUTION_LEVEL;
+
+typedef enum _WDF_SYNCHRONIZATION_SCOPE
+{
+    WdfSynchronizationScopeInvalid = 0,
+    WdfSynchronizationScopeInheritFromParent,
+    WdfSynchronizationScopeDevice,
+    WdfSynchronizationScopeQueue,
+    WdfSynchronizationScopeNone,
+} WDF_SYNCHRONIZATION_SCOPE;
+
+typedef enum _WDF_POWER_DEVICE_STATE
+{
+    WdfPowerDeviceInvalid = 0,
+    WdfPowerDeviceD0,
+    WdfPowerDeviceD1,
+    WdfPowerDeviceD2,
+    WdfPowerDeviceD3,
+    WdfPowerDeviceD3Final,
+} WDF_POWER_DEVICE_STATE;
+
+typedef VOID EVT_WDF_OBJECT_CONTEXT_CLEANUP(WDFOBJECT Object);
+typedef VOID EVT_WDF_OBJECT_CONTEXT_DESTROY(WDFOBJECT Object);
+typedef EVT_WDF_OBJECT_CONTEXT_CLEANUP EVT_WDF_DEVICE_CONTEXT_CLEANUP;
+
+//
+// ContextSize replaces the framework's context type information, all the
+// stand-in needs of it is how much to allocate
+//
+typedef struct _WDF_OBJECT_ATTRIBUTES
+{
+    EVT_WDF_OBJECT_CONTEXT_CLEANUP* EvtCleanupCallback;
+    EVT_WDF_OBJECT_CONTEXT_DESTROY* EvtDestroyCallback;
+    WDF_EXECUTION_LEVEL ExecutionLevel;
+    WDF_SYNCHRONIZATION_SCOPE SynchronizationScope;
+    WDFOBJECT ParentObject;
+    size_t ContextSize;
+} WDF_OBJECT_ATTRIBUTES, *PWDF_OBJECT_ATTRIBUTES;
+
+#define WDF_OBJECT_ATTRIBUTES_INIT(Attributes) \
+    memset((Attributes), 0, sizeof(WDF_OBJECT_ATTRIBUTES))
+
+#define WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(Attributes, Type) \
+    (WDF_OBJECT_ATTRIBUTES_INIT(Attributes), (Attributes)->ContextSize = sizeof(Type))
+
+PVOID StandInObjectContext(PVOID Handle);
+
+#define WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(Type, Function) \
+    static inline Type* Function(PVOID Handle) { return (Type*)StandInObjectContext(Handle); }
+
+VOID WdfObjectDelete(WDFOBJECT Object);
+
+//
+// Driver and device
+//
+typedef NTSTATUS EVT_WDF_DRIVER_DEVICE_ADD(WDFDRIVER Driver, PWDFDEVICE_INIT DeviceInit);
+
+typedef struct _WDF_DRIVER_CONFIG
+{
+    EVT_WDF_DRIVER_DEVICE_ADD* EvtDriverDeviceAdd;
+    ULONG DriverPoolTag;
+} WDF_DRIVER_CONFIG, *PWDF_DRIVER_CONFIG;
+
+#define WDF_DRIVER_CONFIG_INIT(Config, DeviceAdd) \
+    (memset((Config), 0, sizeof(WDF_DRIVER_CONFIG)), (Config)->EvtDriverDeviceAdd = (DeviceAdd))
+
+NTSTATUS WdfDriverCreate(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath, PWDF_OBJECT_ATTRIBUTES Attributes, PWDF_DRIVER_CONFIG Config, WDFDRIVER* Driver);
+PDRIVER_OBJECT WdfDriverWdmGetDriverObject(WDFDRIVER Driver);
+
+typedef NTSTATUS EVT_WDF_DEVICE_D0_ENTRY(WDFDEVICE Device, WDF_POWER_DEVICE_STATE PreviousState);
+typedef NTSTATUS EVT_WDF_DEVICE_D0_EXIT(WDFDEVICE Device, WDF_POWER_DEVICE_STATE TargetState);
+typedef EVT_WDF_DEVICE_D0_ENTRY EVT_WDF_DEVICE_D0_ENTRY_POST_INTERRUPTS_ENABLED;
+typedef EVT_WDF_DEVICE_D0_EXIT EVT_WDF_DEVICE_D0_EXIT_PRE_INTERRUPTS_DISABLED;
+typedef NTSTATUS EVT_WDF_DEVICE_PREPARE_HARDWARE(WDFDEVICE Device, WDFCMRESLIST ResourcesRaw, WDFCMRESLIST ResourcesTranslated);
+typedef NTSTATUS EVT_WDF_DEVICE_RELEASE_HARDWARE(WDFDEVICE Device, WDFCMRESLIST ResourcesTranslated);
+
+typedef struct _WDF_PNPPOWER_EVENT_CALLBACKS
+{
+    EVT_WDF_DEVICE_D0_ENTRY* EvtDeviceD0Entry;
+    EVT_WDF_DEVICE_D0_ENTRY_POST_INTERRUPTS_ENABLED* EvtDeviceD0EntryPostInterruptsEnabled;
+    EVT_WDF_DEVICE_D0_EXIT* EvtDeviceD0Exit;
+    EVT_WDF_DEVICE_D0_EXIT_PRE_INTERRUPTS_DISABLED* EvtDeviceD0ExitPreInterruptsDisabled;
+    EVT_WDF_DEVICE_PREPARE_HARDWARE* EvtDevicePrepareHardware;
+    EVT_WDF_DEVICE_RELEASE_HARDWARE* EvtDeviceReleaseHardware;
+} WDF_PNPPOWER_EVENT_CALLBACKS, *PWDF_PNPPOWER_EVENT_CALLBACKS;
+
+#define WDF_PNPPOWER_EVENT_CALLBACKS_INIT(Callbacks) \
+    memset((Callbacks), 0, sizeof(WDF_PNPPOWER_EVENT_CALLBACKS))
+
+VOID WdfDeviceInitSetPnpPowerEventCallbacks(PWDFDEVICE_INIT DeviceInit, PWDF_PNPPOWER_EVENT_CALLBACKS Callbacks);
+VOID WdfDeviceInitSetPowerPolicyOwnership(PWDFDEVICE_INIT DeviceInit, BOOLEAN IsPowerPolicyOwner);
+NTSTATUS WdfDeviceCreate(PWDFDEVICE_INIT* DeviceInit, PWDF_OBJECT_ATTRIBUTES Attributes, WDFDEVICE* Device);
+
+ULONG WdfCmResourceListGetCount(WDFCMRESLIST List);
+PCM_PARTIAL_RESOURCE_DESCRIPTOR WdfCmResourceListGetDescriptor(WDFCMRESLIST List, ULONG Index);
+
+//
+// Registry
+//
+NTSTATUS WdfDriverOpenParametersRegistryKey(WDFDRIVER Driver, ULONG DesiredAccess, PWDF_OBJECT_ATTRIBUTES Attributes, WDFKEY* Key);
+NTSTATUS WdfDeviceOpenRegistryKey(WDFDEVICE Device, ULONG DeviceInstanceKeyType, ULONG DesiredAccess, PWDF_OBJECT_ATTRIBUTES Attributes, WDFKEY* Key);
+NTSTATUS WdfRegistryQueryULong(WDFKEY Key, PCUNICODE_STRING ValueName, PULONG Value);
+VOID WdfRegistryClose(WDFKEY Key);
+
+//
+// Queues and requests
+//
+typedef enum _WDF_IO_QUEUE_DISPATCH_TYPE
+{
+    WdfIoQueueDispatchInvalid = 0,
+    WdfIoQueueDispatchSequential,
+    WdfIoQueueDispatchParallel,
+    WdfIoQueueDispatchManual,
+} WDF_IO_QUEUE_DISPATCH_TYPE;
+
+typedef VOID EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL(WDFQUEUE Queue, WDFREQUEST Request, size_t OutputBufferLength, size_t InputBufferLength, ULONG IoControlCode);
+typedef EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL;
+
+typedef struct _WDF_IO_QUEUE_CONFIG
+{
+    WDF_IO_QUEUE_DISPATCH_TYPE DispatchType;
+    WDF_TRI_STATE PowerManaged;
+    BOOLEAN DefaultQueue;
+    EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL* EvtIoDeviceControl;
+    EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL* EvtIoInternalDeviceControl;
+} WDF_IO_QUEUE_CONFIG, *PWDF_IO_QUEUE_CONFIG;
+
+#define WDF_IO_QUEUE_CONFIG_INIT(Config, Type) \
+    (memset((Config), 0, sizeof(WDF_IO_QUEUE_CONFIG)), (Config)->DispatchType = (Type), (Config)->PowerManaged = WdfUseDefault)
+
+#define WDF_IO_QUEUE_CONFIG_INIT_DEFAULT_QUEUE(Config, Type) \
+    (WDF_IO_QUEUE_CONFIG_INIT(Config, Type), (Config)->DefaultQueue = TRUE)
+
+NTSTATUS WdfIoQueueCreate(WDFDEVICE Device, PWDF_IO_QUEUE_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes, WDFQUEUE* Queue);
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue);
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST* Request);
+
+typedef struct _WDF_REQUEST_PARAMETERS
+{
+    union
+    {
+        struct
+        {
+            size_t OutputBufferLength;
+            size_t InputBufferLength;
+            ULONG IoControlCode;
+        } DeviceIoControl;
+    } Parameters;
+} WDF_REQUEST_PARAMETERS, *PWDF_REQUEST_PARAMETERS;
+
+#define WDF_REQUEST_PARAMETERS_INIT(Parameters) \
+    memset((Parameters), 0, sizeof(WDF_REQUEST_PARAMETERS))
+
+VOID WdfRequestGetParameters(WDFREQUEST Request, PWDF_REQUEST_PARAMETERS Parameters);
+PIRP WdfRequestWdmGetIrp(WDFREQUEST Request);
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID* Buffer, size_t* Length);
+NTSTATUS WdfRequestRetrieveOutputMemory(WDFREQUEST Request, WDFMEMORY* Memory);
+VOID WdfRequestSetInformation(WDFREQUEST Request, ULONG_PTR Information);
+VOID WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status);
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE Queue);
+NTSTATUS WdfRequestCreate(PWDF_OBJECT_ATTRIBUTES Attributes, WDFIOTARGET IoTarget, WDFREQUEST* Request);
+NTSTATUS WdfRequestGetStatus(WDFREQUEST Request);
+
+typedef struct _WDF_REQUEST_REUSE_PARAMS
+{
+    ULONG Flags;
+    NTSTATUS Status;
+} WDF_REQUEST_REUSE_PARAMS, *PWDF_REQUEST_REUSE_PARAMS;
+
+#define WDF_REQUEST_REUSE_NO_FLAGS      0
+
+#define WDF_REQUEST_REUSE_PARAMS_INIT(Params, ReuseFlags, ReuseStatus) \
+    ((Params)->Flags = (ReuseFlags), (Params)->Status = (ReuseStatus))
+
+NTSTATUS WdfRequestReuse(WDFREQUEST Request, PWDF_REQUEST_REUSE_PARAMS ReuseParams);
+
+typedef struct _WDF_REQUEST_SEND_OPTIONS
+{
+    ULONG Flags;
+    LONGLONG Timeout;
+} WDF_REQUEST_SEND_OPTIONS, *PWDF_REQUEST_SEND_OPTIONS;
+
+#define WDF_REQUEST_SEND_OPTION_TIMEOUT         0x00000001
+#define WDF_REQUEST_SEND_OPTION_SYNCHRONOUS     0x00000002
+
+#define WDF_REQUEST_SEND_OPTIONS_INIT(Options, SendFlags) \
+    ((Options)->Flags = (SendFlags), (Options)->Timeout = 0)
+
+BOOLEAN WdfRequestSend(WDFREQUEST Request, WDFIOTARGET Target, PWDF_REQUEST_SEND_OPTIONS Options);
+
+//
+// Memory
+//
+NTSTATUS WdfMemoryCreatePreallocated(PWDF_OBJECT_ATTRIBUTES Attributes, PVOID Buffer, size_t BufferSize, WDFMEMORY* Memory);
+NTSTATUS WdfMemoryCopyFromBuffer(WDFMEMORY Destination, size_t DestinationOffset, PVOID Buffer, size_t NumBytesToCopyFrom);
+
+//
+// I/O targets
+//
+typedef struct _WDF_IO_TARGET_OPEN_PARAMS
+{
+    PCUNICODE_STRING TargetDeviceName;
+    ULONG DesiredAccess;
+} WDF_IO_TARGET_OPEN_PARAMS, *PWDF_IO_TARGET_OPEN_PARAMS;
+
+#define WDF_IO_TARGET_OPEN_PARAMS_INIT_OPEN_BY_NAME(Params, Name, Access) \
+    ((Params)->TargetDeviceName = (Name), (Params)->DesiredAccess = (Access))
+
+NTSTATUS WdfIoTargetCreate(WDFDEVICE Device, PWDF_OBJECT_ATTRIBUTES Attributes, WDFIOTARGET* IoTarget);
+NTSTATUS WdfIoTargetOpen(WDFIOTARGET IoTarget, PWDF_IO_TARGET_OPEN_PARAMS OpenParams);
+NTSTATUS WdfIoTargetFormatRequestForIoctl(WDFIOTARGET IoTarget, WDFREQUEST Request, ULONG IoctlCode, WDFMEMORY InputBuffer, PVOID InputBufferOffset, WDFMEMORY OutputBuffer, PVOID OutputBufferOffset);
+
+//
+// Interrupts
+//
+typedef BOOLEAN EVT_WDF_INTERRUPT_ISR(WDFINTERRUPT Interrupt, ULONG MessageID);
+typedef VOID EVT_WDF_INTERRUPT_DPC(WDFINTERRUPT Interrupt, WDFOBJECT AssociatedObject);
+typedef VOID EVT_WDF_INTERRUPT_WORKITEM(WDFINTERRUPT Interrupt, WDFOBJECT AssociatedObject);
+
+typedef struct _WDF_INTERRUPT_CONFIG
+{
+    EVT_WDF_INTERRUPT_ISR* EvtInterruptIsr;
+    EVT_WDF_INTERRUPT_DPC* EvtInterruptDpc;
+    EVT_WDF_INTERRUPT_WORKITEM* EvtInterruptWorkItem;
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR InterruptRaw;
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR InterruptTranslated;
+    BOOLEAN PassiveHandling;
+    BOOLEAN CanWakeDevice;
+} WDF_INTERRUPT_CONFIG, *PWDF_INTERRUPT_CONFIG;
+
+#define WDF_INTERRUPT_CONFIG_INIT(Config, Isr, Dpc) \
+    (memset((Config), 0, sizeof(WDF_INTERRUPT_CONFIG)), (Config)->EvtInterruptIsr = (Isr), (Config)->EvtInterruptDpc = (Dpc))
+
+NTSTATUS WdfInterruptCreate(WDFDEVICE Device, PWDF_INTERRUPT_CONFIG Configuration, PWDF_OBJECT_ATTRIBUTES Attributes, WDFINTERRUPT* Interrupt);
+WDFDEVICE WdfInterruptGetDevice(WDFINTERRUPT Interrupt);
+BOOLEAN WdfInterruptQueueWorkItemForIsr(WDFINTERRUPT Interrupt);
+VOID WdfInterruptEnable(WDFINTERRUPT Interrupt);
+VOID WdfInterruptDisable(WDFINTERRUPT Interrupt);
+
+//
+// Work items, timers and locks
+//
+typedef VOID EVT_WDF_WORKITEM(WDFWORKITEM WorkItem);
+
+typedef struct _WDF_WORKITEM_CONFIG
+{
+    EVT_WDF_WORKITEM* EvtWorkItemFunc;
+    BOOLEAN AutomaticSerialization;
+} WDF_WORKITEM_CONFIG, *PWDF_WORKITEM_CONFIG;
+
+#define WDF_WORKITEM_CONFIG_INIT(Config, Function) \
+    ((Config)->EvtWorkItemFunc = (Function), (Config)->AutomaticSerialization = TRUE)
+
+NTSTATUS WdfWorkItemCreate(PWDF_WORKITEM_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes, WDFWORKITEM* WorkItem);
+VOID WdfWorkItemEnqueue(WDFWORKITEM WorkItem);
+
+typedef VOID EVT_WDF_TIMER(WDFTIMER Timer);
+
+typedef struct _WDF_TIMER_CONFIG
+{
+    EVT_WDF_TIMER* EvtTimerFunc;
+    ULONG Period;
+    BOOLEAN AutomaticSerialization;
+    ULONG TolerableDelay;
+} WDF_TIMER_CONFIG, *PWDF_TIMER_CONFIG;
+
+#define WDF_TIMER_CONFIG_INIT(Config, Function) \
+    (memset((Config), 0, sizeof(WDF_TIMER_CONFIG)), (Config)->EvtTimerFunc = (Function), (Config)->AutomaticSerialization = TRUE)
+
+NTSTATUS WdfTimerCreate(PWDF_TIMER_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes, WDFTIMER* Timer);
+BOOLEAN WdfTimerStart(WDFTIMER Timer, LONGLONG DueTime);
+BOOLEAN WdfTimerStop(WDFTIMER Timer, BOOLEAN Wait);
+WDFOBJECT WdfTimerGetParentObject(WDFTIMER Timer);
+
+NTSTATUS WdfSpinLockCreate(PWDF_OBJECT_ATTRIBUTES SpinLockAttributes, WDFSPINLOCK* SpinLock);
+VOID WdfSpinLockAcquire(WDFSPINLOCK SpinLock);
+VOID WdfSpinLockRelease(WDFSPINLOCK SpinLock);
@@ -0,0 +1,232 @@
+// Copyright (c) Bingxing Wang. All Rights Reserved.
+
+//
+// Host stand-in for the kernel types and routines the driver's sources
+// use. Interlocked and fenced accesses map to compiler atomics, the
+// interrupt time is the stand-in clock of framework.c, see standin.h.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+typedef void VOID;
+typedef void* PVOID;
+typedef unsigned char UCHAR, *PUCHAR, BOOLEAN, *PBOOLEAN, BYTE;
+typedef char CHAR;
+typedef const char* PCSTR;
+typedef unsigned short USHORT, *PUSHORT;
+typedef wchar_t WCHAR;
+typedef WCHAR* PWSTR;
+typedef const WCHAR* PCWSTR;
+typedef int32_t LONG, *PLONG, NTSTATUS;
+typedef uint32_t ULONG, *PULONG, DWORD;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG, *PULONGLONG;
+typedef uintptr_t ULONG_PTR, *PULONG_PTR;
+typedef size_t SIZE_T;
+
+typedef union _LARGE_INTEGER
+{
+    struct
+    {
+        ULONG LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _UNICODE_STRING
+{
+    USHORT Length;
+    USHORT MaximumLength;
+    PWSTR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef const UNICODE_STRING* PCUNICODE_STRING;
+
+#define IN
+#define OUT
+#define _In_
+#define _Out_
+#define TRUE                            1
+#define FALSE                           0
+#define FORCEINLINE                     static inline
+#define DECLSPEC_CACHEALIGN             _Alignas(64)
+#define C_ASSERT(e)                     _Static_assert(e, #e)
+#define UNREFERENCED_PARAMETER(P)       ((void)(P))
+#define PAGED_CODE()
+#define NT_ASSERT(e)
+#define NT_ASSERTMSG(m, e)
+#define NT_SUCCESS(Status)              ((NTSTATUS)(Status) >= 0)
+#define MAXULONG                        0xFFFFFFFFul
+#define MAXULONGLONG                    (~(ULONGLONG)0)
+#define UNICODE_NULL                    ((WCHAR)0)
+#define RTL_NUMBER_OF(A)                (sizeof(A) / sizeof((A)[0]))
+#define min(a, b)                       ((a) < (b) ? (a) : (b))
+#define max(a, b)                       ((a) > (b) ? (a) : (b))
+
+#define RtlCopyMemory(Destination, Source, Length)  memcpy((Destination), (Source), (Length))
+#define RtlZeroMemory(Destination, Length)          memset((Destination), 0, (Length))
+
+#define RTL_CONSTANT_STRING(s)          { sizeof(s) - sizeof((s)[0]), sizeof(s), (PWSTR)(s) }
+#define DECLARE_CONST_UNICODE_STRING(Name, String) \
+    const UNICODE_STRING Name = RTL_CONSTANT_STRING(String)
+#define DECLARE_UNICODE_STRING_SIZE(Name, Size) \
+    WCHAR Name##_buffer[(Size)]; \
+    UNICODE_STRING Name = { 0, (Size) * sizeof(WCHAR), Name##_buffer }
+
+VOID RtlInitUnicodeString(PUNICODE_STRING Destination, PCWSTR Source);
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000L)
+#define STATUS_DEVICE_BUSY              ((NTSTATUS)0x80000011L)
+#define STATUS_NO_MORE_ENTRIES          ((NTSTATUS)0x8000001AL)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001L)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000DL)
+#define STATUS_INVALID_DEVICE_REQUEST   ((NTSTATUS)0xC0000010L)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS)0xC0000023L)
+#define STATUS_OBJECT_NAME_NOT_FOUND    ((NTSTATUS)0xC0000034L)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS)0xC000009AL)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BBL)
+#define STATUS_CANCELLED                ((NTSTATUS)0xC0000120L)
+#define STATUS_INVALID_BUFFER_SIZE      ((NTSTATUS)0xC0000206L)
+#define STATUS_NO_CALLBACK_ACTIVE       ((NTSTATUS)0xC000021CL)
+#define STATUS_NOT_FOUND                ((NTSTATUS)0xC0000225L)
+
+#define DPFLTR_IHVDRIVER_ID             77
+#define DPFLTR_ERROR_LEVEL              0
+
+ULONG DbgPrintEx(ULONG ComponentId, ULONG Level, PCSTR Format, ...);
+
+#define InterlockedIncrement(p)                 __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define InterlockedDecrement(p)                 __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define InterlockedAdd(p, v)                    __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define InterlockedOr(p, v)                     __atomic_fetch_or((p), (v), __ATOMIC_SEQ_CST)
+#define InterlockedExchange(p, v)               __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define InterlockedExchange64(p, v)             __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define ReadNoFence(p)                          __atomic_load_n((p), __ATOMIC_RELAXED)
+#define ReadNoFence64(p)                        __atomic_load_n((p), __ATOMIC_RELAXED)
+#define ReadAcquire(p)                          __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define WriteNoFence(p, v)                      __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define WriteNoFence64(p, v)                    __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define WriteRelease(p, v)                      __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static inline LONG InterlockedCompareExchange(volatile LONG* Destination, LONG Exchange, LONG Comparand)
+{
+    __atomic_compare_exchange_n(Destination, &Comparand, Exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return Comparand;
+}
+
+static inline LONGLONG InterlockedCompareExchange64(volatile LONGLONG* Destination, LONGLONG Exchange, LONGLONG Comparand)
+{
+    __atomic_compare_exchange_n(Destination, &Comparand, Exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return Comparand;
+}
+
+static inline BOOLEAN BitScanForward(ULONG* Index, ULONG Mask)
+{
+    if (Mask == 0)
+    {
+        return FALSE;
+    }
+
+    *Index = (ULONG)__builtin_ctz(Mask);
+    return TRUE;
+}
+
+static inline BOOLEAN BitScanReverse64(ULONG* Index, ULONGLONG Mask)
+{
+    if (Mask == 0)
+    {
+        return FALSE;
+    }
+
+    *Index = 63 - (ULONG)__builtin_clzll(Mask);
+    return TRUE;
+}
+
+static inline ULONG RtlNumberOfSetBitsUlongPtr(ULONG_PTR Target)
+{
+    return (ULONG)__builtin_popcountll((ULONGLONG)Target);
+}
+
+ULONGLONG KeQueryInterruptTime(VOID);
+ULONGLONG KeQueryInterruptTimePrecise(PULONGLONG QpcTimeStamp);
+
+//
+// Only the fields the driver touches
+//
+typedef struct _IO_STACK_LOCATION
+{
+    struct
+    {
+        struct
+        {
+            ULONG OutputBufferLength;
+            ULONG InputBufferLength;
+            ULONG IoControlCode;
+            PVOID Type3InputBuffer;
+        } DeviceIoControl;
+    } Parameters;
+} IO_STACK_LOCATION, *PIO_STACK_LOCATION;
+
+typedef struct _IRP
+{
+    PVOID UserBuffer;
+
+    struct
+    {
+        NTSTATUS Status;
+        ULONG_PTR Information;
+    } IoStatus;
+
+    IO_STACK_LOCATION Stack;
+} IRP, *PIRP;
+
+#define IoGetCurrentIrpStackLocation(Irp)   (&(Irp)->Stack)
+
+typedef struct _DRIVER_OBJECT
+{
+    PVOID DriverExtension;
+} DRIVER_OBJECT, *PDRIVER_OBJECT;
+
+typedef NTSTATUS DRIVER_INITIALIZE(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath);
+
+typedef struct _CM_PARTIAL_RESOURCE_DESCRIPTOR
+{
+    UCHAR Type;
+    UCHAR ShareDisposition;
+    USHORT Flags;
+
+    union
+    {
+        struct
+        {
+            UCHAR Class;
+            UCHAR Type;
+            UCHAR Reserved1;
+            UCHAR Reserved2;
+            ULONG IdLowPart;
+            ULONG IdHighPart;
+        } Connection;
+
+        struct
+        {
+            ULONG Level;
+            ULONG Vector;
+            ULONG_PTR Affinity;
+        } Interrupt;
+    } u;
+} CM_PARTIAL_RESOURCE_DESCRIPTOR, *PCM_PARTIAL_RESOURCE_DESCRIPTOR;
+
+#define CmResourceTypeInterrupt                 2
+#define CmResourceTypeConnection                132
+#define CM_RESOURCE_CONNECTION_CLASS_GPIO       1
+#define CM_RESOURCE_CONNECTION_TYPE_GPIO_IO     2
+
+#define KEY_READ                        0x20019
+#define PLUGPLAY_REGISTRY_DEVICE        1
+#define FILE_GENERIC_READ               0x120089